@@ -4,6 +4,20 @@
 
 #include <stdexcept>
 #include <cassert>
+#include <new>
+#include <utility>
+
+#include "ObjectPool.h"
+#include "ThreadPool.h"
+
+// Internal counters, recorded only when built with AVL_TREE_STATS
+#ifdef AVL_TREE_STATS
+#define AVL_STATS(statement) statement
+#define AVL_COMPARE(comparison) (this->stats.comparisons++, (comparison))
+#else
+#define AVL_STATS(statement)
+#define AVL_COMPARE(comparison) (comparison)
+#endif
 
 enum struct TreeStatusType {
     TREE_SUCCESS = 0,
@@ -12,6 +26,20 @@ enum struct TreeStatusType {
     TREE_INVALID_INPUT = -3
 } ;
 
+struct TreeStats {
+    unsigned long long comparisons;      // Key comparisons (including compare functions)
+    unsigned long long lookups;          // Descents from the root looking for a key
+    unsigned long long nodesVisited;     // Nodes visited by those descents
+    unsigned long long leftLeftRolls;
+    unsigned long long leftRightRolls;
+    unsigned long long rightLeftRolls;
+    unsigned long long rightRightRolls;
+    unsigned long long retraces;         // Walks back to the root after an insert or remove
+    unsigned long long retraceLength;    // Total number of nodes updated by those walks
+    int maxHeight;                       // Largest tree height seen (a single node has height 0)
+    long long liveBytes;                 // Heap bytes held by nodes, keys and values
+};
+
 template <class KeyType, class ValueType>
 struct Node {
     KeyType* key;
@@ -19,14 +47,259 @@ struct Node {
     Node* parent;
     Node* left;
     Node* right;
-    int height;
+    int height;       // Rank kept by the tree's balance policy, the height for AvlBalance
+    int subtreeSize;  // Number of nodes in the subtree rooted here
 };
 
+// Pools the nodes of AvlTrees sharing it are taken from, with their keys and values. Removed
+// nodes are reused by later inserts, so trees that stay below the pools' peak size do not
+// touch the heap. The pools must outlive the trees. Not thread safe, but see ObjectPool for
+// pools with a cache per thread.
 template <class KeyType, class ValueType>
+struct AvlNodePool {
+    ObjectPool<Node<KeyType, ValueType> > nodes;
+    ObjectPool<KeyType> keys;
+    ObjectPool<ValueType> values;
+
+    explicit AvlNodePool(int numCaches = 1) : nodes(numCaches), keys(numCaches), values(numCaches) {}
+
+    // Grows the pools to hold numNodes nodes, returns false when out of memory
+    bool reserve(long long numNodes) {
+        return nodes.reserve(numNodes) && keys.reserve(numNodes) && values.reserve(numNodes);
+    }
+
+    // Counters of the nodes, with the heap allocations of the keys and values added
+    PoolStats get_stats() const {
+        PoolStats result = nodes.get_stats();
+        result.heapAllocations += keys.get_stats().heapAllocations + values.get_stats().heapAllocations;
+        return result;
+    }
+};
+
+// Lookups find_many walks down the tree together, so that their cache misses overlap
+#define AVL_FIND_GROUP_SIZE 8
+
+#if defined(__GNUC__)
+#define AVL_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define AVL_PREFETCH(address)
+#endif
+
+// Parallel in order traversals split the tree at this depth at most (2^depth subtrees)
+#define AVL_MAX_SPLIT_DEPTH 8
+#define AVL_MAX_SPLIT_PIECES (2 << AVL_MAX_SPLIT_DEPTH)
+
+// Balance policies of AvlTree. A policy keeps Node::height as the rank of the node and
+// restores its rank rules after an insert or remove, walking up to the root (which also
+// updates the subtree sizes) and calling the tree's rotations.
+
+// Strict AVL: the rank is the height, the heights of sons differ by at most 1. Lookups are
+// the fastest, but a remove may rotate at every level of the path.
+struct AvlBalance {
+    template <class Tree, class NodeType>
+    static void rebalance_after_insert(Tree& tree, NodeType* node) {
+        retrace(tree, node->parent);
+    }
+
+    // child took the place of the removed node below parent (NULL for a removed leaf)
+    template <class Tree, class NodeType>
+    static void rebalance_after_remove(Tree& tree, NodeType* parent, NodeType* child) {
+        (void)child;
+        retrace(tree, parent);
+    }
+
+private:
+    template <class Tree, class NodeType>
+    static void retrace(Tree& tree, NodeType* node) {
+        AVL_STATS(tree.stats.retraces++);
+        while (node != NULL) {
+            AVL_STATS(tree.stats.retraceLength++);
+            tree.update_height(node);
+            tree.balance_tree(node);
+            node = node->parent;
+        }
+    }
+};
+
+// Weak AVL (Haeupler, Sen and Tarjan): a son's rank is 1 or 2 below its parent's (a missing
+// son has rank -1) and leaves have rank 0. Inserts rebalance like AVL, and without removes the
+// tree is an AVL tree, but a remove stops after at most two rotations, so updates (a remove and
+// an insert) do O(1) amortized rotations. The height stays below 2 log n, the ranks are an upper
+// bound of the heights.
+struct WavlBalance {
+    template <class Tree, class NodeType>
+    static void rebalance_after_insert(Tree& tree, NodeType* node) {
+        // The new leaf has rank 0, a son with its parent's rank is fixed going up
+        bool fixing = true;
+        AVL_STATS(tree.stats.retraces++);
+        while (node->parent != NULL) {
+            NodeType* parent = node->parent;
+            AVL_STATS(tree.stats.retraceLength++);
+            tree.update_size(parent);
+            if (fixing && parent->height == node->height) {
+                NodeType* sibling = parent->left == node ? parent->right : parent->left;
+                if (parent->height - rank(sibling) == 1) {
+                    parent->height++;
+                }
+                else {
+                    node = rotate_after_insert(tree, parent, node);
+                    fixing = false;
+                    continue;
+                }
+            }
+            else {
+                fixing = false;
+            }
+            node = parent;
+        }
+    }
+
+    template <class Tree, class NodeType>
+    static void rebalance_after_remove(Tree& tree, NodeType* parent, NodeType* child) {
+        // child's subtree lost a node, which may leave it 3 ranks below parent
+        bool fixing = true;
+        AVL_STATS(tree.stats.retraces++);
+        while (parent != NULL) {
+            AVL_STATS(tree.stats.retraceLength++);
+            tree.update_size(parent);
+            NodeType* next = parent;
+            // Once the ranks are fixed only the sizes up to the root are left
+            if (fixing && parent->left == NULL && parent->right == NULL) {
+                // A leaf of rank 1 is demoted, which may leave it 3 ranks below its parent
+                fixing = parent->height == 1;
+                parent->height = 0;
+            }
+            else if (fixing && parent->height - rank(child) == 3) {
+                NodeType* sibling = parent->left == child ? parent->right : parent->left;
+                if (parent->height - sibling->height == 2) {
+                    parent->height--;
+                }
+                else if (rank(sibling->left) == sibling->height - 2 && rank(sibling->right) == sibling->height - 2) {
+                    parent->height--;
+                    sibling->height--;
+                }
+                else {
+                    next = rotate_after_remove(tree, parent, sibling);
+                    fixing = false;
+                }
+            }
+            else {
+                fixing = false;
+            }
+            child = next;
+            parent = next->parent;
+        }
+    }
+
+private:
+    template <class NodeType>
+    static int rank(const NodeType* node) {
+        return node == NULL ? -1 : node->height;
+    }
+
+    // Lifts son above its parent, the subtree sizes follow, the ranks are left to the caller
+    template <class Tree, class NodeType>
+    static void rotate_up(Tree& tree, NodeType* son) {
+        NodeType* parent = son->parent;
+        if (parent->left == son) {
+            tree.rotate_right(parent);
+        }
+        else {
+            tree.rotate_left(parent);
+        }
+        tree.update_size(parent);
+        tree.update_size(son);
+    }
+
+    // node has its parent's rank and a sibling 2 ranks below, returns the new root of the subtree
+    template <class Tree, class NodeType>
+    static NodeType* rotate_after_insert(Tree& tree, NodeType* parent, NodeType* node) {
+        bool isLeftSon = parent->left == node;
+        NodeType* inner = isLeftSon ? node->right : node->left;
+        parent->height--;
+        if (node->height - rank(inner) == 2) {
+            AVL_STATS(isLeftSon ? tree.stats.leftLeftRolls++ : tree.stats.rightRightRolls++);
+            rotate_up(tree, node);
+            return node;
+        }
+        AVL_STATS(isLeftSon ? tree.stats.leftRightRolls++ : tree.stats.rightLeftRolls++);
+        rotate_up(tree, inner);
+        rotate_up(tree, inner);
+        inner->height++;
+        node->height--;
+        return inner;
+    }
+
+    // The other son of parent is 3 ranks below it, sibling is 1 rank below and not a 2,2 node
+    template <class Tree, class NodeType>
+    static NodeType* rotate_after_remove(Tree& tree, NodeType* parent, NodeType* sibling) {
+        bool isLeftSon = parent->left == sibling;
+        NodeType* outer = isLeftSon ? sibling->left : sibling->right;
+        NodeType* inner = isLeftSon ? sibling->right : sibling->left;
+        if (sibling->height - rank(outer) == 1) {
+            AVL_STATS(isLeftSon ? tree.stats.leftLeftRolls++ : tree.stats.rightRightRolls++);
+            rotate_up(tree, sibling);
+            sibling->height++;
+            parent->height -= parent->left == NULL && parent->right == NULL ? 2 : 1;
+            return sibling;
+        }
+        AVL_STATS(isLeftSon ? tree.stats.leftRightRolls++ : tree.stats.rightLeftRolls++);
+        rotate_up(tree, inner);
+        rotate_up(tree, inner);
+        inner->height += 2;
+        sibling->height--;
+        parent->height -= 2;
+        return inner;
+    }
+};
+
+template <class KeyType, class ValueType, class BalancePolicy = AvlBalance>
 class AvlTree {
-    // Real root is right son of root
+    friend BalancePolicy;
+
+    // A part of the in order sequence: a whole subtree, or a single node above the split depth
+    struct InOrderPiece {
+        Node<KeyType, ValueType>* node;
+        bool wholeSubtree;
+        int offset;  // Position of the piece's first node in the in order sequence
+        int size;
+    };
+
+    template <class OutputType>
+    struct MapInOrderJob {
+        InOrderPiece pieces[AVL_MAX_SPLIT_PIECES];
+        OutputType* array;
+        OutputType (*mapFunc)(ValueType value);
+    };
+
+    // Real root is right son of root, which points at dummyRoot (no node has it as parent)
+    Node<KeyType, ValueType> dummyRoot;
     Node<KeyType, ValueType>* root;
     int size;
+    // Last inserted node, where insert_near_last starts looking (NULL once removed or relinked)
+    Node<KeyType, ValueType>* finger;
+    bool fingerIsMax;
+    // Where nodes, keys and values are allocated, the heap when NULL
+    AvlNodePool<KeyType, ValueType>* nodePool;
+
+    // Allocate from nodePool or the heap, throw std::bad_alloc
+    Node<KeyType, ValueType>* new_node();
+    template <class KeyArg>
+    KeyType* new_key(KeyArg&& key);
+    template <class ValueArg>
+    ValueType* new_value(ValueArg&& value);
+    // Frees a node with its key and value (either may be NULL)
+    void delete_node(Node<KeyType, ValueType>* node);
+#ifdef AVL_TREE_STATS
+    mutable TreeStats stats;
+
+    // Updates the max height seen after the tree changed
+    void record_height() {
+        if (root->right != NULL && root->right->height > stats.maxHeight) {
+            stats.maxHeight = root->right->height;
+        }
+    }
+#endif
 
     // Balances a tree when given the problematic node
     void balance_tree(Node<KeyType, ValueType>* currParentNode);
@@ -45,12 +318,19 @@ class AvlTree {
     
     // Does a right right roll
     void right_right_roll(Node<KeyType, ValueType>* root);
+
+    // Lift the left (right) son of node above it, only relinking the nodes
+    void rotate_right(Node<KeyType, ValueType>* node);
+    void rotate_left(Node<KeyType, ValueType>* node);
     
     // Swaps between two nodes
     void swap_nodes(Node<KeyType, ValueType>* node1, Node<KeyType, ValueType>* node2);
     
-    // Updates height of a specific node
+    // Updates height and subtree size of a specific node from its sons
     void update_height(Node<KeyType, ValueType>* node);
+
+    // Updates the subtree size of a specific node from its sons
+    static void update_size(Node<KeyType, ValueType>* node);
     
     // Gets nodes into given array in order
     void in_order(Node<KeyType, ValueType>** array,
@@ -74,19 +354,57 @@ class AvlTree {
     
     // Deletes all tree nodes (except dummy tree)
     void delete_tree_nodes(Node<KeyType, ValueType>* node);
+
+    // Turns a subtree into a sorted list linked through the right pointers, followed by rest
+    Node<KeyType, ValueType>* flatten_to_list(Node<KeyType, ValueType>* node, Node<KeyType, ValueType>* rest);
+
+    // Relinks the first length nodes of a sorted list into a balanced subtree, advancing head past them
+    Node<KeyType, ValueType>* build_from_list(Node<KeyType, ValueType>** head, int length);
+
+    // Collects the in order pieces of a subtree when split at the given depth
+    static void split_in_order(Node<KeyType, ValueType>* node, int depth, InOrderPiece* pieces, int* counter);
+
+    static int subtree_size(const Node<KeyType, ValueType>* node);
+
+    static ValueType copy_value(ValueType value);
+
+    // Finds the node at the given in order index of a subtree, using the subtree sizes
+    static Node<KeyType, ValueType>* select_in_order(Node<KeyType, ValueType>* node, int index);
+
+    // Finds the previous node in order, NULL for the first one
+    static Node<KeyType, ValueType>* get_previous_in_order(Node<KeyType, ValueType>* node);
+
+    template <class OutputType>
+    static void map_subtree_in_order(OutputType* array, const Node<KeyType, ValueType>* node, int* counter, OutputType (*mapFunc)(ValueType value));
+
+    // ThreadPool tasks of map_values_in_order, the context is a MapInOrderJob
+    template <class OutputType>
+    static void size_piece_task(int pieceIdx, void* context);
+    template <class OutputType>
+    static void map_piece_task(int pieceIdx, void* context);
+
+    // Calls func on the values of a subtree in order (by keys)
+    void values_for_each(Node<KeyType, ValueType>* const node, void (*func)(ValueType value, void* context), void* context)const;
     
      // Copies the nodes of a tree, without dummy root
     void copy_aux(Node<KeyType, ValueType>* copyToParent,
-        Node<KeyType, ValueType>* copyTo,
+        Node<KeyType, ValueType>*& copyTo,
         Node<KeyType, ValueType>** InOrder,
         Node<KeyType, ValueType>** PreOrder, int treeSize);
 
     // Fills an empty tree with a copy of another tree
-    void copy(AvlTree<KeyType, ValueType> const& toCopy,
-        AvlTree<KeyType, ValueType>& copyTo);
+    void copy(AvlTree<KeyType, ValueType, BalancePolicy> const& toCopy,
+        AvlTree<KeyType, ValueType, BalancePolicy>& copyTo);
 
-     // Inserts a given node to the tree in the right place and updates the tree stats
-    TreeStatusType place_node(Node<KeyType, ValueType>* toPlace);
+     // Inserts a given node to the tree in the right place, descending from start (the real root
+     // or a node whose subtree spans the new key), and updates the tree stats
+    TreeStatusType place_node(Node<KeyType, ValueType>* toPlace, Node<KeyType, ValueType>* start);
+
+    // Finds the node a search for key should start at, climbing from the finger until its subtree spans key
+    Node<KeyType, ValueType>* finger_search_start(const KeyType& key) const;
+
+    template <class KeyArg, class ValueArg>
+    TreeStatusType emplace_aux(KeyArg&& key, ValueArg&& value, bool nearLast);
  
     // Finds a node with the given key in the tree
     Node<KeyType, ValueType>* find_node_by_key(KeyType const& key) const;
@@ -106,28 +424,85 @@ class AvlTree {
      // Finds the next node inorder from the tree
     Node<KeyType, ValueType>* get_next_in_order(Node<KeyType, ValueType>* node);
 
+    // Builds a balanced subtree out of a sorted range, moving the elements when moveElements is set
+    Node<KeyType, ValueType>* build_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end, Node<KeyType, ValueType>* parent, bool moveElements);
+
+    TreeStatusType create_tree_from_sorted_array_aux(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length, bool moveElements);
+
 public:
-    AvlTree<KeyType, ValueType>();
-    AvlTree<KeyType, ValueType>(AvlTree<KeyType, ValueType>& tree);
+    AvlTree<KeyType, ValueType, BalancePolicy>();
+    // A tree taking its nodes from nodePool (NULL for the heap)
+    explicit AvlTree<KeyType, ValueType, BalancePolicy>(AvlNodePool<KeyType, ValueType>* nodePool);
+    // The copy uses the same node pool
+    AvlTree<KeyType, ValueType, BalancePolicy>(AvlTree<KeyType, ValueType, BalancePolicy>& tree);
     ~AvlTree();
-    AvlTree& operator=(AvlTree<KeyType, ValueType> const& tree);
-
-    TreeStatusType insert(KeyType& key, ValueType& value);
+    AvlTree& operator=(AvlTree<KeyType, ValueType, BalancePolicy> const& tree);
+
+    TreeStatusType insert(const KeyType& key, const ValueType& value);
+    TreeStatusType insert(KeyType&& key, ValueType&& value);
+    // Constructs the key and value in the new node from the given arguments (moved from when rvalues,
+    // also when the key already exists)
+    template <class KeyArg, class ValueArg>
+    TreeStatusType emplace(KeyArg&& key, ValueArg&& value);
+    // Same as insert / emplace, but the search for the new node's place starts at the last
+    // inserted node instead of the root (finger search), climbing only as far as needed. A new
+    // maximum right after a maximum is placed without any descent, so increasing keys are
+    // appended in O(1) comparisons (the heights and sizes are still updated up to the root).
+    TreeStatusType insert_near_last(const KeyType& key, const ValueType& value);
+    template <class KeyArg, class ValueArg>
+    TreeStatusType emplace_near_last(KeyArg&& key, ValueArg&& value);
     TreeStatusType find(const KeyType& key, ValueType* value) const;
+    // Sets the value of a key already in the tree, in place and without allocating
+    TreeStatusType replace(const KeyType& key, const ValueType& value);
+    // Looks up numKeys keys at once, writing the status of keys[i] into results[i] and its value
+    // into values[i] when found. The lookups advance in groups, each one prefetching its next node
+    // and key while the others compare, instead of waiting for every miss in turn.
+    void find_many(const KeyType* keys, int numKeys, ValueType* values, TreeStatusType* results) const;
+    // Same as above, writing mapFunc of the values into outputs
+    template <class OutputType>
+    void map_find_many(const KeyType* keys, int numKeys, OutputType* outputs, TreeStatusType* results, OutputType (*mapFunc)(ValueType value)) const;
     TreeStatusType remove(const KeyType& key);
     TreeStatusType remove_by_pointer(Node<KeyType, ValueType>* toDelete);
+    // Removes all the nodes without rebalancing, O(n)
+    void clear();
+    // Takes all the nodes of other (which is left empty) without copying or allocating, O(1)
+    // besides clearing this tree. Both trees must use the same node pool.
+    void steal(AvlTree<KeyType, ValueType, BalancePolicy>& other);
+    // Moves all the nodes of other (which is left empty) into this tree by relinking them, in
+    // O(n1 + n2) without allocating. Keys should be distinct, a key of other that is already in
+    // this tree is dropped. Both trees must use the same node pool.
+    void merge(AvlTree<KeyType, ValueType, BalancePolicy>& other);
     TreeStatusType get_size(int* n) const;
     TreeStatusType create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length);
-    Node<KeyType, ValueType>* get_root_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end, int height, Node<KeyType, ValueType>* parent);
+    // Same as above, but moves the arrays' elements into the tree instead of copying them
+    TreeStatusType move_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length);
     KeyType* find_max()const;
     KeyType* find_min()const;
     void get_tree_keys_in_order(KeyType* const array)const;
     void get_tree_values_in_order(ValueType* const array)const;
+    void for_each_value(void (*func)(ValueType value, void* context), void* context)const;
+    // Writes mapFunc of every value into array in order (by keys). Given a pool, the tree is split
+    // into subtrees that are sized and then filled in parallel, each at its own offset.
+    template <class OutputType>
+    void map_values_in_order(OutputType* const array, OutputType (*mapFunc)(ValueType value), ThreadPool* pool)const;
     ValueType* get_tree_values_ranged_in_order(int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const;
+    // A NULL validationFunc accepts every value in range
+    // Same as above into a caller owned array, which must fit get_num_of_values_ranged() values
+    int fill_tree_values_ranged_in_order(ValueType* const array, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const;
+    int get_num_of_values_ranged(KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const;
+    // Writes mapFunc of up to count values into array in descending order of keys, starting at
+    // firstRank (rank 0 holds the largest key). O(log n + count), returns the number of values written.
+    template <class OutputType>
+    int map_values_by_rank_desc(OutputType* const array, int firstRank, int count, OutputType (*mapFunc)(ValueType value))const;
+    // Number of keys larger than key, which need not be in the tree (its rank above when it is). O(log n).
+    int count_keys_above(const KeyType& key)const;
     void get_tree_in_order(Node<KeyType, ValueType>** const array);
     KeyType* get_closest_key(Node<KeyType, ValueType>* node, KeyType* key, KeyType* closestKey, int (*compareFunc)(KeyType* key1, KeyType* key2,KeyType* refKey), bool closestKeyValid) const;
     KeyType* find_closest_key(KeyType* key, int (*compareFunc)(KeyType* key1, KeyType* key2, KeyType* refKey))const;
-    
+
+    // Internal counters, all zero unless built with AVL_TREE_STATS (liveBytes is always filled)
+    TreeStats get_stats() const;
+    void reset_stats();
 };
 
 // Utitlity Methods
@@ -141,29 +516,33 @@ static int max(int num1, int num2) {
 /****************************************************************************/
 
 // tree balancing funcs
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::balance_tree(Node<KeyType, ValueType>* currParentNode) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::balance_tree(Node<KeyType, ValueType>* currParentNode) {
     int balanceFactor = this->balance_factor(currParentNode);
     if (balanceFactor == 2) {
         if (this->balance_factor(currParentNode->left) == -1) {
+            AVL_STATS(stats.leftRightRolls++);
             this->left_right_roll(currParentNode);
         }
         else {
+            AVL_STATS(stats.leftLeftRolls++);
             this->left_left_roll(currParentNode);
         }
     }
     if (balanceFactor == -2) {
         if (this->balance_factor(currParentNode->right) == 1) {
+            AVL_STATS(stats.rightLeftRolls++);
             this->right_left_roll(currParentNode);
         }
         else {
+            AVL_STATS(stats.rightRightRolls++);
             this->right_right_roll(currParentNode);
         }
     }
 }
 
-template <class KeyType, class ValueType>
-int AvlTree<KeyType, ValueType>::balance_factor(const Node<KeyType, ValueType>* const root) const {
+template <class KeyType, class ValueType, class BalancePolicy>
+int AvlTree<KeyType, ValueType, BalancePolicy>::balance_factor(const Node<KeyType, ValueType>* const root) const {
     assert(root != NULL);
     if (root->right == NULL && root->left == NULL) {
         return 0;
@@ -177,8 +556,24 @@ int AvlTree<KeyType, ValueType>::balance_factor(const Node<KeyType, ValueType>*
     return root->left->height - root->right->height;
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::left_left_roll(Node<KeyType, ValueType>* root) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::left_left_roll(Node<KeyType, ValueType>* root) {
+    Node<KeyType, ValueType>* pivot = root->left;
+    rotate_right(root);
+    update_height(root);
+    update_height(pivot);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::right_right_roll(Node<KeyType, ValueType>* const root) {
+    Node<KeyType, ValueType>* pivot = root->right;
+    rotate_left(root);
+    update_height(root);
+    update_height(pivot);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::rotate_right(Node<KeyType, ValueType>* const root) {
     Node<KeyType, ValueType>* node1 = root;
     Node<KeyType, ValueType>* node2 = root->left;
 
@@ -203,13 +598,10 @@ void AvlTree<KeyType, ValueType>::left_left_roll(Node<KeyType, ValueType>* root)
         node2->right->parent = node1;
     }
     node2->right = node1;
-
-    update_height(node1);
-    update_height(node2);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::right_right_roll(Node<KeyType, ValueType>* const root) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::rotate_left(Node<KeyType, ValueType>* const root) {
     Node<KeyType, ValueType>* node1 = root;
     Node<KeyType, ValueType>* node2 = root->right;
 
@@ -235,25 +627,22 @@ void AvlTree<KeyType, ValueType>::right_right_roll(Node<KeyType, ValueType>* con
         node2->left->parent = node1;
     }
     node2->left = node1;
-
-    update_height(node1);
-    update_height(node2);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::left_right_roll(Node<KeyType, ValueType>* const root) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::left_right_roll(Node<KeyType, ValueType>* const root) {
     right_right_roll(root->left);
     left_left_roll(root);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::right_left_roll(Node<KeyType, ValueType>* const root) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::right_left_roll(Node<KeyType, ValueType>* const root) {
     left_left_roll(root->right);
     right_right_roll(root);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::swap_nodes(Node<KeyType, ValueType>* const node1, Node<KeyType, ValueType>* const node2) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::swap_nodes(Node<KeyType, ValueType>* const node1, Node<KeyType, ValueType>* const node2) {
     assert(node1 != NULL && node2 != NULL);
 
     if (!node1->parent) { // True root is right son of tree root
@@ -280,6 +669,10 @@ void AvlTree<KeyType, ValueType>::swap_nodes(Node<KeyType, ValueType>* const nod
         node1->height = node2->height;
         node2->height = tempH;
 
+        int tempSize = node1->subtreeSize;
+        node1->subtreeSize = node2->subtreeSize;
+        node2->subtreeSize = tempSize;
+
         node2->left->parent = node2;
 
         if (node1->right) {
@@ -292,14 +685,17 @@ void AvlTree<KeyType, ValueType>::swap_nodes(Node<KeyType, ValueType>* const nod
         Node<KeyType, ValueType>* tempRight = node1->right;
         Node<KeyType, ValueType>* tempLeft = node1->left;
         int tempHeight = node1->height;
+        int tempSize = node1->subtreeSize;
 
         node1->parent = node2->parent;
         node1->height = node2->height;
+        node1->subtreeSize = node2->subtreeSize;
         node1->right = node2->right;
         node1->left = node2->left;
 
         node2->parent = currParentNode;
         node2->height = tempHeight;
+        node2->subtreeSize = tempSize;
         node2->right = tempRight;
         node2->left = tempLeft;
 
@@ -312,8 +708,8 @@ void AvlTree<KeyType, ValueType>::swap_nodes(Node<KeyType, ValueType>* const nod
     }
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::update_height(Node<KeyType, ValueType>* const node) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::update_height(Node<KeyType, ValueType>* const node) {
     assert(node != NULL);
     if (node->right == NULL && node->left == NULL) {
         node->height = 0;
@@ -327,30 +723,36 @@ void AvlTree<KeyType, ValueType>::update_height(Node<KeyType, ValueType>* const
     else {
         node->height = 1 + max(node->right->height, node->left->height);
     }
+    update_size(node);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::get_tree_in_order(
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::update_size(Node<KeyType, ValueType>* const node) {
+    node->subtreeSize = 1 + subtree_size(node->left) + subtree_size(node->right);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::get_tree_in_order(
     Node<KeyType, ValueType>** const array) {
 
     int counter = 0;
     in_order(array, this->root->right, &counter);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::get_tree_keys_in_order(KeyType* const array)const {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::get_tree_keys_in_order(KeyType* const array)const {
     int counter = 0;
     keys_in_order(array, root->right, &counter);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::get_tree_values_in_order(ValueType* const array)const {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::get_tree_values_in_order(ValueType* const array)const {
     int counter = 0;
     values_in_order(array, root->right, &counter);
 }
 
-template <class KeyType, class ValueType>
-ValueType* AvlTree<KeyType, ValueType>::get_tree_values_ranged_in_order(int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
+template <class KeyType, class ValueType, class BalancePolicy>
+ValueType* AvlTree<KeyType, ValueType, BalancePolicy>::get_tree_values_ranged_in_order(int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
     int arraySize = 0;
     num_of_values_ranged_in_order(root->right, &arraySize, minKey, maxKey, validationFunc);
     ValueType* array = new ValueType[arraySize];
@@ -358,68 +760,255 @@ ValueType* AvlTree<KeyType, ValueType>::get_tree_values_ranged_in_order(int* cou
     return array;
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::keys_in_order(KeyType* array, Node<KeyType, ValueType>* const node, int* counter)const {
+template <class KeyType, class ValueType, class BalancePolicy>
+int AvlTree<KeyType, ValueType, BalancePolicy>::fill_tree_values_ranged_in_order(ValueType* const array, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
+    int counter = 0;
+    values_ranged_in_order(array, root->right, &counter, minKey, maxKey, validationFunc);
+    return counter;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+int AvlTree<KeyType, ValueType, BalancePolicy>::get_num_of_values_ranged(KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
+    int counter = 0;
+    num_of_values_ranged_in_order(root->right, &counter, minKey, maxKey, validationFunc);
+    return counter;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class OutputType>
+int AvlTree<KeyType, ValueType, BalancePolicy>::map_values_by_rank_desc(OutputType* const array, int firstRank, int count, OutputType (*mapFunc)(ValueType value))const {
+    if (firstRank < 0 || firstRank >= size || count <= 0) {
+        return 0;
+    }
+    Node<KeyType, ValueType>* node = select_in_order(root->right, size - 1 - firstRank);
+    int counter = 0;
+    // Every step climbs or descends an edge that is walked at most twice over the whole range
+    while (node != NULL && counter < count) {
+        array[counter] = mapFunc(*node->value);
+        counter++;
+        node = get_previous_in_order(node);
+    }
+    return counter;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+int AvlTree<KeyType, ValueType, BalancePolicy>::count_keys_above(const KeyType& key)const {
+    Node<KeyType, ValueType>* node = root->right;
+    int counter = 0;
+    while (node != NULL) {
+        if (AVL_COMPARE(*(node->key) > key)) {
+            // The node and its right subtree are all above key
+            counter += 1 + subtree_size(node->right);
+            node = node->left;
+        }
+        else {
+            if (AVL_COMPARE(*(node->key) == key)) {
+                return counter + subtree_size(node->right);
+            }
+            node = node->right;
+        }
+    }
+    return counter;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::for_each_value(void (*func)(ValueType value, void* context), void* context)const {
+    values_for_each(root->right, func, context);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::split_in_order(Node<KeyType, ValueType>* node, int depth, InOrderPiece* pieces, int* counter) {
+    if (node == NULL) {
+        return;
+    }
+    if (depth == 0) {
+        pieces[*counter].node = node;
+        pieces[*counter].wholeSubtree = true;
+        (*counter)++;
+        return;
+    }
+    split_in_order(node->left, depth - 1, pieces, counter);
+    pieces[*counter].node = node;
+    pieces[*counter].wholeSubtree = false;
+    (*counter)++;
+    split_in_order(node->right, depth - 1, pieces, counter);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+int AvlTree<KeyType, ValueType, BalancePolicy>::subtree_size(const Node<KeyType, ValueType>* node) {
+    if (node == NULL) {
+        return 0;
+    }
+    return node->subtreeSize;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::select_in_order(Node<KeyType, ValueType>* node, int index) {
+    while (node != NULL) {
+        int leftSize = subtree_size(node->left);
+        if (index < leftSize) {
+            node = node->left;
+        }
+        else if (index == leftSize) {
+            return node;
+        }
+        else {
+            index -= leftSize + 1;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::get_previous_in_order(Node<KeyType, ValueType>* node) {
+    if (node->left != NULL) {
+        node = node->left;
+        while (node->right != NULL) {
+            node = node->right;
+        }
+        return node;
+    }
+    // Climb until coming up from a right son, the real root has no parent
+    while (node->parent != NULL && node->parent->left == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class OutputType>
+void AvlTree<KeyType, ValueType, BalancePolicy>::map_subtree_in_order(OutputType* array, const Node<KeyType, ValueType>* node, int* counter, OutputType (*mapFunc)(ValueType value)) {
+    if (node == NULL) {
+        return;
+    }
+    map_subtree_in_order(array, node->left, counter, mapFunc);
+    array[*counter] = mapFunc(*node->value);
+    (*counter)++;
+    map_subtree_in_order(array, node->right, counter, mapFunc);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class OutputType>
+void AvlTree<KeyType, ValueType, BalancePolicy>::size_piece_task(int pieceIdx, void* context) {
+    InOrderPiece& piece = static_cast<MapInOrderJob<OutputType>*>(context)->pieces[pieceIdx];
+    piece.size = piece.wholeSubtree ? subtree_size(piece.node) : 1;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class OutputType>
+void AvlTree<KeyType, ValueType, BalancePolicy>::map_piece_task(int pieceIdx, void* context) {
+    MapInOrderJob<OutputType>* job = static_cast<MapInOrderJob<OutputType>*>(context);
+    InOrderPiece& piece = job->pieces[pieceIdx];
+    int counter = piece.offset;
+    if (piece.wholeSubtree) {
+        map_subtree_in_order(job->array, piece.node, &counter, job->mapFunc);
+    }
+    else {
+        job->array[counter] = job->mapFunc(*piece.node->value);
+    }
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class OutputType>
+void AvlTree<KeyType, ValueType, BalancePolicy>::map_values_in_order(OutputType* const array, OutputType (*mapFunc)(ValueType value), ThreadPool* pool)const {
+    int numThreads = pool == NULL ? 1 : pool->get_num_threads();
+    if (numThreads == 1) {
+        int counter = 0;
+        map_subtree_in_order(array, root->right, &counter, mapFunc);
+        return;
+    }
+    // About 4 subtrees per thread, so uneven subtrees still spread well
+    int splitDepth = 0;
+    while (splitDepth < AVL_MAX_SPLIT_DEPTH && (1 << splitDepth) < 4 * numThreads) {
+        splitDepth++;
+    }
+    MapInOrderJob<OutputType> job;
+    job.array = array;
+    job.mapFunc = mapFunc;
+    int numPieces = 0;
+    split_in_order(root->right, splitDepth, job.pieces, &numPieces);
+
+    // Sizing pass, then every piece starts where the previous pieces end
+    pool->run(numPieces, size_piece_task<OutputType>, &job);
+    int offset = 0;
+    for (int pieceIdx = 0; pieceIdx < numPieces; pieceIdx++) {
+        job.pieces[pieceIdx].offset = offset;
+        offset += job.pieces[pieceIdx].size;
+    }
+    pool->run(numPieces, map_piece_task<OutputType>, &job);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::values_for_each(Node<KeyType, ValueType>* const node, void (*func)(ValueType value, void* context), void* context)const {
+    if (node == NULL) {
+        return;
+    }
+    values_for_each(node->left, func, context);
+    func(*node->value, context);
+    values_for_each(node->right, func, context);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::keys_in_order(KeyType* array, Node<KeyType, ValueType>* const node, int* counter)const {
     if (node == NULL) {
         return;
     }
     keys_in_order(array, node->left, counter);
-    KeyType* cpyKey = new KeyType(*node->key);
-    array[*counter] = *cpyKey;
+    array[*counter] = *node->key;
     (*counter)++;
     keys_in_order(array, node->right, counter);
 }
 
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::values_in_order(ValueType* array, Node<KeyType, ValueType>* const node, int* counter)const {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::values_in_order(ValueType* array, Node<KeyType, ValueType>* const node, int* counter)const {
     if (node == NULL) {
         return;
     }
     values_in_order(array, node->left, counter);
-    ValueType* cpyValue = new ValueType(*node->value);
-    array[*counter] = *cpyValue;
+    array[*counter] = *node->value;
     (*counter)++;
     values_in_order(array, node->right, counter);
 }
 
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::values_ranged_in_order(ValueType* array, Node<KeyType, ValueType>* const node, int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::values_ranged_in_order(ValueType* array, Node<KeyType, ValueType>* const node, int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
     if (node == NULL) {
         return;
     }
-    if ((*node->key) > minKey) {
+    if (AVL_COMPARE((*node->key) > minKey)) {
         values_ranged_in_order(array, node->left, counter, minKey, maxKey, validationFunc);
     }
-    if ((*node->key) >= minKey && (*node->key) <= maxKey && validationFunc(*(node->value))) {
+    if (AVL_COMPARE((*node->key) >= minKey) && AVL_COMPARE((*node->key) <= maxKey) && (validationFunc == NULL || validationFunc(*(node->value)))) {
         array[*counter] = *node->value;
         (*counter)++;
     }
-    if ((*node->key) < maxKey) {
+    if (AVL_COMPARE((*node->key) < maxKey)) {
         values_ranged_in_order(array, node->right, counter, minKey, maxKey, validationFunc);
     }
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::num_of_values_ranged_in_order(Node<KeyType, ValueType>* const node, int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::num_of_values_ranged_in_order(Node<KeyType, ValueType>* const node, int* counter, KeyType minKey, KeyType maxKey, bool (*validationFunc)(ValueType value))const {
     if (node == NULL) {
         return;
     }
-    if ((*node->key) > minKey) {
+    if (AVL_COMPARE((*node->key) > minKey)) {
         num_of_values_ranged_in_order(node->left, counter, minKey, maxKey, validationFunc);
     }
-    if ((*node->key) >= minKey && (*node->key) <= maxKey && validationFunc(*(node->value))) {
+    if (AVL_COMPARE((*node->key) >= minKey) && AVL_COMPARE((*node->key) <= maxKey) && (validationFunc == NULL || validationFunc(*(node->value)))) {
         (*counter)++;
     }
-    if ((*node->key) < maxKey) {
+    if (AVL_COMPARE((*node->key) < maxKey)) {
         num_of_values_ranged_in_order(node->right, counter, minKey, maxKey, validationFunc);
     }
 }
 
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::in_order(Node<KeyType, ValueType>** const array,
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::in_order(Node<KeyType, ValueType>** const array,
     Node<KeyType, ValueType>* const node,
     int* counter) const {
     if (node == NULL) {
@@ -431,8 +1020,8 @@ void AvlTree<KeyType, ValueType>::in_order(Node<KeyType, ValueType>** const arra
     in_order(array, node->right, counter);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::pre_order(Node<KeyType, ValueType>** array,
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::pre_order(Node<KeyType, ValueType>** array,
     Node<KeyType, ValueType>* const node,
     int* counter) {
     if (node == NULL) {
@@ -444,33 +1033,72 @@ void AvlTree<KeyType, ValueType>::pre_order(Node<KeyType, ValueType>** array,
     pre_order(array, node->right, counter);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::delete_tree_nodes(Node<KeyType, ValueType>* node) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::delete_tree_nodes(Node<KeyType, ValueType>* node) {
     if (node == NULL) {
         return;
     }
     delete_tree_nodes(node->left);
     delete_tree_nodes(node->right);
+    delete_node(node);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::new_node() {
+    if (nodePool != NULL) {
+        return nodePool->nodes.create();
+    }
+    return new Node<KeyType, ValueType>;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class KeyArg>
+KeyType* AvlTree<KeyType, ValueType, BalancePolicy>::new_key(KeyArg&& key) {
+    if (nodePool != NULL) {
+        return nodePool->keys.create(std::forward<KeyArg>(key));
+    }
+    return new KeyType(std::forward<KeyArg>(key));
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class ValueArg>
+ValueType* AvlTree<KeyType, ValueType, BalancePolicy>::new_value(ValueArg&& value) {
+    if (nodePool != NULL) {
+        return nodePool->values.create(std::forward<ValueArg>(value));
+    }
+    return new ValueType(std::forward<ValueArg>(value));
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::delete_node(Node<KeyType, ValueType>* node) {
+    if (nodePool != NULL) {
+        nodePool->values.destroy(node->value);
+        nodePool->keys.destroy(node->key);
+        nodePool->nodes.destroy(node);
+        return;
+    }
     delete node->value;
     delete node->key;
     delete node;
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::copy_aux(Node<KeyType, ValueType>* copyToParent,
-    Node<KeyType, ValueType>* copyTo,
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::copy_aux(Node<KeyType, ValueType>* copyToParent,
+    Node<KeyType, ValueType>*& copyTo,
     Node<KeyType, ValueType>** const InOrder,
     Node<KeyType, ValueType>** const PreOrder,
     int treeSize) {
     if (treeSize == 0) {
+        copyTo = NULL;
         return;
     }
 
-    copyTo = new Node<KeyType, ValueType>;
-    copyTo->key = new KeyType(*(PreOrder[0]->key));
-    copyTo->value = new ValueType(*(PreOrder[0]->value));
+    copyTo = new_node();
+    copyTo->key = new_key(*(PreOrder[0]->key));
+    copyTo->value = new_value(*(PreOrder[0]->value));
     copyTo->parent = copyToParent;
     copyTo->height = PreOrder[0]->height;
+    copyTo->subtreeSize = PreOrder[0]->subtreeSize;
 
     int currIndex = -1;
     for (int i = 0; i < treeSize; i++) {
@@ -484,9 +1112,9 @@ void AvlTree<KeyType, ValueType>::copy_aux(Node<KeyType, ValueType>* copyToParen
         treeSize - currIndex - 1);
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::copy(AvlTree<KeyType, ValueType> const& toCopy,
-    AvlTree<KeyType, ValueType>& copyTo) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::copy(AvlTree<KeyType, ValueType, BalancePolicy> const& toCopy,
+    AvlTree<KeyType, ValueType, BalancePolicy>& copyTo) {
     Node<KeyType, ValueType>** treeInOrder = new Node<KeyType, ValueType>*[toCopy.size];
     int in_counter = 0;
     in_order(treeInOrder, toCopy.root->right, &in_counter);
@@ -501,76 +1129,108 @@ void AvlTree<KeyType, ValueType>::copy(AvlTree<KeyType, ValueType> const& toCopy
     delete[] treePreOrder;
 }
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::place_node(Node<KeyType, ValueType>* toPlace) {
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::place_node(Node<KeyType, ValueType>* toPlace, Node<KeyType, ValueType>* start) {
     //if the tree is empty
     if (this->size == 0) {
         this->size++;
         toPlace->parent = NULL;
         this->root->right = toPlace;
+        finger = toPlace;
+        fingerIsMax = true;
         return TreeStatusType::TREE_SUCCESS;
     }
     
+    // The new node is the maximum if the descent only turns right from a start on the right spine
+    bool isMax = start == this->root->right || (start == finger && fingerIsMax);
     Node<KeyType, ValueType>* currParentNode = this->root;
-    Node<KeyType, ValueType>* temp = this->root->right;
+    Node<KeyType, ValueType>* temp = start;
 
+    AVL_STATS(stats.lookups++);
     while (temp != NULL) {
-        if (*(temp->key) == *(toPlace->key)) {
+        AVL_STATS(stats.nodesVisited++);
+        if (AVL_COMPARE(*(temp->key) == *(toPlace->key))) {
             return TreeStatusType::TREE_FAILURE;
         }
-        else if (*(temp->key) < *(toPlace->key)) {
+        else if (AVL_COMPARE(*(temp->key) < *(toPlace->key))) {
             currParentNode = temp;
             temp = temp->right;
         }
-        else if (*(temp->key) > *(toPlace->key)) {
+        else if (AVL_COMPARE(*(temp->key) > *(toPlace->key))) {
             currParentNode = temp;
             temp = temp->left;
+            isMax = false;
         }
     }
 
     // Place node
     toPlace->parent = currParentNode;
     this->size++;
-    if (*(currParentNode->key) < *(toPlace->key)) {
+    finger = toPlace;
+    fingerIsMax = isMax;
+    if (AVL_COMPARE(*(currParentNode->key) < *(toPlace->key))) {
         currParentNode->right = toPlace;
     }
-    else if (*(currParentNode->key) > *(toPlace->key)) {
+    else if (AVL_COMPARE(*(currParentNode->key) > *(toPlace->key))) {
         currParentNode->left = toPlace;
     }
 
-    while (currParentNode != NULL) {
-        update_height(currParentNode);
-        balance_tree(currParentNode);
-        currParentNode = currParentNode->parent;
-    }
+    BalancePolicy::rebalance_after_insert(*this, toPlace);
+    AVL_STATS(record_height());
     return TreeStatusType::TREE_SUCCESS;
 }
 
-template <class KeyType, class ValueType>
-Node<KeyType, ValueType>* AvlTree<KeyType, ValueType>::find_node_by_key(KeyType const& key) const {
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::finger_search_start(const KeyType& key) const {
+    // A maximum has no right son, a larger key goes right below it
+    if (fingerIsMax && AVL_COMPARE(*(finger->key) < key)) {
+        return finger;
+    }
+    // Climb while the key is beyond the ancestor bounding the subtree on the key's side, the
+    // key being on the other side of the finger bounds it from there
+    bool goingRight = AVL_COMPARE(*(finger->key) < key);
+    Node<KeyType, ValueType>* node = finger;
+    while (node->parent != NULL) {
+        Node<KeyType, ValueType>* parent = node->parent;
+        bool isLeftSon = parent->left == node;
+        if (goingRight && isLeftSon && !AVL_COMPARE(*(parent->key) < key)) {
+            return parent;
+        }
+        if (!goingRight && !isLeftSon && !AVL_COMPARE(key < *(parent->key))) {
+            return parent;
+        }
+        node = parent;
+    }
+    return node;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::find_node_by_key(KeyType const& key) const {
     Node<KeyType, ValueType>* temp = this->root->right;
 
+    AVL_STATS(stats.lookups++);
     while (temp != NULL) {
-        if (*(temp->key) == key) {
+        AVL_STATS(stats.nodesVisited++);
+        if (AVL_COMPARE(*(temp->key) == key)) {
             return temp;
         }
-        else if (*(temp->key) < key) {
+        else if (AVL_COMPARE(*(temp->key) < key)) {
             temp = temp->right;
         }
-        else if (*(temp->key) > key) {
+        else if (AVL_COMPARE(*(temp->key) > key)) {
             temp = temp->left;
         }
     }
     return NULL;
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::remove_root() {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::remove_root() {
     this->root->right = NULL;
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::remove_leaf(Node<KeyType, ValueType>* toRemove) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::remove_leaf(Node<KeyType, ValueType>* toRemove) {
     assert(toRemove != NULL);
     bool isRightSon = (toRemove == toRemove->parent->right);
     if (isRightSon) {
@@ -581,8 +1241,8 @@ void AvlTree<KeyType, ValueType>::remove_leaf(Node<KeyType, ValueType>* toRemove
     }
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::remove_one_child(Node<KeyType, ValueType>* toRemove) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::remove_one_child(Node<KeyType, ValueType>* toRemove) {
     assert(toRemove != NULL);
     bool isRoot = toRemove->parent == NULL;
     bool isRightSon = !isRoot && toRemove == toRemove->parent->right;
@@ -621,8 +1281,8 @@ void AvlTree<KeyType, ValueType>::remove_one_child(Node<KeyType, ValueType>* toR
     }
 }
 
-template <class KeyType, class ValueType>
-void AvlTree<KeyType, ValueType>::remove_two_children(Node<KeyType, ValueType>* toRemove) {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::remove_two_children(Node<KeyType, ValueType>* toRemove) {
     assert(toRemove != NULL);
     Node<KeyType, ValueType>* next = get_next_in_order(toRemove->right);
     swap_nodes(toRemove, next);
@@ -635,8 +1295,8 @@ void AvlTree<KeyType, ValueType>::remove_two_children(Node<KeyType, ValueType>*
     }
 }
 
-template <class KeyType, class ValueType>
-Node<KeyType, ValueType>* AvlTree<KeyType, ValueType>::get_next_in_order(Node<KeyType, ValueType>* node) {
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::get_next_in_order(Node<KeyType, ValueType>* node) {
     assert(node != NULL);
     if (node->left != NULL) {
         return get_next_in_order(node->left);
@@ -647,28 +1307,49 @@ Node<KeyType, ValueType>* AvlTree<KeyType, ValueType>::get_next_in_order(Node<Ke
 }
 
 // AvlTree basic funcs
-template <class KeyType, class ValueType>
-AvlTree<KeyType, ValueType>::AvlTree() {
-    this->root = new Node<KeyType, ValueType>;
+template <class KeyType, class ValueType, class BalancePolicy>
+AvlTree<KeyType, ValueType, BalancePolicy>::AvlTree() : AvlTree(NULL) {
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+AvlTree<KeyType, ValueType, BalancePolicy>::AvlTree(AvlNodePool<KeyType, ValueType>* nodePool) {
+    this->root = &dummyRoot;
     this->root->key = NULL;
+    this->root->value = NULL;
     this->root->right = NULL;
     this->root->left = NULL;
     this->root->parent = NULL;
     this->root->height = -1;
+    this->root->subtreeSize = 0;
     this->size = 0;
+    this->finger = NULL;
+    this->fingerIsMax = false;
+    this->nodePool = nodePool;
+    reset_stats();
 }
 
-template <class KeyType, class ValueType>
-AvlTree<KeyType, ValueType>::AvlTree(AvlTree<KeyType, ValueType>& tree) {
+template <class KeyType, class ValueType, class BalancePolicy>
+AvlTree<KeyType, ValueType, BalancePolicy>::AvlTree(AvlTree<KeyType, ValueType, BalancePolicy>& tree) {
+    this->root = &dummyRoot;
+    this->root->key = NULL;
+    this->root->value = NULL;
+    this->root->right = NULL;
+    this->root->left = NULL;
+    this->root->parent = NULL;
+    this->root->height = -1;
+    this->root->subtreeSize = 0;
+    this->finger = NULL;
+    this->fingerIsMax = false;
+    this->nodePool = tree.nodePool;
 
     this->size = tree.size;
-    this->root->left = NULL;
     copy(tree, *this);
+    reset_stats();
 }
 
-template <class KeyType, class ValueType>
-AvlTree<KeyType, ValueType>& AvlTree<KeyType, ValueType>::operator=(AvlTree<KeyType,
-    ValueType> const& tree) {
+template <class KeyType, class ValueType, class BalancePolicy>
+AvlTree<KeyType, ValueType, BalancePolicy>& AvlTree<KeyType, ValueType, BalancePolicy>::operator=(AvlTree<KeyType,
+    ValueType, BalancePolicy> const& tree) {
     if (this == &tree) {
         return *this;
     }
@@ -677,34 +1358,61 @@ AvlTree<KeyType, ValueType>& AvlTree<KeyType, ValueType>::operator=(AvlTree<KeyT
     Node<KeyType, ValueType>** thisInOrder = new Node<KeyType, ValueType>*[this->size];
     get_tree_in_order(thisInOrder);
     for (int i = 0; i < this->size; i++) {
-        delete thisInOrder[i]->key;
-        delete thisInOrder[i]->value;
-        delete thisInOrder[i];
+        delete_node(thisInOrder[i]);
     }
     delete[] thisInOrder;
+    this->finger = NULL;
 
     // Copy the new tree
     this->size = tree.size;
     this->root->left = NULL;
     copy(tree, *this);
+    AVL_STATS(record_height());
 
     return *this;
 }
 
-template <class KeyType, class ValueType>
-AvlTree<KeyType, ValueType>::~AvlTree() {
+template <class KeyType, class ValueType, class BalancePolicy>
+AvlTree<KeyType, ValueType, BalancePolicy>::~AvlTree() {
     delete_tree_nodes(this->root->right);
-    delete this->root;
 }
 
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::insert(KeyType& key, ValueType& value) {
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::insert(const KeyType& key, const ValueType& value) {
+    return emplace(key, value);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::insert(KeyType&& key, ValueType&& value) {
+    return emplace(std::move(key), std::move(value));
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class KeyArg, class ValueArg>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::emplace(KeyArg&& key, ValueArg&& value) {
+    return emplace_aux(std::forward<KeyArg>(key), std::forward<ValueArg>(value), false);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::insert_near_last(const KeyType& key, const ValueType& value) {
+    return emplace_aux(key, value, true);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class KeyArg, class ValueArg>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::emplace_near_last(KeyArg&& key, ValueArg&& value) {
+    return emplace_aux(std::forward<KeyArg>(key), std::forward<ValueArg>(value), true);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class KeyArg, class ValueArg>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::emplace_aux(KeyArg&& key, ValueArg&& value, bool nearLast) {
     
     // Create the node
     Node<KeyType, ValueType>* newNode;
     try {
-        newNode = new Node<KeyType, ValueType>;
+        newNode = new_node();
     }
     catch (std::bad_alloc& ba) {
         return TreeStatusType::TREE_ALLOCATION_ERROR;
@@ -712,17 +1420,25 @@ TreeStatusType AvlTree<KeyType, ValueType>::insert(KeyType& key, ValueType& valu
 
     // Fill the parameters
     newNode->height = 0;
+    newNode->subtreeSize = 1;
     newNode->right = NULL;
     newNode->left = NULL;
-    newNode->key = new KeyType(key);
-    newNode->value = new ValueType(value);
+    newNode->key = NULL;
+    newNode->value = NULL;
+    try {
+        newNode->key = new_key(std::forward<KeyArg>(key));
+        newNode->value = new_value(std::forward<ValueArg>(value));
+    }
+    catch (std::bad_alloc& ba) {
+        delete_node(newNode);
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
 
     // Place the node
-    if (place_node(newNode) == TreeStatusType::TREE_FAILURE) {
+    Node<KeyType, ValueType>* start = nearLast && finger != NULL ? finger_search_start(*(newNode->key)) : this->root->right;
+    if (place_node(newNode, start) == TreeStatusType::TREE_FAILURE) {
         // Sanity check
-        delete newNode->key;
-        delete newNode->value;
-        delete newNode;
+        delete_node(newNode);
         newNode = NULL;
 
         return TreeStatusType::TREE_FAILURE;
@@ -731,8 +1447,8 @@ TreeStatusType AvlTree<KeyType, ValueType>::insert(KeyType& key, ValueType& valu
     return TreeStatusType::TREE_SUCCESS;
 }
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::find(const KeyType& key,
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::find(const KeyType& key,
     ValueType* value) const {
     if (value == NULL) {
         return TreeStatusType::TREE_INVALID_INPUT;
@@ -748,8 +1464,96 @@ TreeStatusType AvlTree<KeyType, ValueType>::find(const KeyType& key,
     }
 }
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::remove(const KeyType& key) {
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::replace(const KeyType& key, const ValueType& value) {
+    Node<KeyType, ValueType>* found = find_node_by_key(key);
+    if (found == NULL) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    *(found->value) = value;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+ValueType AvlTree<KeyType, ValueType, BalancePolicy>::copy_value(ValueType value) {
+    return value;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::find_many(const KeyType* keys, int numKeys, ValueType* values, TreeStatusType* results) const {
+    map_find_many(keys, numKeys, values, results, copy_value);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+template <class OutputType>
+void AvlTree<KeyType, ValueType, BalancePolicy>::map_find_many(const KeyType* keys, int numKeys, OutputType* outputs, TreeStatusType* results, OutputType (*mapFunc)(ValueType value)) const {
+    // Every slot runs one lookup. A visit to a slot either prefetches the key of its node, or
+    // compares that key and prefetches the next node, so each slot's memory has the visits to
+    // the other slots to arrive.
+    Node<KeyType, ValueType>* slotNodes[AVL_FIND_GROUP_SIZE];
+    int slotKeys[AVL_FIND_GROUP_SIZE];  // Index of the key looked up, -1 for an idle slot
+    bool slotKeyFetched[AVL_FIND_GROUP_SIZE];
+    int nextKey = 0;
+    int numBusy = 0;
+    for (int slot = 0; slot < AVL_FIND_GROUP_SIZE; slot++) {
+        slotKeys[slot] = -1;
+        if (nextKey < numKeys) {
+            AVL_STATS(stats.lookups++);
+            slotKeys[slot] = nextKey++;
+            slotNodes[slot] = root->right;
+            slotKeyFetched[slot] = false;
+            numBusy++;
+        }
+    }
+
+    while (numBusy > 0) {
+        for (int slot = 0; slot < AVL_FIND_GROUP_SIZE; slot++) {
+            int keyIdx = slotKeys[slot];
+            if (keyIdx < 0) {
+                continue;
+            }
+            Node<KeyType, ValueType>* node = slotNodes[slot];
+            if (node != NULL) {
+                if (!slotKeyFetched[slot]) {
+                    AVL_PREFETCH(node->key);
+                    slotKeyFetched[slot] = true;
+                    continue;
+                }
+                AVL_STATS(stats.nodesVisited++);
+                if (!AVL_COMPARE(*(node->key) == keys[keyIdx])) {
+                    node = AVL_COMPARE(*(node->key) < keys[keyIdx]) ? node->right : node->left;
+                    if (node != NULL) {
+                        AVL_PREFETCH(node);
+                        slotNodes[slot] = node;
+                        slotKeyFetched[slot] = false;
+                        continue;
+                    }
+                }
+            }
+            // The lookup ended, at its key or at a missing son
+            if (node != NULL) {
+                outputs[keyIdx] = mapFunc(*(node->value));
+                results[keyIdx] = TreeStatusType::TREE_SUCCESS;
+            }
+            else {
+                results[keyIdx] = TreeStatusType::TREE_FAILURE;
+            }
+            if (nextKey < numKeys) {
+                AVL_STATS(stats.lookups++);
+                slotKeys[slot] = nextKey++;
+                slotNodes[slot] = root->right;
+                slotKeyFetched[slot] = false;
+            }
+            else {
+                slotKeys[slot] = -1;
+                numBusy--;
+            }
+        }
+    }
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::remove(const KeyType& key) {
     Node<KeyType, ValueType>* toDelete = find_node_by_key(key);
     if (toDelete == NULL) {
         return TreeStatusType::TREE_FAILURE;
@@ -757,8 +1561,8 @@ TreeStatusType AvlTree<KeyType, ValueType>::remove(const KeyType& key) {
     return remove_by_pointer(toDelete);
 }
 
-template <class KeyType, class ValueType>
-KeyType* AvlTree<KeyType, ValueType>::find_max()const {
+template <class KeyType, class ValueType, class BalancePolicy>
+KeyType* AvlTree<KeyType, ValueType, BalancePolicy>::find_max()const {
     Node<KeyType, ValueType>* currNode = this->root->right;
 
     if (currNode == NULL) {
@@ -771,8 +1575,8 @@ KeyType* AvlTree<KeyType, ValueType>::find_max()const {
     return currNode->key;
 }
 
-template <class KeyType, class ValueType>
-KeyType* AvlTree<KeyType, ValueType>::find_min()const {
+template <class KeyType, class ValueType, class BalancePolicy>
+KeyType* AvlTree<KeyType, ValueType, BalancePolicy>::find_min()const {
     Node<KeyType, ValueType>* currNode = this->root->right;
 
     if (currNode == NULL) {
@@ -786,8 +1590,8 @@ KeyType* AvlTree<KeyType, ValueType>::find_min()const {
 }
 
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::remove_by_pointer(Node<KeyType, ValueType>*
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::remove_by_pointer(Node<KeyType, ValueType>*
     toDelete) {
     if (toDelete == NULL) {
         return TreeStatusType::TREE_INVALID_INPUT;
@@ -806,23 +1610,119 @@ TreeStatusType AvlTree<KeyType, ValueType>::remove_by_pointer(Node<KeyType, Valu
         remove_two_children(toDelete);
     }
 
-    // Update heights and check balance factor for the parents
-    Node<KeyType, ValueType>* temp = toDelete->parent;
-    while (temp != NULL) {
-        update_height(temp);
-        balance_tree(temp);
-        temp = temp->parent;
+    // Update ranks and sizes of the parents, the son (if any) took the removed node's place
+    BalancePolicy::rebalance_after_remove(*this, toDelete->parent, toDelete->left != NULL ? toDelete->left : toDelete->right);
+    if (toDelete == finger) {
+        finger = NULL;
     }
     // Delete the node's data
-    delete toDelete->value;
-    delete toDelete->key;
-    delete toDelete;
+    delete_node(toDelete);
     this->size--;
     return TreeStatusType::TREE_SUCCESS;
 }
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::get_size(int* n) const {
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::clear() {
+    delete_tree_nodes(this->root->right);
+    this->root->right = NULL;
+    this->size = 0;
+    this->finger = NULL;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::steal(AvlTree<KeyType, ValueType, BalancePolicy>& other) {
+    if (this == &other) {
+        return;
+    }
+    clear();
+    // The real root hangs off the dummy root, so only the two links move
+    this->root->right = other.root->right;
+    this->size = other.size;
+    other.root->right = NULL;
+    other.size = 0;
+    other.finger = NULL;
+    AVL_STATS(record_height());
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::flatten_to_list(Node<KeyType, ValueType>* node, Node<KeyType, ValueType>* rest) {
+    if (node == NULL) {
+        return rest;
+    }
+    node->right = flatten_to_list(node->right, rest);
+    Node<KeyType, ValueType>* left = node->left;
+    node->left = NULL;
+    return flatten_to_list(left, node);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::build_from_list(Node<KeyType, ValueType>** head, int length) {
+    if (length == 0) {
+        return NULL;
+    }
+    Node<KeyType, ValueType>* left = build_from_list(head, length / 2);
+    Node<KeyType, ValueType>* subRoot = *head;
+    *head = subRoot->right;
+    subRoot->left = left;
+    if (left != NULL) {
+        left->parent = subRoot;
+    }
+    subRoot->right = build_from_list(head, length - length / 2 - 1);
+    if (subRoot->right != NULL) {
+        subRoot->right->parent = subRoot;
+    }
+    update_height(subRoot);
+    return subRoot;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::merge(AvlTree<KeyType, ValueType, BalancePolicy>& other) {
+    if (this == &other || other.size == 0) {
+        return;
+    }
+    Node<KeyType, ValueType>* list1 = flatten_to_list(this->root->right, NULL);
+    Node<KeyType, ValueType>* list2 = flatten_to_list(other.root->right, NULL);
+    other.root->right = NULL;
+    other.size = 0;
+    other.finger = NULL;
+    this->finger = NULL;
+
+    // Merge the sorted lists, keeping the tail's right pointer on the last merged node
+    Node<KeyType, ValueType> head;
+    Node<KeyType, ValueType>* tail = &head;
+    int length = 0;
+    while (list1 != NULL && list2 != NULL) {
+        if (AVL_COMPARE(*list2->key < *list1->key)) {
+            tail->right = list2;
+            list2 = list2->right;
+        }
+        else if (AVL_COMPARE(*list1->key < *list2->key)) {
+            tail->right = list1;
+            list1 = list1->right;
+        }
+        else {
+            // Duplicate key, the node of this tree stays
+            Node<KeyType, ValueType>* duplicate = list2;
+            list2 = list2->right;
+            delete_node(duplicate);
+            continue;
+        }
+        tail = tail->right;
+        length++;
+    }
+    for (tail->right = list1 != NULL ? list1 : list2; tail->right != NULL; tail = tail->right) {
+        length++;
+    }
+
+    Node<KeyType, ValueType>* list = head.right;
+    this->root->right = build_from_list(&list, length);
+    this->root->right->parent = NULL;
+    this->size = length;
+    AVL_STATS(record_height());
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::get_size(int* n) const {
     if (n == NULL) {
         return TreeStatusType::TREE_INVALID_INPUT;
     }
@@ -831,64 +1731,120 @@ TreeStatusType AvlTree<KeyType, ValueType>::get_size(int* n) const {
     return TreeStatusType::TREE_SUCCESS;
 }
 
-template <class KeyType, class ValueType>
-KeyType* AvlTree<KeyType, ValueType>::get_closest_key(Node<KeyType, ValueType>* node, KeyType* key, KeyType* closestKey, int (*compareFunc)(KeyType* key1, KeyType* key2, KeyType* refKey), bool closestKeyValid) const {
+template <class KeyType, class ValueType, class BalancePolicy>
+KeyType* AvlTree<KeyType, ValueType, BalancePolicy>::get_closest_key(Node<KeyType, ValueType>* node, KeyType* key, KeyType* closestKey, int (*compareFunc)(KeyType* key1, KeyType* key2, KeyType* refKey), bool closestKeyValid) const {
     if (node == NULL) {
         return closestKey;
     }
+    AVL_STATS(stats.nodesVisited++);
 
     bool valid = closestKeyValid;    
     if (!valid) {
         KeyType* newClosestKey = node->key;
         valid = true;
         // Traverse according to following rule: left if refrence key is smaller than current node key, right otherwise
-        if ((*key) < (*node->key))
+        if (AVL_COMPARE((*key) < (*node->key)))
             return get_closest_key(node->left, key, newClosestKey, compareFunc, valid);
         else
             return get_closest_key(node->right, key, newClosestKey, compareFunc, valid);
     }
-    else if (compareFunc(node->key, closestKey, key) > 0) {  // If current node key is closser to refrence key (key), compare function returns positive value
+    else if (AVL_COMPARE(compareFunc(node->key, closestKey, key) > 0)) {  // If current node key is closser to refrence key (key), compare function returns positive value
        closestKey = node->key;  // Update closest key
     }
     // Traverse according to following rule: left if refrence key is smaller than current node key, right otherwise
-    if ((*key) < (*node->key))
+    if (AVL_COMPARE((*key) < (*node->key)))
         return get_closest_key(node->left, key, closestKey, compareFunc, valid);
     else
         return get_closest_key(node->right, key, closestKey, compareFunc, valid);
 }
 
-template <class KeyType, class ValueType>
-KeyType* AvlTree<KeyType, ValueType>::find_closest_key(KeyType* key, int (*compareFunc)(KeyType* key1, KeyType* key2, KeyType* refKey))const {
+template <class KeyType, class ValueType, class BalancePolicy>
+KeyType* AvlTree<KeyType, ValueType, BalancePolicy>::find_closest_key(KeyType* key, int (*compareFunc)(KeyType* key1, KeyType* key2, KeyType* refKey))const {
+    AVL_STATS(stats.lookups++);
     return get_closest_key(root->right, key, NULL, compareFunc, false);
 }
 
-template <class KeyType, class ValueType>
-Node<KeyType, ValueType>* AvlTree<KeyType, ValueType>::get_root_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end, int height, Node<KeyType, ValueType>* parent) {
+template <class KeyType, class ValueType, class BalancePolicy>
+Node<KeyType, ValueType>* AvlTree<KeyType, ValueType, BalancePolicy>::build_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end, Node<KeyType, ValueType>* parent, bool moveElements) {
     if (start > end) {
         return NULL;
     }
     int middle = (start + end) / 2;
-    Node<KeyType, ValueType>* tempRoot = new Node<KeyType, ValueType>;
-    tempRoot->height = height;
-    tempRoot->key = new KeyType(sortedKeyArray[middle]);
-    tempRoot->value = new ValueType(sortedValueArray[middle]);
+    Node<KeyType, ValueType>* tempRoot = new_node();
+    tempRoot->key = NULL;
+    tempRoot->value = NULL;
+    tempRoot->left = NULL;
+    tempRoot->right = NULL;
     tempRoot->parent = parent;
-    tempRoot->left = get_root_from_sorted_array(sortedKeyArray, sortedValueArray, start, middle - 1, height + 1, tempRoot);
-    tempRoot->right = get_root_from_sorted_array(sortedKeyArray, sortedValueArray, middle + 1, end, height + 1, tempRoot);
+    try {
+        if (moveElements) {
+            tempRoot->key = new_key(std::move(sortedKeyArray[middle]));
+            tempRoot->value = new_value(std::move(sortedValueArray[middle]));
+        }
+        else {
+            tempRoot->key = new_key(sortedKeyArray[middle]);
+            tempRoot->value = new_value(sortedValueArray[middle]);
+        }
+        tempRoot->left = build_from_sorted_array(sortedKeyArray, sortedValueArray, start, middle - 1, tempRoot, moveElements);
+        tempRoot->right = build_from_sorted_array(sortedKeyArray, sortedValueArray, middle + 1, end, tempRoot, moveElements);
+    }
+    catch (std::bad_alloc& ba) {
+        // Free what was built so far before passing the failure up
+        delete_tree_nodes(tempRoot);
+        throw;
+    }
+    update_height(tempRoot);
     return tempRoot;
 }
 
-template <class KeyType, class ValueType>
-TreeStatusType AvlTree<KeyType, ValueType>::create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length) {
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::create_tree_from_sorted_array_aux(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length, bool moveElements) {
     if (root->right != NULL) {
         return TreeStatusType::TREE_FAILURE;
     }
-    root->right = get_root_from_sorted_array(sortedKeyArray, sortedValueArray, 0, length - 1, 0, NULL);
+    try {
+        root->right = build_from_sorted_array(sortedKeyArray, sortedValueArray, 0, length - 1, NULL, moveElements);
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
     size = length;
     if (root->right == NULL) {
         return TreeStatusType::TREE_FAILURE;
     }
+    AVL_STATS(record_height());
     return TreeStatusType::TREE_SUCCESS;
 }
 
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length) {
+    return create_tree_from_sorted_array_aux(sortedKeyArray, sortedValueArray, length, false);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStatusType AvlTree<KeyType, ValueType, BalancePolicy>::move_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length) {
+    return create_tree_from_sorted_array_aux(sortedKeyArray, sortedValueArray, length, true);
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+TreeStats AvlTree<KeyType, ValueType, BalancePolicy>::get_stats() const {
+    TreeStats result;
+#ifdef AVL_TREE_STATS
+    result = stats;
+#else
+    result = TreeStats();
+#endif
+    // Every entry holds a node, a key and a value, each allocated on its own
+    result.liveBytes = (long long)size * (long long)(sizeof(Node<KeyType, ValueType>) + sizeof(KeyType) + sizeof(ValueType));
+    return result;
+}
+
+template <class KeyType, class ValueType, class BalancePolicy>
+void AvlTree<KeyType, ValueType, BalancePolicy>::reset_stats() {
+#ifdef AVL_TREE_STATS
+    stats = TreeStats();
+    record_height();
+#endif
+}
+
 #endif //DATASTRUCTURESWORLDCUP_AVLTREE_H
@@ -0,0 +1,101 @@
+#include "ChangeFeed.h"
+
+#include <cstddef>
+#include <new>
+
+ChangeFeed::ChangeFeed(int capacity) : slots(NULL), capacity(1), reserved(0), published(0) {
+	while (this->capacity < static_cast<unsigned long long>(capacity)) {
+		this->capacity <<= 1;
+	}
+}
+
+ChangeFeed::~ChangeFeed() {
+	delete[] slots;
+}
+
+bool ChangeFeed::enable() {
+	if (slots != NULL) {
+		return true;
+	}
+	Slot* newSlots = new (std::nothrow) Slot[capacity];
+	if (newSlots == NULL) {
+		return false;
+	}
+	for (unsigned long long slotIdx = 0; slotIdx < capacity; slotIdx++) {
+		newSlots[slotIdx].stamp.store(0, std::memory_order_relaxed);
+	}
+	slots = newSlots;
+	return true;
+}
+
+bool ChangeFeed::is_enabled() const {
+	return slots != NULL;
+}
+
+void ChangeFeed::push(ChangeType type, int teamId, int value, int otherValue) {
+	if (slots == NULL) {
+		return;
+	}
+	// Only this thread writes reserved
+	unsigned long long sequence = reserved.load(std::memory_order_relaxed);
+	reserved.store(sequence + 1, std::memory_order_relaxed);
+	Slot& slot = slots[sequence & (capacity - 1)];
+	slot.stamp.store(0, std::memory_order_relaxed);
+	// A reader that sees any of the new fields sees the cleared stamp on its second check
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.type.store(static_cast<int>(type), std::memory_order_relaxed);
+	slot.teamId.store(teamId, std::memory_order_relaxed);
+	slot.value.store(value, std::memory_order_relaxed);
+	slot.otherValue.store(otherValue, std::memory_order_relaxed);
+	slot.stamp.store(sequence + 1, std::memory_order_release);
+}
+
+void ChangeFeed::publish() {
+	if (slots == NULL) {
+		return;
+	}
+	published.store(reserved.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+unsigned long long ChangeFeed::end() const {
+	return published.load(std::memory_order_acquire);
+}
+
+int ChangeFeed::read(unsigned long long* cursor, ChangeEvent* events, int maxEvents, unsigned long long* lost) const {
+	if (lost != NULL) {
+		*lost = 0;
+	}
+	if (cursor == NULL || events == NULL || maxEvents <= 0 || slots == NULL) {
+		return 0;
+	}
+	unsigned long long end = published.load(std::memory_order_acquire);
+	int numRead = 0;
+	while (numRead < maxEvents && *cursor < end) {
+		const Slot& slot = slots[*cursor & (capacity - 1)];
+		unsigned long long stamp = slot.stamp.load(std::memory_order_acquire);
+		ChangeEvent& event = events[numRead];
+		event.sequence = *cursor;
+		event.type = static_cast<ChangeType>(slot.type.load(std::memory_order_relaxed));
+		event.teamId = slot.teamId.load(std::memory_order_relaxed);
+		event.value = slot.value.load(std::memory_order_relaxed);
+		event.otherValue = slot.otherValue.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (stamp == *cursor + 1 && slot.stamp.load(std::memory_order_relaxed) == stamp) {
+			numRead++;
+			(*cursor)++;
+			continue;
+		}
+		// The writer lapped this reader, continue from the oldest event still in the ring
+		unsigned long long pushed = reserved.load(std::memory_order_acquire);
+		unsigned long long oldest = pushed > capacity ? pushed - capacity : 0;
+		if (oldest <= *cursor) {
+			// Being rewritten right now, so the event after it is the oldest left
+			oldest = *cursor + 1;
+		}
+		if (lost != NULL) {
+			*lost += oldest - *cursor;
+		}
+		*cursor = oldest;
+	}
+	return numRead;
+}
@@ -0,0 +1,87 @@
+#ifndef WET1_CHANGE_FEED_H_
+#define WET1_CHANGE_FEED_H_
+
+#include <atomic>
+
+// Default number of events a change feed keeps for slow readers
+#define CHANGE_FEED_CAPACITY 4096
+
+enum struct ChangeType {
+	TEAM_ADDED,      // teamId with value points
+	TEAM_REMOVED,    // teamId
+	TEAM_POINTS,     // teamId now has value points
+	TEAMS_UNITED,    // value and otherValue were united into teamId (after their TEAM_REMOVED)
+	PLAYER_ADDED,    // Player value joined teamId
+	PLAYER_REMOVED,  // Player value left teamId
+	TOP_SCORER,      // Top scorer of teamId (-1 for all the players) is now player value, 0 when there are no players
+};
+
+struct ChangeEvent {
+	unsigned long long sequence;  // Position in the feed, events are numbered from 0 without gaps
+	ChangeType type;
+	int teamId;
+	int value;
+	int otherValue;
+};
+
+// Ring buffer of change events with one writer and any number of readers.
+//
+// The writer pushes events and publishes them in batches, readers see a batch
+// only once it is complete. Every reader keeps its own cursor (the sequence of
+// the next event it wants) and drains at its own pace, without locks: the
+// writer never waits for readers and overwrites the oldest events when the
+// ring is full. A reader that fell behind by more than the capacity is told
+// how many events it lost and continues from the oldest one left, it has to
+// re-read whatever state those events described.
+//
+// Slots are read like a seqlock: every slot carries the sequence of its event,
+// which the reader checks again after copying the event out.
+class ChangeFeed {
+	struct Slot {
+		std::atomic<unsigned long long> stamp;  // Sequence of the event + 1, 0 while written
+		std::atomic<int> type;
+		std::atomic<int> teamId;
+		std::atomic<int> value;
+		std::atomic<int> otherValue;
+	};
+
+	Slot* slots;  // NULL until enabled
+	unsigned long long capacity;
+	std::atomic<unsigned long long> reserved;   // Events pushed, some may be unpublished
+	std::atomic<unsigned long long> published;  // Events readers may read
+
+public:
+	// The capacity is rounded up to a power of two, no memory is taken before enable()
+	explicit ChangeFeed(int capacity = CHANGE_FEED_CAPACITY);
+	~ChangeFeed();
+	ChangeFeed(const ChangeFeed&) = delete;
+	ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+	// Writer side. Pushes are dropped until the feed is enabled.
+	bool enable();
+	bool is_enabled() const;
+	void push(ChangeType type, int teamId, int value, int otherValue = 0);
+	void publish();
+
+	// Publishes everything pushed while alive when it goes out of scope
+	class Batch {
+		ChangeFeed& feed;
+
+	public:
+		explicit Batch(ChangeFeed& feed) : feed(feed) {}
+		~Batch() {
+			feed.publish();
+		}
+		Batch(const Batch&) = delete;
+		Batch& operator=(const Batch&) = delete;
+	};
+
+	// Reader side, safe from any thread. Copies up to maxEvents published events starting at
+	// *cursor into events and moves the cursor past them. The number of events skipped
+	// because they were overwritten goes into lost (when not NULL). Returns the number read.
+	int read(unsigned long long* cursor, ChangeEvent* events, int maxEvents, unsigned long long* lost) const;
+	// Sequence of the next event to be published, a new reader starts here
+	unsigned long long end() const;
+};
+
+#endif // WET1_CHANGE_FEED_H_
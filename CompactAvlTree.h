@@ -0,0 +1,737 @@
+#ifndef WET1_COMPACT_AVLTREE_H
+#define WET1_COMPACT_AVLTREE_H
+
+#include "AVLTree.h"
+
+#include <new>
+#include <utility>
+#include <vector>
+
+// AvlTree with compact node storage.
+//
+// All nodes live in one vector and link to each other with 32-bit indices
+// instead of pointers. Keys and values are stored inside the nodes, and the
+// height is replaced by a balance factor in a single byte, so an AvlTree<int, Player*>
+// entry takes 32 bytes in one block instead of a node, a key and a value
+// allocated on their own. Removed nodes are kept on a free list and reused by
+// later inserts (their key and value are assigned over, not destroyed).
+//
+// Indices stay valid when the vector grows, but pointers returned by
+// find_max() / find_min() do not survive the next insert.
+
+typedef unsigned int CompactIndex;
+#define COMPACT_NIL 0xFFFFFFFFu
+
+template <class KeyType, class ValueType>
+struct CompactNode {
+    KeyType key;
+    ValueType value;
+    CompactIndex parent;
+    CompactIndex left;   // Next free node while on the free list
+    CompactIndex right;
+    signed char balance; // Height of right subtree minus height of left subtree
+
+    template <class KeyArg, class ValueArg>
+    CompactNode(KeyArg&& key, ValueArg&& value) : key(std::forward<KeyArg>(key)), value(std::forward<ValueArg>(value)),
+        parent(COMPACT_NIL), left(COMPACT_NIL), right(COMPACT_NIL), balance(0) {}
+};
+
+template <class KeyType, class ValueType>
+class CompactAvlTree {
+    typedef CompactNode<KeyType, ValueType> CNode;
+
+    std::vector<CNode> nodes;
+    CompactIndex root;
+    CompactIndex freeList;
+    int size;
+#ifdef AVL_TREE_STATS
+    mutable TreeStats stats;
+#endif
+
+    // Takes a node off the free list (or appends one) holding the given key and value
+    template <class KeyArg, class ValueArg>
+    CompactIndex allocate_node(KeyArg&& key, ValueArg&& value);
+    void free_node(CompactIndex node);
+
+    // Replaces the child oldChild of parent (or the root) by newChild
+    void replace_child(CompactIndex parent, CompactIndex oldChild, CompactIndex newChild);
+
+    // Rolls of a subtree whose root x is off balance by 2 towards its child z, return the new subtree root
+    CompactIndex left_roll(CompactIndex x, CompactIndex z);
+    CompactIndex right_roll(CompactIndex x, CompactIndex z);
+    CompactIndex right_left_roll(CompactIndex x, CompactIndex z);
+    CompactIndex left_right_roll(CompactIndex x, CompactIndex z);
+
+    // Walks up from a changed subtree, updating balance factors and rolling where needed
+    void retrace_after_insert(CompactIndex node);
+    void retrace_after_remove(CompactIndex parent, bool leftShrank);
+
+    CompactIndex find_node_by_key(const KeyType& key) const;
+
+    CompactIndex build_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end, CompactIndex parent, int* height);
+    // Links nodes[start..end], already sorted by key, into a balanced subtree
+    CompactIndex link_sorted_nodes(int start, int end, CompactIndex parent, int* height);
+    void indices_in_order(CompactIndex* array, CompactIndex node, int* counter) const;
+
+    void keys_in_order(KeyType* array, CompactIndex node, int* counter) const;
+    void values_in_order(ValueType* array, CompactIndex node, int* counter) const;
+    void values_ranged_in_order(ValueType* array, CompactIndex node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const;
+    void num_of_values_ranged_in_order(CompactIndex node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const;
+    int subtree_height(CompactIndex node) const;
+
+public:
+    CompactAvlTree();
+
+    TreeStatusType insert(const KeyType& key, const ValueType& value);
+    TreeStatusType insert(KeyType&& key, ValueType&& value);
+    template <class KeyArg, class ValueArg>
+    TreeStatusType emplace(KeyArg&& key, ValueArg&& value);
+    TreeStatusType find(const KeyType& key, ValueType* value) const;
+    TreeStatusType remove(const KeyType& key);
+    TreeStatusType get_size(int* n) const;
+    TreeStatusType create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length);
+    // Makes room for numEntries nodes, so inserts up to that size do not reallocate
+    TreeStatusType reserve(int numEntries);
+    // Moves the entries to a vector of exactly their size, dropping the free list and spare capacity
+    TreeStatusType shrink_to_fit();
+    void clear();
+    KeyType* find_max();
+    KeyType* find_min();
+    void get_tree_keys_in_order(KeyType* const array) const;
+    void get_tree_values_in_order(ValueType* const array) const;
+    // A NULL validationFunc accepts every value in range
+    int fill_tree_values_ranged_in_order(ValueType* const array, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const;
+    int get_num_of_values_ranged(const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const;
+
+    // Internal counters, all zero unless built with AVL_TREE_STATS (liveBytes and maxHeight are always filled)
+    TreeStats get_stats() const;
+    void reset_stats();
+};
+
+/****************************************************************************/
+
+// Node storage
+template <class KeyType, class ValueType>
+template <class KeyArg, class ValueArg>
+CompactIndex CompactAvlTree<KeyType, ValueType>::allocate_node(KeyArg&& key, ValueArg&& value) {
+    if (freeList == COMPACT_NIL) {
+        nodes.push_back(CNode(std::forward<KeyArg>(key), std::forward<ValueArg>(value)));
+        return static_cast<CompactIndex>(nodes.size() - 1);
+    }
+    CompactIndex node = freeList;
+    freeList = nodes[node].left;
+    nodes[node].key = std::forward<KeyArg>(key);
+    nodes[node].value = std::forward<ValueArg>(value);
+    nodes[node].parent = COMPACT_NIL;
+    nodes[node].left = COMPACT_NIL;
+    nodes[node].right = COMPACT_NIL;
+    nodes[node].balance = 0;
+    return node;
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::free_node(CompactIndex node) {
+    nodes[node].left = freeList;
+    freeList = node;
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::replace_child(CompactIndex parent, CompactIndex oldChild, CompactIndex newChild) {
+    if (newChild != COMPACT_NIL) {
+        nodes[newChild].parent = parent;
+    }
+    if (parent == COMPACT_NIL) {
+        root = newChild;
+    }
+    else if (nodes[parent].left == oldChild) {
+        nodes[parent].left = newChild;
+    }
+    else {
+        nodes[parent].right = newChild;
+    }
+}
+
+// tree balancing funcs
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::left_roll(CompactIndex x, CompactIndex z) {
+    AVL_STATS(stats.rightRightRolls++);
+    CompactIndex inner = nodes[z].left;
+    nodes[x].right = inner;
+    if (inner != COMPACT_NIL) {
+        nodes[inner].parent = x;
+    }
+    nodes[z].left = x;
+    nodes[x].parent = z;
+    if (nodes[z].balance == 0) {  // Only after a remove
+        nodes[x].balance = 1;
+        nodes[z].balance = -1;
+    }
+    else {
+        nodes[x].balance = 0;
+        nodes[z].balance = 0;
+    }
+    return z;
+}
+
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::right_roll(CompactIndex x, CompactIndex z) {
+    AVL_STATS(stats.leftLeftRolls++);
+    CompactIndex inner = nodes[z].right;
+    nodes[x].left = inner;
+    if (inner != COMPACT_NIL) {
+        nodes[inner].parent = x;
+    }
+    nodes[z].right = x;
+    nodes[x].parent = z;
+    if (nodes[z].balance == 0) {  // Only after a remove
+        nodes[x].balance = -1;
+        nodes[z].balance = 1;
+    }
+    else {
+        nodes[x].balance = 0;
+        nodes[z].balance = 0;
+    }
+    return z;
+}
+
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::right_left_roll(CompactIndex x, CompactIndex z) {
+    AVL_STATS(stats.rightLeftRolls++);
+    CompactIndex y = nodes[z].left;
+    CompactIndex yRight = nodes[y].right;
+    nodes[z].left = yRight;
+    if (yRight != COMPACT_NIL) {
+        nodes[yRight].parent = z;
+    }
+    nodes[y].right = z;
+    nodes[z].parent = y;
+    CompactIndex yLeft = nodes[y].left;
+    nodes[x].right = yLeft;
+    if (yLeft != COMPACT_NIL) {
+        nodes[yLeft].parent = x;
+    }
+    nodes[y].left = x;
+    nodes[x].parent = y;
+    if (nodes[y].balance == 0) {
+        nodes[x].balance = 0;
+        nodes[z].balance = 0;
+    }
+    else if (nodes[y].balance > 0) {
+        nodes[x].balance = -1;
+        nodes[z].balance = 0;
+    }
+    else {
+        nodes[x].balance = 0;
+        nodes[z].balance = 1;
+    }
+    nodes[y].balance = 0;
+    return y;
+}
+
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::left_right_roll(CompactIndex x, CompactIndex z) {
+    AVL_STATS(stats.leftRightRolls++);
+    CompactIndex y = nodes[z].right;
+    CompactIndex yLeft = nodes[y].left;
+    nodes[z].right = yLeft;
+    if (yLeft != COMPACT_NIL) {
+        nodes[yLeft].parent = z;
+    }
+    nodes[y].left = z;
+    nodes[z].parent = y;
+    CompactIndex yRight = nodes[y].right;
+    nodes[x].left = yRight;
+    if (yRight != COMPACT_NIL) {
+        nodes[yRight].parent = x;
+    }
+    nodes[y].right = x;
+    nodes[x].parent = y;
+    if (nodes[y].balance == 0) {
+        nodes[x].balance = 0;
+        nodes[z].balance = 0;
+    }
+    else if (nodes[y].balance < 0) {
+        nodes[x].balance = 1;
+        nodes[z].balance = 0;
+    }
+    else {
+        nodes[x].balance = 0;
+        nodes[z].balance = -1;
+    }
+    nodes[y].balance = 0;
+    return y;
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::retrace_after_insert(CompactIndex node) {
+    AVL_STATS(stats.retraces++);
+    CompactIndex child = node;
+    for (CompactIndex x = nodes[child].parent; x != COMPACT_NIL; x = nodes[child].parent) {
+        AVL_STATS(stats.retraceLength++);
+        CompactIndex grandParent = nodes[x].parent;
+        CompactIndex newSubRoot;
+        if (child == nodes[x].right) {
+            if (nodes[x].balance < 0) {
+                nodes[x].balance = 0;
+                return;
+            }
+            if (nodes[x].balance == 0) {
+                nodes[x].balance = 1;
+                child = x;
+                continue;
+            }
+            newSubRoot = nodes[child].balance < 0 ? right_left_roll(x, child) : left_roll(x, child);
+        }
+        else {
+            if (nodes[x].balance > 0) {
+                nodes[x].balance = 0;
+                return;
+            }
+            if (nodes[x].balance == 0) {
+                nodes[x].balance = -1;
+                child = x;
+                continue;
+            }
+            newSubRoot = nodes[child].balance > 0 ? left_right_roll(x, child) : right_roll(x, child);
+        }
+        // A roll after an insert restores the subtree's height
+        replace_child(grandParent, x, newSubRoot);
+        return;
+    }
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::retrace_after_remove(CompactIndex parent, bool leftShrank) {
+    AVL_STATS(stats.retraces++);
+    for (CompactIndex x = parent; x != COMPACT_NIL; ) {
+        AVL_STATS(stats.retraceLength++);
+        CompactIndex grandParent = nodes[x].parent;
+        bool xIsLeft = grandParent != COMPACT_NIL && nodes[grandParent].left == x;
+        CompactIndex newSubRoot;
+        int siblingBalance;
+        if (leftShrank) {
+            if (nodes[x].balance < 0) {
+                nodes[x].balance = 0;
+                x = grandParent;
+                leftShrank = xIsLeft;
+                continue;
+            }
+            if (nodes[x].balance == 0) {
+                nodes[x].balance = 1;
+                return;
+            }
+            CompactIndex z = nodes[x].right;
+            siblingBalance = nodes[z].balance;
+            newSubRoot = siblingBalance < 0 ? right_left_roll(x, z) : left_roll(x, z);
+        }
+        else {
+            if (nodes[x].balance > 0) {
+                nodes[x].balance = 0;
+                x = grandParent;
+                leftShrank = xIsLeft;
+                continue;
+            }
+            if (nodes[x].balance == 0) {
+                nodes[x].balance = -1;
+                return;
+            }
+            CompactIndex z = nodes[x].left;
+            siblingBalance = nodes[z].balance;
+            newSubRoot = siblingBalance > 0 ? left_right_roll(x, z) : right_roll(x, z);
+        }
+        replace_child(grandParent, x, newSubRoot);
+        if (siblingBalance == 0) {  // The rolled subtree kept its height
+            return;
+        }
+        x = grandParent;
+        leftShrank = xIsLeft;
+    }
+}
+
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::find_node_by_key(const KeyType& key) const {
+    AVL_STATS(stats.lookups++);
+    CompactIndex currNode = root;
+    while (currNode != COMPACT_NIL) {
+        AVL_STATS(stats.nodesVisited++);
+        if (AVL_COMPARE(key < nodes[currNode].key)) {
+            currNode = nodes[currNode].left;
+        }
+        else if (AVL_COMPARE(nodes[currNode].key < key)) {
+            currNode = nodes[currNode].right;
+        }
+        else {
+            return currNode;
+        }
+    }
+    return COMPACT_NIL;
+}
+
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::build_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end, CompactIndex parent, int* height) {
+    if (start > end) {
+        *height = -1;
+        return COMPACT_NIL;
+    }
+    int middle = (start + end) / 2;
+    CompactIndex subRoot = allocate_node(sortedKeyArray[middle], sortedValueArray[middle]);
+    nodes[subRoot].parent = parent;
+    int leftHeight;
+    int rightHeight;
+    CompactIndex left = build_from_sorted_array(sortedKeyArray, sortedValueArray, start, middle - 1, subRoot, &leftHeight);
+    CompactIndex right = build_from_sorted_array(sortedKeyArray, sortedValueArray, middle + 1, end, subRoot, &rightHeight);
+    nodes[subRoot].left = left;
+    nodes[subRoot].right = right;
+    nodes[subRoot].balance = static_cast<signed char>(rightHeight - leftHeight);
+    *height = 1 + max(leftHeight, rightHeight);
+    return subRoot;
+}
+
+template <class KeyType, class ValueType>
+CompactIndex CompactAvlTree<KeyType, ValueType>::link_sorted_nodes(int start, int end, CompactIndex parent, int* height) {
+    if (start > end) {
+        *height = -1;
+        return COMPACT_NIL;
+    }
+    int middle = (start + end) / 2;
+    CompactIndex subRoot = static_cast<CompactIndex>(middle);
+    int leftHeight;
+    int rightHeight;
+    nodes[subRoot].parent = parent;
+    nodes[subRoot].left = link_sorted_nodes(start, middle - 1, subRoot, &leftHeight);
+    nodes[subRoot].right = link_sorted_nodes(middle + 1, end, subRoot, &rightHeight);
+    nodes[subRoot].balance = static_cast<signed char>(rightHeight - leftHeight);
+    *height = 1 + max(leftHeight, rightHeight);
+    return subRoot;
+}
+
+// Traversals
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::indices_in_order(CompactIndex* array, CompactIndex node, int* counter) const {
+    if (node == COMPACT_NIL) {
+        return;
+    }
+    indices_in_order(array, nodes[node].left, counter);
+    array[*counter] = node;
+    (*counter)++;
+    indices_in_order(array, nodes[node].right, counter);
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::keys_in_order(KeyType* array, CompactIndex node, int* counter) const {
+    if (node == COMPACT_NIL) {
+        return;
+    }
+    keys_in_order(array, nodes[node].left, counter);
+    array[*counter] = nodes[node].key;
+    (*counter)++;
+    keys_in_order(array, nodes[node].right, counter);
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::values_in_order(ValueType* array, CompactIndex node, int* counter) const {
+    if (node == COMPACT_NIL) {
+        return;
+    }
+    values_in_order(array, nodes[node].left, counter);
+    array[*counter] = nodes[node].value;
+    (*counter)++;
+    values_in_order(array, nodes[node].right, counter);
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::values_ranged_in_order(ValueType* array, CompactIndex node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const {
+    if (node == COMPACT_NIL) {
+        return;
+    }
+    const CNode& currNode = nodes[node];
+    if (AVL_COMPARE(minKey < currNode.key)) {
+        values_ranged_in_order(array, currNode.left, counter, minKey, maxKey, validationFunc);
+    }
+    if (AVL_COMPARE(!(currNode.key < minKey)) && AVL_COMPARE(!(maxKey < currNode.key)) && (validationFunc == NULL || validationFunc(currNode.value))) {
+        array[*counter] = currNode.value;
+        (*counter)++;
+    }
+    if (AVL_COMPARE(currNode.key < maxKey)) {
+        values_ranged_in_order(array, currNode.right, counter, minKey, maxKey, validationFunc);
+    }
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::num_of_values_ranged_in_order(CompactIndex node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const {
+    if (node == COMPACT_NIL) {
+        return;
+    }
+    const CNode& currNode = nodes[node];
+    if (AVL_COMPARE(minKey < currNode.key)) {
+        num_of_values_ranged_in_order(currNode.left, counter, minKey, maxKey, validationFunc);
+    }
+    if (AVL_COMPARE(!(currNode.key < minKey)) && AVL_COMPARE(!(maxKey < currNode.key)) && (validationFunc == NULL || validationFunc(currNode.value))) {
+        (*counter)++;
+    }
+    if (AVL_COMPARE(currNode.key < maxKey)) {
+        num_of_values_ranged_in_order(currNode.right, counter, minKey, maxKey, validationFunc);
+    }
+}
+
+template <class KeyType, class ValueType>
+int CompactAvlTree<KeyType, ValueType>::subtree_height(CompactIndex node) const {
+    // The balance factors tell which side is the taller one, so one path is enough
+    int height = -1;
+    while (node != COMPACT_NIL) {
+        height++;
+        node = nodes[node].balance < 0 ? nodes[node].left : nodes[node].right;
+    }
+    return height;
+}
+
+// CompactAvlTree basic funcs
+template <class KeyType, class ValueType>
+CompactAvlTree<KeyType, ValueType>::CompactAvlTree() {
+    this->root = COMPACT_NIL;
+    this->freeList = COMPACT_NIL;
+    this->size = 0;
+    reset_stats();
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::insert(const KeyType& key, const ValueType& value) {
+    return emplace(key, value);
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::insert(KeyType&& key, ValueType&& value) {
+    return emplace(std::move(key), std::move(value));
+}
+
+template <class KeyType, class ValueType>
+template <class KeyArg, class ValueArg>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::emplace(KeyArg&& key, ValueArg&& value) {
+    // Find the parent of the new node
+    AVL_STATS(stats.lookups++);
+    CompactIndex parent = COMPACT_NIL;
+    bool isLeft = false;
+    for (CompactIndex currNode = root; currNode != COMPACT_NIL; ) {
+        AVL_STATS(stats.nodesVisited++);
+        parent = currNode;
+        if (AVL_COMPARE(key < nodes[currNode].key)) {
+            isLeft = true;
+            currNode = nodes[currNode].left;
+        }
+        else if (AVL_COMPARE(nodes[currNode].key < key)) {
+            isLeft = false;
+            currNode = nodes[currNode].right;
+        }
+        else {
+            return TreeStatusType::TREE_FAILURE;
+        }
+    }
+    if (size == static_cast<int>(COMPACT_NIL >> 1)) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+
+    CompactIndex newNode;
+    try {
+        newNode = allocate_node(std::forward<KeyArg>(key), std::forward<ValueArg>(value));
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    nodes[newNode].parent = parent;
+    if (parent == COMPACT_NIL) {
+        root = newNode;
+    }
+    else if (isLeft) {
+        nodes[parent].left = newNode;
+    }
+    else {
+        nodes[parent].right = newNode;
+    }
+    size++;
+    retrace_after_insert(newNode);
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::find(const KeyType& key, ValueType* value) const {
+    if (value == NULL) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    CompactIndex found = find_node_by_key(key);
+    if (found == COMPACT_NIL) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    *value = nodes[found].value;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::remove(const KeyType& key) {
+    CompactIndex toRemove = find_node_by_key(key);
+    if (toRemove == COMPACT_NIL) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    // With two children, the successor's data takes the node's place and the successor is removed
+    if (nodes[toRemove].left != COMPACT_NIL && nodes[toRemove].right != COMPACT_NIL) {
+        CompactIndex next = nodes[toRemove].right;
+        while (nodes[next].left != COMPACT_NIL) {
+            next = nodes[next].left;
+        }
+        std::swap(nodes[toRemove].key, nodes[next].key);
+        std::swap(nodes[toRemove].value, nodes[next].value);
+        toRemove = next;
+    }
+    CompactIndex parent = nodes[toRemove].parent;
+    CompactIndex child = nodes[toRemove].left != COMPACT_NIL ? nodes[toRemove].left : nodes[toRemove].right;
+    bool leftShrank = parent != COMPACT_NIL && nodes[parent].left == toRemove;
+    replace_child(parent, toRemove, child);
+    free_node(toRemove);
+    size--;
+    retrace_after_remove(parent, leftShrank);
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::get_size(int* n) const {
+    if (n == NULL) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    *n = this->size;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length) {
+    if (root != COMPACT_NIL || length <= 0) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    if (reserve(length) != TreeStatusType::TREE_SUCCESS) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    int height;
+    root = build_from_sorted_array(sortedKeyArray, sortedValueArray, 0, length - 1, COMPACT_NIL, &height);
+    size = length;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::reserve(int numEntries) {
+    if (numEntries < 0 || numEntries > static_cast<int>(COMPACT_NIL >> 1)) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    try {
+        nodes.reserve(numEntries);
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType CompactAvlTree<KeyType, ValueType>::shrink_to_fit() {
+    try {
+        std::vector<CNode> packed;
+        packed.reserve(size);
+        if (size > 0) {
+            std::vector<CompactIndex> order(size);
+            int counter = 0;
+            indices_in_order(&order[0], root, &counter);
+            for (int nodeIdx = 0; nodeIdx < size; nodeIdx++) {
+                packed.push_back(std::move(nodes[order[nodeIdx]]));
+            }
+        }
+        nodes.swap(packed);
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    int height;
+    root = link_sorted_nodes(0, size - 1, COMPACT_NIL, &height);
+    freeList = COMPACT_NIL;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::clear() {
+    nodes.clear();
+    root = COMPACT_NIL;
+    freeList = COMPACT_NIL;
+    size = 0;
+}
+
+template <class KeyType, class ValueType>
+KeyType* CompactAvlTree<KeyType, ValueType>::find_max() {
+    CompactIndex currNode = root;
+    if (currNode == COMPACT_NIL) {
+        return NULL;
+    }
+    while (nodes[currNode].right != COMPACT_NIL) {
+        currNode = nodes[currNode].right;
+    }
+    return &nodes[currNode].key;
+}
+
+template <class KeyType, class ValueType>
+KeyType* CompactAvlTree<KeyType, ValueType>::find_min() {
+    CompactIndex currNode = root;
+    if (currNode == COMPACT_NIL) {
+        return NULL;
+    }
+    while (nodes[currNode].left != COMPACT_NIL) {
+        currNode = nodes[currNode].left;
+    }
+    return &nodes[currNode].key;
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::get_tree_keys_in_order(KeyType* const array) const {
+    int counter = 0;
+    keys_in_order(array, root, &counter);
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::get_tree_values_in_order(ValueType* const array) const {
+    int counter = 0;
+    values_in_order(array, root, &counter);
+}
+
+template <class KeyType, class ValueType>
+int CompactAvlTree<KeyType, ValueType>::fill_tree_values_ranged_in_order(ValueType* const array, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const {
+    int counter = 0;
+    values_ranged_in_order(array, root, &counter, minKey, maxKey, validationFunc);
+    return counter;
+}
+
+template <class KeyType, class ValueType>
+int CompactAvlTree<KeyType, ValueType>::get_num_of_values_ranged(const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const {
+    int counter = 0;
+    num_of_values_ranged_in_order(root, &counter, minKey, maxKey, validationFunc);
+    return counter;
+}
+
+template <class KeyType, class ValueType>
+TreeStats CompactAvlTree<KeyType, ValueType>::get_stats() const {
+    TreeStats result;
+#ifdef AVL_TREE_STATS
+    result = stats;
+#else
+    result = TreeStats();
+#endif
+    // All the entries share one block, including the free and spare nodes
+    result.liveBytes = (long long)sizeof(*this) + (long long)nodes.capacity() * (long long)sizeof(CNode);
+    int height = subtree_height(root);
+    if (height > result.maxHeight) {
+        result.maxHeight = height;
+    }
+    return result;
+}
+
+template <class KeyType, class ValueType>
+void CompactAvlTree<KeyType, ValueType>::reset_stats() {
+#ifdef AVL_TREE_STATS
+    stats = TreeStats();
+#endif
+}
+
+#endif //WET1_COMPACT_AVLTREE_H
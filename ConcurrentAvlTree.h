@@ -0,0 +1,715 @@
+#ifndef WET1_CONCURRENT_AVLTREE_H
+#define WET1_CONCURRENT_AVLTREE_H
+
+#include "AVLTree.h"
+#include "EpochReclaimer.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+// AvlTree for many threads, after Bronson, Casper, Chafi and Olukotun,
+// "A Practical Concurrent Binary Search Tree" (PPoPP 2010).
+//
+// Lookups take no locks. They walk down optimistically, reading the version
+// of every node they pass and checking it again after moving to the son; a
+// rotation that moved keys out of a node's subtree changes its version, and
+// the walk retries from the last node that is still valid. Inserts and removes
+// lock only the node they change (and its parent when unlinking), so updates on
+// disjoint paths run in parallel. Balance is relaxed: after an update the thread
+// walks up fixing heights and rotating under the locks of the nodes involved,
+// and others may see the tree out of balance in between.
+//
+// Removing a node with two sons only clears its value, leaving a routing node
+// that is unlinked later, once it has at most one son. Unlinked nodes and
+// removed values are freed through EpochReclaimer, so lookups never read freed
+// memory; every public method pins the calling thread itself.
+//
+// Heights here count a leaf as 1 and a missing son as 0. Locks are always
+// taken parent first. Builds need EpochReclaimer.cpp and -pthread.
+
+// Version bits: a shrink (rotation moving keys out of the subtree) in progress, and unlinked
+#define CONCURRENT_SHRINKING 1ULL
+#define CONCURRENT_UNLINKED 2ULL
+// Version checks of a shrinking node before waiting for its lock
+#define CONCURRENT_SPINS_BEFORE_LOCK 100
+
+template <class KeyType, class ValueType>
+struct ConcurrentNode {
+    KeyType* key;                               // NULL for the root holder
+    std::atomic<ValueType*> value;              // NULL for a routing node
+    std::atomic<int> height;
+    std::atomic<unsigned long long> version;
+    std::atomic<ConcurrentNode*> parent;
+    std::atomic<ConcurrentNode*> left;
+    std::atomic<ConcurrentNode*> right;
+    std::mutex lock;
+
+    ConcurrentNode(KeyType* key, ValueType* value, ConcurrentNode* parent) : key(key), value(value), height(1),
+        version(0), parent(parent), left(NULL), right(NULL) {}
+};
+
+template <class KeyType, class ValueType>
+class ConcurrentAvlTree {
+    typedef ConcurrentNode<KeyType, ValueType> CNode;
+
+    enum struct Attempt {
+        SUCCESS,
+        FAILURE,
+        RETRY   // A node on the way changed, retry from the caller's node
+    };
+
+    // Conditions of a node that its new height cannot fix
+    static const int UNLINK_REQUIRED = -1;
+    static const int REBALANCE_REQUIRED = -2;
+    static const int NOTHING_REQUIRED = -3;
+
+    // The root is the right son of the holder, which has no key and never changes version
+    CNode holder;
+    std::atomic<int> size;
+
+    // Direction of key from node: negative for its left son, 0 for node itself, positive for the right son
+    static int compare(const KeyType& key, const CNode* node);
+    static CNode* child(const CNode* node, int direction);
+    static void set_child(CNode* node, int direction, CNode* son);
+    static int height(const CNode* node);
+    static bool is_shrinking_or_unlinked(unsigned long long version);
+    static bool is_unlinked(unsigned long long version);
+    static unsigned long long begin_change(unsigned long long version);
+    static unsigned long long end_change(unsigned long long version);
+    static void wait_until_shrink_completed(CNode* node, unsigned long long version);
+
+    // Continue a search below node in the given direction, node having had nodeVersion when reached
+    static Attempt attempt_find(const KeyType& key, CNode* node, int direction, unsigned long long nodeVersion, ValueType* value);
+    // Inserts newValue under key if missing, or removes key when newValue is NULL
+    Attempt attempt_update(const KeyType& key, ValueType* newValue, CNode* node, int direction, unsigned long long nodeVersion);
+    Attempt attempt_node_update(ValueType* newValue, CNode* parent, CNode* node);
+    // Splices out node (both locked with its parent) if it has at most one son, leaving heights to the caller
+    static bool attempt_unlink(CNode* parent, CNode* node);
+
+    // Returns the height node should have, or what besides a new height it needs
+    static int node_condition(CNode* node);
+    // Walks up from a damaged node, fixing heights, rotating and unlinking routing nodes
+    void fix_height_and_rebalance(CNode* node);
+    // The following take locked nodes and return the next damaged node, NULL when done
+    static CNode* fix_height(CNode* node);
+    static CNode* rebalance(CNode* parent, CNode* node);
+    // son, on side of node, is too tall compared to node's other son of height otherHeight
+    static CNode* rebalance_toward(CNode* parent, CNode* node, CNode* son, int side, int otherHeight);
+    static CNode* rotate(CNode* parent, CNode* node, CNode* son, int side, int otherHeight, int outerHeight, CNode* inner, int innerHeight);
+    static CNode* rotate_double(CNode* parent, CNode* node, CNode* son, int side, int otherHeight, int outerHeight, CNode* inner, int innerSideHeight);
+
+    static void delete_node(void* node);
+    static void delete_value(void* value);
+    static void delete_subtree(CNode* node);
+
+public:
+    ConcurrentAvlTree();
+    // No other thread may use the tree any more
+    ~ConcurrentAvlTree();
+    ConcurrentAvlTree(const ConcurrentAvlTree&) = delete;
+    ConcurrentAvlTree& operator=(const ConcurrentAvlTree&) = delete;
+
+    // The following may be called from any number of threads at once
+    TreeStatusType insert(const KeyType& key, const ValueType& value);
+    TreeStatusType find(const KeyType& key, ValueType* value) const;
+    TreeStatusType remove(const KeyType& key);
+    // Exact when no update runs at the same time
+    TreeStatusType get_size(int* n) const;
+};
+
+/****************************************************************************/
+
+template <class KeyType, class ValueType>
+int ConcurrentAvlTree<KeyType, ValueType>::compare(const KeyType& key, const CNode* node) {
+    if (key == *(node->key)) {
+        return 0;
+    }
+    return key < *(node->key) ? -1 : 1;
+}
+
+template <class KeyType, class ValueType>
+ConcurrentNode<KeyType, ValueType>* ConcurrentAvlTree<KeyType, ValueType>::child(const CNode* node, int direction) {
+    return direction < 0 ? node->left.load() : node->right.load();
+}
+
+template <class KeyType, class ValueType>
+void ConcurrentAvlTree<KeyType, ValueType>::set_child(CNode* node, int direction, CNode* son) {
+    if (direction < 0) {
+        node->left.store(son);
+    }
+    else {
+        node->right.store(son);
+    }
+}
+
+template <class KeyType, class ValueType>
+int ConcurrentAvlTree<KeyType, ValueType>::height(const CNode* node) {
+    return node == NULL ? 0 : node->height.load();
+}
+
+template <class KeyType, class ValueType>
+bool ConcurrentAvlTree<KeyType, ValueType>::is_shrinking_or_unlinked(unsigned long long version) {
+    return (version & (CONCURRENT_SHRINKING | CONCURRENT_UNLINKED)) != 0;
+}
+
+template <class KeyType, class ValueType>
+bool ConcurrentAvlTree<KeyType, ValueType>::is_unlinked(unsigned long long version) {
+    return (version & CONCURRENT_UNLINKED) != 0;
+}
+
+template <class KeyType, class ValueType>
+unsigned long long ConcurrentAvlTree<KeyType, ValueType>::begin_change(unsigned long long version) {
+    return version | CONCURRENT_SHRINKING;
+}
+
+template <class KeyType, class ValueType>
+unsigned long long ConcurrentAvlTree<KeyType, ValueType>::end_change(unsigned long long version) {
+    // Clears both bits and counts the change
+    return (version | CONCURRENT_SHRINKING | CONCURRENT_UNLINKED) + 1;
+}
+
+template <class KeyType, class ValueType>
+void ConcurrentAvlTree<KeyType, ValueType>::wait_until_shrink_completed(CNode* node, unsigned long long version) {
+    if ((version & CONCURRENT_SHRINKING) == 0) {
+        return;
+    }
+    for (int spinIdx = 0; spinIdx < CONCURRENT_SPINS_BEFORE_LOCK; spinIdx++) {
+        if (node->version.load() != version) {
+            return;
+        }
+    }
+    // Shrinks happen under the node's lock, so taking it waits for the end
+    std::lock_guard<std::mutex> nodeGuard(node->lock);
+}
+
+// Lookups
+
+template <class KeyType, class ValueType>
+typename ConcurrentAvlTree<KeyType, ValueType>::Attempt ConcurrentAvlTree<KeyType, ValueType>::attempt_find(const KeyType& key,
+    CNode* node, int direction, unsigned long long nodeVersion, ValueType* value) {
+    while (true) {
+        CNode* son = child(node, direction);
+        if (son == NULL) {
+            return node->version.load() != nodeVersion ? Attempt::RETRY : Attempt::FAILURE;
+        }
+        int sonDirection = compare(key, son);
+        if (sonDirection == 0) {
+            // Values are replaced, never changed in place, and freed only after this thread unpins
+            ValueType* found = son->value.load();
+            if (found == NULL) {
+                return Attempt::FAILURE;
+            }
+            *value = *found;
+            return Attempt::SUCCESS;
+        }
+        unsigned long long sonVersion = son->version.load();
+        if (is_shrinking_or_unlinked(sonVersion)) {
+            wait_until_shrink_completed(son, sonVersion);
+            if (node->version.load() != nodeVersion) {
+                return Attempt::RETRY;
+            }
+        }
+        else if (son != child(node, direction)) {
+            // The son changed before its version was read
+            if (node->version.load() != nodeVersion) {
+                return Attempt::RETRY;
+            }
+        }
+        else {
+            // The way to node is still valid, so son was reached validly too
+            if (node->version.load() != nodeVersion) {
+                return Attempt::RETRY;
+            }
+            Attempt result = attempt_find(key, son, sonDirection, sonVersion, value);
+            if (result != Attempt::RETRY) {
+                return result;
+            }
+        }
+    }
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType ConcurrentAvlTree<KeyType, ValueType>::find(const KeyType& key, ValueType* value) const {
+    if (value == NULL) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    EpochReclaimer::Guard epochGuard;
+    CNode* root = const_cast<CNode*>(&holder);
+    Attempt result;
+    do {
+        result = attempt_find(key, root, 1, root->version.load(), value);
+    } while (result == Attempt::RETRY);
+    return result == Attempt::SUCCESS ? TreeStatusType::TREE_SUCCESS : TreeStatusType::TREE_FAILURE;
+}
+
+// Updates
+
+template <class KeyType, class ValueType>
+typename ConcurrentAvlTree<KeyType, ValueType>::Attempt ConcurrentAvlTree<KeyType, ValueType>::attempt_update(const KeyType& key,
+    ValueType* newValue, CNode* node, int direction, unsigned long long nodeVersion) {
+    while (true) {
+        CNode* son = child(node, direction);
+        if (node->version.load() != nodeVersion) {
+            return Attempt::RETRY;
+        }
+        if (son == NULL) {
+            if (newValue == NULL) {
+                return Attempt::FAILURE;
+            }
+            bool inserted = false;
+            CNode* damaged = NULL;
+            {
+                std::lock_guard<std::mutex> nodeGuard(node->lock);
+                // Under the lock no rotation can move node any more
+                if (node->version.load() != nodeVersion) {
+                    return Attempt::RETRY;
+                }
+                if (child(node, direction) == NULL) {
+                    KeyType* newKey = new KeyType(key);
+                    CNode* leaf;
+                    try {
+                        leaf = new CNode(newKey, newValue, node);
+                    }
+                    catch (std::bad_alloc& ba) {
+                        delete newKey;
+                        throw;
+                    }
+                    set_child(node, direction, leaf);
+                    inserted = true;
+                    damaged = fix_height(node);
+                }
+            }
+            if (inserted) {
+                size++;
+                fix_height_and_rebalance(damaged);
+                return Attempt::SUCCESS;
+            }
+            // Lost the place to another insert, go on below node
+        }
+        else {
+            unsigned long long sonVersion = son->version.load();
+            if (is_shrinking_or_unlinked(sonVersion)) {
+                wait_until_shrink_completed(son, sonVersion);
+            }
+            else if (son == child(node, direction)) {
+                if (node->version.load() != nodeVersion) {
+                    return Attempt::RETRY;
+                }
+                int sonDirection = compare(key, son);
+                Attempt result = sonDirection == 0 ? attempt_node_update(newValue, node, son) :
+                    attempt_update(key, newValue, son, sonDirection, sonVersion);
+                if (result != Attempt::RETRY) {
+                    return result;
+                }
+            }
+        }
+    }
+}
+
+template <class KeyType, class ValueType>
+typename ConcurrentAvlTree<KeyType, ValueType>::Attempt ConcurrentAvlTree<KeyType, ValueType>::attempt_node_update(ValueType* newValue,
+    CNode* parent, CNode* node) {
+    if (newValue == NULL && node->value.load() == NULL) {
+        return Attempt::FAILURE;
+    }
+    if (newValue == NULL && (node->left.load() == NULL || node->right.load() == NULL)) {
+        // The node can be unlinked, which needs the parent's lock first
+        ValueType* removed;
+        CNode* damaged;
+        {
+            std::lock_guard<std::mutex> parentGuard(parent->lock);
+            if (is_unlinked(parent->version.load()) || node->parent.load() != parent) {
+                return Attempt::RETRY;
+            }
+            {
+                std::lock_guard<std::mutex> nodeGuard(node->lock);
+                removed = node->value.load();
+                if (removed == NULL) {
+                    return Attempt::FAILURE;
+                }
+                if (!attempt_unlink(parent, node)) {
+                    return Attempt::RETRY;
+                }
+            }
+            damaged = fix_height(parent);
+        }
+        size--;
+        EpochReclaimer::retire(removed, delete_value);
+        EpochReclaimer::retire(node, delete_node);
+        fix_height_and_rebalance(damaged);
+        return Attempt::SUCCESS;
+    }
+
+    std::lock_guard<std::mutex> nodeGuard(node->lock);
+    if (is_unlinked(node->version.load())) {
+        return Attempt::RETRY;
+    }
+    ValueType* previous = node->value.load();
+    if (newValue != NULL) {
+        // Insert, reviving a routing node
+        if (previous != NULL) {
+            return Attempt::FAILURE;
+        }
+        node->value.store(newValue);
+        size++;
+        return Attempt::SUCCESS;
+    }
+    if (previous == NULL) {
+        return Attempt::FAILURE;
+    }
+    if (node->left.load() == NULL || node->right.load() == NULL) {
+        // A son left since the check above, unlink instead
+        return Attempt::RETRY;
+    }
+    node->value.store(NULL);
+    size--;
+    EpochReclaimer::retire(previous, delete_value);
+    return Attempt::SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+bool ConcurrentAvlTree<KeyType, ValueType>::attempt_unlink(CNode* parent, CNode* node) {
+    CNode* parentLeft = parent->left.load();
+    if (parentLeft != node && parent->right.load() != node) {
+        return false;
+    }
+    CNode* left = node->left.load();
+    CNode* right = node->right.load();
+    if (left != NULL && right != NULL) {
+        return false;
+    }
+    CNode* splice = left != NULL ? left : right;
+    if (parentLeft == node) {
+        parent->left.store(splice);
+    }
+    else {
+        parent->right.store(splice);
+    }
+    if (splice != NULL) {
+        splice->parent.store(parent);
+    }
+    node->version.store(CONCURRENT_UNLINKED);
+    node->value.store(NULL);
+    return true;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType ConcurrentAvlTree<KeyType, ValueType>::insert(const KeyType& key, const ValueType& value) {
+    ValueType* newValue;
+    try {
+        newValue = new ValueType(value);
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    EpochReclaimer::Guard epochGuard;
+    Attempt result;
+    try {
+        do {
+            result = attempt_update(key, newValue, &holder, 1, holder.version.load());
+        } while (result == Attempt::RETRY);
+    }
+    catch (std::bad_alloc& ba) {
+        delete newValue;
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    if (result == Attempt::FAILURE) {
+        delete newValue;
+        return TreeStatusType::TREE_FAILURE;
+    }
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType ConcurrentAvlTree<KeyType, ValueType>::remove(const KeyType& key) {
+    EpochReclaimer::Guard epochGuard;
+    Attempt result;
+    do {
+        result = attempt_update(key, NULL, &holder, 1, holder.version.load());
+    } while (result == Attempt::RETRY);
+    return result == Attempt::SUCCESS ? TreeStatusType::TREE_SUCCESS : TreeStatusType::TREE_FAILURE;
+}
+
+// Rebalancing
+
+template <class KeyType, class ValueType>
+int ConcurrentAvlTree<KeyType, ValueType>::node_condition(CNode* node) {
+    CNode* left = node->left.load();
+    CNode* right = node->right.load();
+    if ((left == NULL || right == NULL) && node->value.load() == NULL) {
+        return UNLINK_REQUIRED;
+    }
+    // Other threads may change the heights meanwhile, whoever changes them fixes them
+    int nodeHeight = node->height.load();
+    int leftHeight = height(left);
+    int rightHeight = height(right);
+    int newHeight = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    if (leftHeight - rightHeight < -1 || leftHeight - rightHeight > 1) {
+        return REBALANCE_REQUIRED;
+    }
+    return nodeHeight != newHeight ? newHeight : NOTHING_REQUIRED;
+}
+
+template <class KeyType, class ValueType>
+void ConcurrentAvlTree<KeyType, ValueType>::fix_height_and_rebalance(CNode* node) {
+    // The holder has no parent and needs no fixing
+    while (node != NULL && node->parent.load() != NULL) {
+        int condition = node_condition(node);
+        if (condition == NOTHING_REQUIRED || is_unlinked(node->version.load())) {
+            return;
+        }
+        if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+            std::lock_guard<std::mutex> nodeGuard(node->lock);
+            node = fix_height(node);
+        }
+        else {
+            CNode* parent = node->parent.load();
+            CNode* damaged = node;
+            {
+                std::lock_guard<std::mutex> parentGuard(parent->lock);
+                if (!is_unlinked(parent->version.load()) && node->parent.load() == parent) {
+                    std::lock_guard<std::mutex> nodeGuard(node->lock);
+                    damaged = rebalance(parent, node);
+                }
+            }
+            if (node->parent.load() != parent) {
+                // A rotation damages a node below parent, whose new height then has to
+                // reach above parent too even if the walk from below stops short of it
+                fix_height_and_rebalance(damaged);
+                damaged = parent;
+            }
+            node = damaged;
+        }
+    }
+}
+
+template <class KeyType, class ValueType>
+ConcurrentNode<KeyType, ValueType>* ConcurrentAvlTree<KeyType, ValueType>::fix_height(CNode* node) {
+    int condition = node_condition(node);
+    switch (condition) {
+    case REBALANCE_REQUIRED:
+    case UNLINK_REQUIRED:
+        return node;
+    case NOTHING_REQUIRED:
+        return NULL;
+    default:
+        // The parent's height may be wrong now
+        node->height.store(condition);
+        return node->parent.load();
+    }
+}
+
+template <class KeyType, class ValueType>
+ConcurrentNode<KeyType, ValueType>* ConcurrentAvlTree<KeyType, ValueType>::rebalance(CNode* parent, CNode* node) {
+    CNode* left = node->left.load();
+    CNode* right = node->right.load();
+    if ((left == NULL || right == NULL) && node->value.load() == NULL) {
+        if (attempt_unlink(parent, node)) {
+            EpochReclaimer::retire(node, delete_node);
+            return fix_height(parent);
+        }
+        return node;
+    }
+    int nodeHeight = node->height.load();
+    int leftHeight = height(left);
+    int rightHeight = height(right);
+    int newHeight = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    if (leftHeight - rightHeight > 1) {
+        return rebalance_toward(parent, node, left, -1, rightHeight);
+    }
+    if (leftHeight - rightHeight < -1) {
+        return rebalance_toward(parent, node, right, 1, leftHeight);
+    }
+    if (newHeight != nodeHeight) {
+        node->height.store(newHeight);
+        return fix_height(parent);
+    }
+    return NULL;
+}
+
+template <class KeyType, class ValueType>
+ConcurrentNode<KeyType, ValueType>* ConcurrentAvlTree<KeyType, ValueType>::rebalance_toward(CNode* parent, CNode* node,
+    CNode* son, int side, int otherHeight) {
+    std::lock_guard<std::mutex> sonGuard(son->lock);
+    int sonHeight = son->height.load();
+    if (sonHeight - otherHeight <= 1) {
+        // Already fixed by another thread, look at node again
+        return node;
+    }
+    CNode* inner = child(son, -side);
+    int outerHeight = height(child(son, side));
+    int innerHeight = height(inner);
+    if (outerHeight >= innerHeight) {
+        return rotate(parent, node, son, side, otherHeight, outerHeight, inner, innerHeight);
+    }
+    {
+        std::lock_guard<std::mutex> innerGuard(inner->lock);
+        // A stale innerHeight may mean a single rotation is enough after all
+        innerHeight = inner->height.load();
+        if (outerHeight >= innerHeight) {
+            return rotate(parent, node, son, side, otherHeight, outerHeight, inner, innerHeight);
+        }
+        // A double rotation must not leave son unbalanced, which would be damage away from the
+        // path being fixed. Balance inner or son alone first then.
+        int innerSideHeight = height(child(inner, side));
+        int sonBalance = outerHeight - innerSideHeight;
+        if (sonBalance >= -1 && sonBalance <= 1) {
+            return rotate_double(parent, node, son, side, otherHeight, outerHeight, inner, innerSideHeight);
+        }
+        if (sonBalance > 1) {
+            // inner itself is out of balance, the walk up from it comes back to node
+            return inner;
+        }
+    }
+    return rebalance_toward(node, son, inner, -side, outerHeight);
+}
+
+template <class KeyType, class ValueType>
+ConcurrentNode<KeyType, ValueType>* ConcurrentAvlTree<KeyType, ValueType>::rotate(CNode* parent, CNode* node, CNode* son,
+    int side, int otherHeight, int outerHeight, CNode* inner, int innerHeight) {
+    // son takes node's place, node moves down with inner (son's inner subtree) as its son
+    unsigned long long nodeVersion = node->version.load();
+    CNode* parentLeft = parent->left.load();
+    node->version.store(begin_change(nodeVersion));
+
+    set_child(node, side, inner);
+    if (inner != NULL) {
+        inner->parent.store(node);
+    }
+    set_child(son, -side, node);
+    node->parent.store(son);
+    if (parentLeft == node) {
+        parent->left.store(son);
+    }
+    else {
+        parent->right.store(son);
+    }
+    son->parent.store(parent);
+
+    int newNodeHeight = 1 + (innerHeight > otherHeight ? innerHeight : otherHeight);
+    node->height.store(newNodeHeight);
+    son->height.store(1 + (outerHeight > newNodeHeight ? outerHeight : newNodeHeight));
+    node->version.store(end_change(nodeVersion));
+
+    // Fix what the held locks allow, node is the deepest damaged node
+    if (innerHeight - otherHeight < -1 || innerHeight - otherHeight > 1) {
+        return node;
+    }
+    if ((inner == NULL || otherHeight == 0) && node->value.load() == NULL) {
+        return node;
+    }
+    if (outerHeight - newNodeHeight < -1 || outerHeight - newNodeHeight > 1) {
+        return son;
+    }
+    if (outerHeight == 0 && son->value.load() == NULL) {
+        return son;
+    }
+    return fix_height(parent);
+}
+
+template <class KeyType, class ValueType>
+ConcurrentNode<KeyType, ValueType>* ConcurrentAvlTree<KeyType, ValueType>::rotate_double(CNode* parent, CNode* node, CNode* son,
+    int side, int otherHeight, int outerHeight, CNode* inner, int innerSideHeight) {
+    // inner (son's inner son) takes node's place, with son and node as its sons
+    unsigned long long nodeVersion = node->version.load();
+    unsigned long long sonVersion = son->version.load();
+    CNode* parentLeft = parent->left.load();
+    CNode* innerSide = child(inner, side);
+    CNode* innerOther = child(inner, -side);
+    int innerOtherHeight = height(innerOther);
+    node->version.store(begin_change(nodeVersion));
+    son->version.store(begin_change(sonVersion));
+
+    set_child(node, side, innerOther);
+    if (innerOther != NULL) {
+        innerOther->parent.store(node);
+    }
+    set_child(son, -side, innerSide);
+    if (innerSide != NULL) {
+        innerSide->parent.store(son);
+    }
+    set_child(inner, side, son);
+    son->parent.store(inner);
+    set_child(inner, -side, node);
+    node->parent.store(inner);
+    if (parentLeft == node) {
+        parent->left.store(inner);
+    }
+    else {
+        parent->right.store(inner);
+    }
+    inner->parent.store(parent);
+
+    int newNodeHeight = 1 + (innerOtherHeight > otherHeight ? innerOtherHeight : otherHeight);
+    node->height.store(newNodeHeight);
+    int newSonHeight = 1 + (outerHeight > innerSideHeight ? outerHeight : innerSideHeight);
+    son->height.store(newSonHeight);
+    inner->height.store(1 + (newSonHeight > newNodeHeight ? newSonHeight : newNodeHeight));
+    node->version.store(end_change(nodeVersion));
+    son->version.store(end_change(sonVersion));
+
+    // son and node are siblings now, so only one of them could be returned as damaged. A routing
+    // son left with one son is unlinked here, all the locks it needs are held.
+    if ((child(son, side) == NULL || innerSide == NULL) && son->value.load() == NULL && attempt_unlink(inner, son)) {
+        EpochReclaimer::retire(son, delete_node);
+        newSonHeight--;
+        inner->height.store(1 + (newSonHeight > newNodeHeight ? newSonHeight : newNodeHeight));
+    }
+
+    if (innerOtherHeight - otherHeight < -1 || innerOtherHeight - otherHeight > 1) {
+        return node;
+    }
+    if ((innerOther == NULL || otherHeight == 0) && node->value.load() == NULL) {
+        return node;
+    }
+    if (newSonHeight - newNodeHeight < -1 || newSonHeight - newNodeHeight > 1) {
+        return inner;
+    }
+    return fix_height(parent);
+}
+
+// AvlTree basic funcs
+
+template <class KeyType, class ValueType>
+void ConcurrentAvlTree<KeyType, ValueType>::delete_node(void* node) {
+    CNode* toDelete = static_cast<CNode*>(node);
+    delete toDelete->key;
+    delete toDelete;
+}
+
+template <class KeyType, class ValueType>
+void ConcurrentAvlTree<KeyType, ValueType>::delete_value(void* value) {
+    delete static_cast<ValueType*>(value);
+}
+
+template <class KeyType, class ValueType>
+void ConcurrentAvlTree<KeyType, ValueType>::delete_subtree(CNode* node) {
+    if (node == NULL) {
+        return;
+    }
+    delete_subtree(node->left.load());
+    delete_subtree(node->right.load());
+    delete node->value.load();
+    delete_node(node);
+}
+
+template <class KeyType, class ValueType>
+ConcurrentAvlTree<KeyType, ValueType>::ConcurrentAvlTree() : holder(NULL, NULL, NULL), size(0) {}
+
+template <class KeyType, class ValueType>
+ConcurrentAvlTree<KeyType, ValueType>::~ConcurrentAvlTree() {
+    // Unlinked nodes are not reachable from here, EpochReclaimer frees them
+    delete_subtree(holder.right.load());
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType ConcurrentAvlTree<KeyType, ValueType>::get_size(int* n) const {
+    if (n == NULL) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    *n = size.load();
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+#endif // WET1_CONCURRENT_AVLTREE_H
@@ -0,0 +1,157 @@
+#include "EpochReclaimer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Retirements between attempts to advance the global epoch
+#define EPOCH_ADVANCE_INTERVAL 64
+#define EPOCH_NUM_BAGS 3
+// Announced by threads that are not pinned
+#define EPOCH_IDLE (~0ULL)
+
+struct RetiredObject {
+	void* object;
+	void (*deleter)(void* object);
+};
+
+// State of one thread, kept for the next thread when it exits (with the objects it retired)
+struct EpochRecord {
+	std::atomic<unsigned long long> epoch;  // Epoch seen when pinned, EPOCH_IDLE otherwise
+	std::atomic<bool> inUse;
+	EpochRecord* next;
+	int nesting;
+	int retiredSinceAdvance;
+	std::vector<RetiredObject> bags[EPOCH_NUM_BAGS];
+	unsigned long long bagEpochs[EPOCH_NUM_BAGS];  // Epoch of the objects in each bag
+
+	EpochRecord() : epoch(EPOCH_IDLE), inUse(true), next(NULL), nesting(0), retiredSinceAdvance(0) {
+		for (int bagIdx = 0; bagIdx < EPOCH_NUM_BAGS; bagIdx++) {
+			bagEpochs[bagIdx] = 0;
+		}
+	}
+};
+
+static void free_bag(std::vector<RetiredObject>& bag) {
+	for (size_t objectIdx = 0; objectIdx < bag.size(); objectIdx++) {
+		bag[objectIdx].deleter(bag[objectIdx].object);
+	}
+	bag.clear();
+}
+
+// Records are only added, and freed with the domain at exit, after all other threads ended
+struct EpochDomain {
+	std::atomic<unsigned long long> globalEpoch;
+	std::atomic<EpochRecord*> records;
+
+	constexpr EpochDomain() : globalEpoch(0), records(nullptr) {}
+
+	~EpochDomain() {
+		EpochRecord* record = records.load();
+		while (record != NULL) {
+			EpochRecord* next = record->next;
+			for (int bagIdx = 0; bagIdx < EPOCH_NUM_BAGS; bagIdx++) {
+				free_bag(record->bags[bagIdx]);
+			}
+			delete record;
+			record = next;
+		}
+	}
+};
+
+static EpochDomain domain;
+
+// Gives the record of the calling thread back when the thread exits
+struct EpochThread {
+	EpochRecord* record;
+
+	EpochThread() : record(NULL) {}
+	~EpochThread() {
+		if (record != NULL) {
+			record->inUse.store(false);
+		}
+	}
+};
+
+static thread_local EpochThread epochThread;
+
+static EpochRecord* acquire_record() {
+	// Take over the record of an exited thread if there is one
+	for (EpochRecord* record = domain.records.load(); record != NULL; record = record->next) {
+		bool expected = false;
+		if (!record->inUse.load() && record->inUse.compare_exchange_strong(expected, true)) {
+			return record;
+		}
+	}
+	EpochRecord* record = new EpochRecord();
+	EpochRecord* head = domain.records.load();
+	do {
+		record->next = head;
+	} while (!domain.records.compare_exchange_weak(head, record));
+	return record;
+}
+
+// Frees the bags retired at least two epochs before globalEpoch
+static void collect(EpochRecord* record, unsigned long long globalEpoch) {
+	for (int bagIdx = 0; bagIdx < EPOCH_NUM_BAGS; bagIdx++) {
+		if (!record->bags[bagIdx].empty() && record->bagEpochs[bagIdx] + 2 <= globalEpoch) {
+			free_bag(record->bags[bagIdx]);
+		}
+	}
+}
+
+// Advances the global epoch if every pinned thread has seen it, returns the global epoch
+static unsigned long long try_advance() {
+	unsigned long long epoch = domain.globalEpoch.load();
+	for (EpochRecord* record = domain.records.load(); record != NULL; record = record->next) {
+		unsigned long long announced = record->epoch.load();
+		if (announced != EPOCH_IDLE && announced != epoch) {
+			return epoch;
+		}
+	}
+	// On failure another thread advanced it, epoch is updated to its value
+	if (domain.globalEpoch.compare_exchange_strong(epoch, epoch + 1)) {
+		epoch++;
+	}
+	return epoch;
+}
+
+EpochReclaimer::Guard::Guard() {
+	if (epochThread.record == NULL) {
+		epochThread.record = acquire_record();
+	}
+	EpochRecord* record = epochThread.record;
+	if (record->nesting++ > 0) {
+		return;
+	}
+	unsigned long long epoch = domain.globalEpoch.load();
+	record->epoch.store(epoch, std::memory_order_relaxed);
+	// The announcement must be visible before any shared pointer is read
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	collect(record, epoch);
+}
+
+EpochReclaimer::Guard::~Guard() {
+	EpochRecord* record = epochThread.record;
+	if (--record->nesting == 0) {
+		record->epoch.store(EPOCH_IDLE);
+	}
+}
+
+void EpochReclaimer::retire(void* object, void (*deleter)(void* object)) {
+	EpochRecord* record = epochThread.record;
+	// Tagged with the epoch after the unlink: threads that saw the object are pinned at it or before
+	unsigned long long epoch = domain.globalEpoch.load();
+	int bagIdx = static_cast<int>(epoch % EPOCH_NUM_BAGS);
+	if (record->bagEpochs[bagIdx] != epoch) {
+		// The bag holds objects of epoch - 3 or older
+		free_bag(record->bags[bagIdx]);
+		record->bagEpochs[bagIdx] = epoch;
+	}
+	RetiredObject retired = { object, deleter };
+	record->bags[bagIdx].push_back(retired);
+	if (++record->retiredSinceAdvance >= EPOCH_ADVANCE_INTERVAL) {
+		record->retiredSinceAdvance = 0;
+		collect(record, try_advance());
+	}
+}
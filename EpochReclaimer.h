@@ -0,0 +1,33 @@
+#ifndef WET1_EPOCH_RECLAIMER_H_
+#define WET1_EPOCH_RECLAIMER_H_
+
+// Epoch based reclamation of objects that other threads may read without locks.
+//
+// A thread pins itself with a Guard around every access to shared objects.
+// An object unlinked from its structure is retired instead of deleted, and
+// freed only once no thread that was pinned before it was unlinked can still
+// hold it: the global epoch advances when every pinned thread has seen the
+// current one, and objects retired in epoch e are freed once it reaches e + 2.
+// Every thread keeps its retired objects in three bags, one per epoch modulo 3,
+// so retiring takes no lock.
+//
+// There is one domain for the whole process, so any thread may pin and
+// retire. Objects still retired at exit are freed then. Builds need -pthread.
+
+class EpochReclaimer {
+public:
+	// Pins the calling thread while alive, guards may nest
+	class Guard {
+	public:
+		Guard();
+		~Guard();
+		Guard(const Guard&) = delete;
+		Guard& operator=(const Guard&) = delete;
+	};
+
+	// Calls deleter(object) once no pinned thread can reach the object, which must already
+	// be unlinked. The calling thread must be pinned.
+	static void retire(void* object, void (*deleter)(void* object));
+};
+
+#endif // WET1_EPOCH_RECLAIMER_H_
@@ -0,0 +1,166 @@
+#ifndef WET1_OBJECT_POOL_H_
+#define WET1_OBJECT_POOL_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Smallest block of slots a pool allocates
+#define POOL_MIN_BLOCK_SLOTS 16
+// Bytes between the caches of a pool, so threads using neighbouring caches do not share cache lines
+#define POOL_CACHE_LINE 64
+
+struct PoolStats {
+	long long liveObjects;
+	long long capacity;                  // Slots in all the blocks, live or free
+	unsigned long long heapAllocations;  // Blocks taken from the heap so far
+};
+
+// Cache the calling thread uses in pools with several caches, 0 unless set
+inline int& object_pool_cache_index() {
+	static thread_local int cacheIdx = 0;
+	return cacheIdx;
+}
+
+// Pool of objects of one type, carved out of blocks that go back to the heap
+// only with the pool. Destroyed objects leave their slot on a free list that is
+// reused first, so once the pool has grown (or was reserved) to the peak number
+// of live objects, creating and destroying objects does not touch the heap.
+// Blocks double the capacity, so a pool grown one object at a time allocates
+// O(log n) times. Not thread safe.
+//
+// A pool shared by several threads gets one cache (blocks and free list) per
+// thread, and each thread sets object_pool_cache_index() to its own cache
+// before using it. Objects may be destroyed by another thread than the one
+// that created them; their slot joins the destroying thread's cache. Caches
+// are never touched by two threads at once, so they need no locking.
+template <class T>
+class ObjectPool {
+	union Slot {
+		Slot* next;  // Next free slot, or the previous block in the first slot of a block
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	struct Cache {
+		Slot* blocks;  // Last allocated block
+		Slot* freeList;
+		PoolStats stats;  // liveObjects counts creations less destructions in this cache
+		unsigned char padding[POOL_CACHE_LINE];
+	};
+
+	Cache* caches;  // localCache for a pool with one cache
+	int numCaches;
+	Cache localCache;
+
+	Cache& current_cache() {
+		return caches[numCaches == 1 ? 0 : object_pool_cache_index()];
+	}
+
+	// Adds a block of numSlots free slots to cache, throws std::bad_alloc
+	static void grow(Cache& cache, long long numSlots) {
+		Slot* block = new Slot[numSlots + 1];
+		cache.stats.heapAllocations++;
+		block[0].next = cache.blocks;
+		cache.blocks = block;
+		for (long long slotIdx = numSlots; slotIdx >= 1; slotIdx--) {
+			block[slotIdx].next = cache.freeList;
+			cache.freeList = &block[slotIdx];
+		}
+		cache.stats.capacity += numSlots;
+	}
+
+public:
+	// numCaches is the number of threads sharing the pool (at least 1). Throws std::bad_alloc,
+	// a pool with one cache allocates nothing until it is used.
+	explicit ObjectPool(int numCaches = 1) : caches(NULL), numCaches(numCaches < 1 ? 1 : numCaches) {
+		caches = this->numCaches == 1 ? &localCache : new Cache[this->numCaches];
+		for (int cacheIdx = 0; cacheIdx < this->numCaches; cacheIdx++) {
+			caches[cacheIdx].blocks = NULL;
+			caches[cacheIdx].freeList = NULL;
+			caches[cacheIdx].stats.liveObjects = 0;
+			caches[cacheIdx].stats.capacity = 0;
+			caches[cacheIdx].stats.heapAllocations = 0;
+		}
+	}
+
+	// Objects still alive are not destroyed
+	~ObjectPool() {
+		for (int cacheIdx = 0; cacheIdx < numCaches; cacheIdx++) {
+			Slot* blocks = caches[cacheIdx].blocks;
+			while (blocks != NULL) {
+				Slot* previous = blocks[0].next;
+				delete[] blocks;
+				blocks = previous;
+			}
+		}
+		if (caches != &localCache) {
+			delete[] caches;
+		}
+	}
+
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	// Constructs an object in a free slot, throws std::bad_alloc when a block cannot be allocated
+	template <class... Args>
+	T* create(Args&&... args) {
+		Cache& cache = current_cache();
+		if (cache.freeList == NULL) {
+			grow(cache, cache.stats.capacity > POOL_MIN_BLOCK_SLOTS ? cache.stats.capacity : POOL_MIN_BLOCK_SLOTS);
+		}
+		Slot* slot = cache.freeList;
+		cache.freeList = slot->next;
+		T* object;
+		try {
+			object = new (slot->storage) T(std::forward<Args>(args)...);
+		}
+		catch (...) {
+			slot->next = cache.freeList;
+			cache.freeList = slot;
+			throw;
+		}
+		cache.stats.liveObjects++;
+		return object;
+	}
+
+	// Destroys an object created by this pool
+	void destroy(T* object) {
+		if (object == NULL) {
+			return;
+		}
+		object->~T();
+		Cache& cache = current_cache();
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		slot->next = cache.freeList;
+		cache.freeList = slot;
+		cache.stats.liveObjects--;
+	}
+
+	// Grows the calling thread's cache to hold numObjects live objects, returns false when out of memory
+	bool reserve(long long numObjects) {
+		Cache& cache = current_cache();
+		if (numObjects <= cache.stats.capacity) {
+			return true;
+		}
+		try {
+			grow(cache, numObjects - cache.stats.capacity);
+		}
+		catch (std::bad_alloc& ba) {
+			return false;
+		}
+		return true;
+	}
+
+	// Sums of all the caches, which must not be in use meanwhile
+	PoolStats get_stats() const {
+		PoolStats result = { 0, 0, 0 };
+		for (int cacheIdx = 0; cacheIdx < numCaches; cacheIdx++) {
+			result.liveObjects += caches[cacheIdx].stats.liveObjects;
+			result.capacity += caches[cacheIdx].stats.capacity;
+			result.heapAllocations += caches[cacheIdx].stats.heapAllocations;
+		}
+		return result;
+	}
+};
+
+#endif // WET1_OBJECT_POOL_H_
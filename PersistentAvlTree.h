@@ -0,0 +1,591 @@
+#ifndef WET1_PERSISTENT_AVLTREE_H
+#define WET1_PERSISTENT_AVLTREE_H
+
+#include "AVLTree.h"
+
+#include <atomic>
+#include <cassert>
+#include <new>
+#include <utility>
+
+// Persistent (path copying) variant of AvlTree.
+//
+// Nodes are reference counted and may be shared between trees, so copying a
+// tree or taking a snapshot() is O(1). A mutation copies only the nodes on its
+// search path that are still shared and relinks the unchanged subtrees, so the
+// other versions never see it. Nodes owned by a single tree are updated in
+// place, making a tree without live snapshots about as cheap as AvlTree.
+//
+// A mutation first unshares every node it may change: its search path and,
+// for a remove, the siblings a rebalancing may rotate. Each copy takes its
+// original's place before the original is released, so an allocation failure
+// there leaves the tree valid and unchanged. The update itself then allocates
+// nothing.
+//
+// Nodes have no parent pointers (a shared node has several parents), keys and
+// values are stored inside the nodes. A version may be read from any thread,
+// but a single tree must not be mutated or snapshotted while it is read.
+
+template <class KeyType, class ValueType>
+struct PersistentNode {
+    KeyType key;
+    ValueType value;
+    PersistentNode* left;
+    PersistentNode* right;
+    int height;
+    std::atomic<int> refCount;  // Trees and parent nodes pointing at this node
+
+    template <class KeyArg, class ValueArg>
+    PersistentNode(KeyArg&& key, ValueArg&& value) : key(std::forward<KeyArg>(key)), value(std::forward<ValueArg>(value)),
+        left(NULL), right(NULL), height(0), refCount(1) {}
+};
+
+template <class KeyType, class ValueType>
+class PersistentAvlTree {
+    typedef PersistentNode<KeyType, ValueType> PNode;
+
+    PNode* root;
+    int size;
+
+    // Reference counting, a node is freed with the last reference to it
+    static void retain(PNode* node);
+    static void release(PNode* node);
+
+    // Makes the node at *link owned by this tree alone, copying it in place if it is shared.
+    // Throws std::bad_alloc with the link unchanged.
+    static void unshare(PNode** link);
+    // Unshare the nodes insert_aux / remove_aux will change, see the class comment
+    void unshare_insert_path(const KeyType& key);
+    void unshare_remove_path(const KeyType& key);
+    // Unshares the child of node opposite to goLeft if the removal below may rotate it
+    static void unshare_rotated_sibling(PNode* node, bool goLeft);
+
+    static int node_height(const PNode* node);
+    static void update_height(PNode* node);
+
+    // Rolls and balancing of a uniquely owned node, return the new subtree root. The nodes they
+    // move must be unshared already.
+    static PNode* left_roll(PNode* node);
+    static PNode* right_roll(PNode* node);
+    static PNode* balance(PNode* node);
+
+    // Recursive updates of unshared paths, take the subtree reference and return the new
+    // subtree root. They do not allocate. The key must be missing from (insert) or present in
+    // (remove) the subtree.
+    static PNode* insert_aux(PNode* node, PNode* leaf);
+    static PNode* remove_aux(PNode* node, const KeyType& key);
+    // Removes the minimum of the subtree, moving it into target
+    static PNode* remove_min_aux(PNode* node, PNode* target);
+
+    const PNode* find_node_by_key(const KeyType& key) const;
+
+    static PNode* build_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end);
+
+    static void keys_in_order(KeyType* array, const PNode* node, int* counter);
+    static void values_in_order(ValueType* array, const PNode* node, int* counter);
+    static void values_ranged_in_order(ValueType* array, const PNode* node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value));
+    static void num_of_values_ranged_in_order(const PNode* node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value));
+
+public:
+    PersistentAvlTree();
+    // Copies share all the nodes, O(1)
+    PersistentAvlTree(const PersistentAvlTree& tree);
+    PersistentAvlTree& operator=(const PersistentAvlTree& tree);
+    ~PersistentAvlTree();
+
+    // Frozen version of the tree, unaffected by later changes to this tree, O(1)
+    PersistentAvlTree snapshot() const;
+
+    TreeStatusType insert(const KeyType& key, const ValueType& value);
+    TreeStatusType insert(KeyType&& key, ValueType&& value);
+    template <class KeyArg, class ValueArg>
+    TreeStatusType emplace(KeyArg&& key, ValueArg&& value);
+    TreeStatusType find(const KeyType& key, ValueType* value) const;
+    TreeStatusType remove(const KeyType& key);
+    TreeStatusType get_size(int* n) const;
+    TreeStatusType create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length);
+    const KeyType* find_max() const;
+    const KeyType* find_min() const;
+    void get_tree_keys_in_order(KeyType* const array) const;
+    void get_tree_values_in_order(ValueType* const array) const;
+    // A NULL validationFunc accepts every value in range
+    int fill_tree_values_ranged_in_order(ValueType* const array, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const;
+    int get_num_of_values_ranged(const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const;
+};
+
+/****************************************************************************/
+
+// Reference counting
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::retain(PNode* node) {
+    if (node != NULL) {
+        node->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::release(PNode* node) {
+    if (node == NULL) {
+        return;
+    }
+    if (node->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        release(node->left);
+        release(node->right);
+        delete node;
+    }
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::unshare(PNode** link) {
+    PNode* node = *link;
+    if (node->refCount.load(std::memory_order_acquire) == 1) {
+        return;
+    }
+    PNode* copy = new PNode(node->key, node->value);
+    copy->left = node->left;
+    copy->right = node->right;
+    copy->height = node->height;
+    retain(copy->left);
+    retain(copy->right);
+    // The copy holds the same data, the original is released only once it is unlinked
+    *link = copy;
+    release(node);
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::unshare_insert_path(const KeyType& key) {
+    // Rotations after an insert only move nodes of its path
+    PNode** link = &this->root;
+    while (*link != NULL) {
+        unshare(link);
+        link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+    }
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::unshare_remove_path(const KeyType& key) {
+    PNode** link = &this->root;
+    bool toSuccessor = false;
+    while (*link != NULL) {
+        unshare(link);
+        PNode* node = *link;
+        bool goLeft;
+        if (toSuccessor) {
+            if (node->left == NULL) {
+                return;
+            }
+            goLeft = true;
+        }
+        else if (key < node->key) {
+            goLeft = true;
+        }
+        else if (node->key < key) {
+            goLeft = false;
+        }
+        else if (node->left == NULL || node->right == NULL) {
+            // Spliced out, its parent rebalances
+            return;
+        }
+        else {
+            // The successor, the minimum of the right subtree, takes the key's place
+            toSuccessor = true;
+            goLeft = false;
+        }
+        unshare_rotated_sibling(node, goLeft);
+        link = goLeft ? &node->left : &node->right;
+    }
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::unshare_rotated_sibling(PNode* node, bool goLeft) {
+    // The path child loses at most 1 height, which unbalances node only when the sibling is
+    // already taller. The sibling's children are not changed by the removal, so whether the
+    // rotation is double (and moves the sibling's inner child) is known here.
+    PNode** siblingLink = goLeft ? &node->right : &node->left;
+    PNode* pathChild = goLeft ? node->left : node->right;
+    if (*siblingLink == NULL || node_height(*siblingLink) - node_height(pathChild) != 1) {
+        return;
+    }
+    unshare(siblingLink);
+    PNode* sibling = *siblingLink;
+    PNode** innerLink = goLeft ? &sibling->left : &sibling->right;
+    PNode* outer = goLeft ? sibling->right : sibling->left;
+    if (node_height(outer) < node_height(*innerLink)) {
+        unshare(innerLink);
+    }
+}
+
+// tree balancing funcs
+template <class KeyType, class ValueType>
+int PersistentAvlTree<KeyType, ValueType>::node_height(const PNode* node) {
+    return node == NULL ? -1 : node->height;
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::update_height(PNode* node) {
+    node->height = 1 + max(node_height(node->left), node_height(node->right));
+}
+
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::left_roll(PNode* node) {
+    PNode* newRoot = node->right;
+    assert(newRoot->refCount.load(std::memory_order_relaxed) == 1);
+    node->right = newRoot->left;
+    newRoot->left = node;
+    update_height(node);
+    update_height(newRoot);
+    return newRoot;
+}
+
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::right_roll(PNode* node) {
+    PNode* newRoot = node->left;
+    assert(newRoot->refCount.load(std::memory_order_relaxed) == 1);
+    node->left = newRoot->right;
+    newRoot->right = node;
+    update_height(node);
+    update_height(newRoot);
+    return newRoot;
+}
+
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::balance(PNode* node) {
+    int balanceFactor = node_height(node->left) - node_height(node->right);
+    if (balanceFactor == 2) {
+        if (node_height(node->left->left) < node_height(node->left->right)) {
+            // Left right roll
+            node->left = left_roll(node->left);
+        }
+        return right_roll(node);
+    }
+    if (balanceFactor == -2) {
+        if (node_height(node->right->right) < node_height(node->right->left)) {
+            // Right left roll
+            node->right = right_roll(node->right);
+        }
+        return left_roll(node);
+    }
+    return node;
+}
+
+// Recursive updates
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::insert_aux(PNode* node, PNode* leaf) {
+    if (node == NULL) {
+        return leaf;
+    }
+    if (leaf->key < node->key) {
+        node->left = insert_aux(node->left, leaf);
+    }
+    else {
+        node->right = insert_aux(node->right, leaf);
+    }
+    update_height(node);
+    return balance(node);
+}
+
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::remove_aux(PNode* node, const KeyType& key) {
+    if (key < node->key) {
+        node->left = remove_aux(node->left, key);
+    }
+    else if (node->key < key) {
+        node->right = remove_aux(node->right, key);
+    }
+    else if (node->left == NULL || node->right == NULL) {
+        // Splice out the node, its only child takes its place
+        PNode* child = node->left != NULL ? node->left : node->right;
+        retain(child);
+        release(node);
+        return child;
+    }
+    else {
+        // Replace the node's data by its successor's and remove the successor
+        node->right = remove_min_aux(node->right, node);
+    }
+    update_height(node);
+    return balance(node);
+}
+
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::remove_min_aux(PNode* node, PNode* target) {
+    if (node->left == NULL) {
+        PNode* right = node->right;
+        retain(right);
+        target->key = std::move(node->key);
+        target->value = std::move(node->value);
+        release(node);
+        return right;
+    }
+    node->left = remove_min_aux(node->left, target);
+    update_height(node);
+    return balance(node);
+}
+
+template <class KeyType, class ValueType>
+const PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::find_node_by_key(const KeyType& key) const {
+    const PNode* currNode = root;
+    while (currNode != NULL) {
+        if (key < currNode->key) {
+            currNode = currNode->left;
+        }
+        else if (currNode->key < key) {
+            currNode = currNode->right;
+        }
+        else {
+            return currNode;
+        }
+    }
+    return NULL;
+}
+
+template <class KeyType, class ValueType>
+PersistentNode<KeyType, ValueType>* PersistentAvlTree<KeyType, ValueType>::build_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int start, int end) {
+    if (start > end) {
+        return NULL;
+    }
+    int middle = (start + end) / 2;
+    PNode* tempRoot = new PNode(sortedKeyArray[middle], sortedValueArray[middle]);
+    try {
+        tempRoot->left = build_from_sorted_array(sortedKeyArray, sortedValueArray, start, middle - 1);
+        tempRoot->right = build_from_sorted_array(sortedKeyArray, sortedValueArray, middle + 1, end);
+    }
+    catch (std::bad_alloc& ba) {
+        release(tempRoot);
+        throw;
+    }
+    update_height(tempRoot);
+    return tempRoot;
+}
+
+// Traversals
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::keys_in_order(KeyType* array, const PNode* node, int* counter) {
+    if (node == NULL) {
+        return;
+    }
+    keys_in_order(array, node->left, counter);
+    array[*counter] = node->key;
+    (*counter)++;
+    keys_in_order(array, node->right, counter);
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::values_in_order(ValueType* array, const PNode* node, int* counter) {
+    if (node == NULL) {
+        return;
+    }
+    values_in_order(array, node->left, counter);
+    array[*counter] = node->value;
+    (*counter)++;
+    values_in_order(array, node->right, counter);
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::values_ranged_in_order(ValueType* array, const PNode* node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) {
+    if (node == NULL) {
+        return;
+    }
+    if (minKey < node->key) {
+        values_ranged_in_order(array, node->left, counter, minKey, maxKey, validationFunc);
+    }
+    if (!(node->key < minKey) && !(maxKey < node->key) && (validationFunc == NULL || validationFunc(node->value))) {
+        array[*counter] = node->value;
+        (*counter)++;
+    }
+    if (node->key < maxKey) {
+        values_ranged_in_order(array, node->right, counter, minKey, maxKey, validationFunc);
+    }
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::num_of_values_ranged_in_order(const PNode* node, int* counter, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) {
+    if (node == NULL) {
+        return;
+    }
+    if (minKey < node->key) {
+        num_of_values_ranged_in_order(node->left, counter, minKey, maxKey, validationFunc);
+    }
+    if (!(node->key < minKey) && !(maxKey < node->key) && (validationFunc == NULL || validationFunc(node->value))) {
+        (*counter)++;
+    }
+    if (node->key < maxKey) {
+        num_of_values_ranged_in_order(node->right, counter, minKey, maxKey, validationFunc);
+    }
+}
+
+// PersistentAvlTree basic funcs
+template <class KeyType, class ValueType>
+PersistentAvlTree<KeyType, ValueType>::PersistentAvlTree() {
+    this->root = NULL;
+    this->size = 0;
+}
+
+template <class KeyType, class ValueType>
+PersistentAvlTree<KeyType, ValueType>::PersistentAvlTree(const PersistentAvlTree<KeyType, ValueType>& tree) {
+    this->root = tree.root;
+    this->size = tree.size;
+    retain(this->root);
+}
+
+template <class KeyType, class ValueType>
+PersistentAvlTree<KeyType, ValueType>& PersistentAvlTree<KeyType, ValueType>::operator=(const PersistentAvlTree<KeyType, ValueType>& tree) {
+    // Retain first, so assigning a tree to itself keeps its nodes
+    retain(tree.root);
+    release(this->root);
+    this->root = tree.root;
+    this->size = tree.size;
+    return *this;
+}
+
+template <class KeyType, class ValueType>
+PersistentAvlTree<KeyType, ValueType>::~PersistentAvlTree() {
+    release(this->root);
+}
+
+template <class KeyType, class ValueType>
+PersistentAvlTree<KeyType, ValueType> PersistentAvlTree<KeyType, ValueType>::snapshot() const {
+    return PersistentAvlTree<KeyType, ValueType>(*this);
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::insert(const KeyType& key, const ValueType& value) {
+    return emplace(key, value);
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::insert(KeyType&& key, ValueType&& value) {
+    return emplace(std::move(key), std::move(value));
+}
+
+template <class KeyType, class ValueType>
+template <class KeyArg, class ValueArg>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::emplace(KeyArg&& key, ValueArg&& value) {
+    // Look the key up first, so a failed insert does not copy the path
+    if (find_node_by_key(key) != NULL) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    // Everything is allocated before the tree changes, see the class comment
+    PNode* leaf;
+    try {
+        leaf = new PNode(std::forward<KeyArg>(key), std::forward<ValueArg>(value));
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    try {
+        unshare_insert_path(leaf->key);
+    }
+    catch (std::bad_alloc& ba) {
+        delete leaf;
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    this->root = insert_aux(this->root, leaf);
+    this->size++;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::find(const KeyType& key, ValueType* value) const {
+    if (value == NULL) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    const PNode* found = find_node_by_key(key);
+    if (found == NULL) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    *value = found->value;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::remove(const KeyType& key) {
+    if (find_node_by_key(key) == NULL) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    try {
+        unshare_remove_path(key);
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    this->root = remove_aux(this->root, key);
+    this->size--;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::get_size(int* n) const {
+    if (n == NULL) {
+        return TreeStatusType::TREE_INVALID_INPUT;
+    }
+    *n = this->size;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+TreeStatusType PersistentAvlTree<KeyType, ValueType>::create_tree_from_sorted_array(KeyType* sortedKeyArray, ValueType* sortedValueArray, int length) {
+    if (this->root != NULL || length <= 0) {
+        return TreeStatusType::TREE_FAILURE;
+    }
+    try {
+        this->root = build_from_sorted_array(sortedKeyArray, sortedValueArray, 0, length - 1);
+    }
+    catch (std::bad_alloc& ba) {
+        return TreeStatusType::TREE_ALLOCATION_ERROR;
+    }
+    this->size = length;
+    return TreeStatusType::TREE_SUCCESS;
+}
+
+template <class KeyType, class ValueType>
+const KeyType* PersistentAvlTree<KeyType, ValueType>::find_max() const {
+    const PNode* currNode = this->root;
+    if (currNode == NULL) {
+        return NULL;
+    }
+    while (currNode->right != NULL) {
+        currNode = currNode->right;
+    }
+    return &currNode->key;
+}
+
+template <class KeyType, class ValueType>
+const KeyType* PersistentAvlTree<KeyType, ValueType>::find_min() const {
+    const PNode* currNode = this->root;
+    if (currNode == NULL) {
+        return NULL;
+    }
+    while (currNode->left != NULL) {
+        currNode = currNode->left;
+    }
+    return &currNode->key;
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::get_tree_keys_in_order(KeyType* const array) const {
+    int counter = 0;
+    keys_in_order(array, this->root, &counter);
+}
+
+template <class KeyType, class ValueType>
+void PersistentAvlTree<KeyType, ValueType>::get_tree_values_in_order(ValueType* const array) const {
+    int counter = 0;
+    values_in_order(array, this->root, &counter);
+}
+
+template <class KeyType, class ValueType>
+int PersistentAvlTree<KeyType, ValueType>::fill_tree_values_ranged_in_order(ValueType* const array, const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const {
+    int counter = 0;
+    values_ranged_in_order(array, this->root, &counter, minKey, maxKey, validationFunc);
+    return counter;
+}
+
+template <class KeyType, class ValueType>
+int PersistentAvlTree<KeyType, ValueType>::get_num_of_values_ranged(const KeyType& minKey, const KeyType& maxKey, bool (*validationFunc)(ValueType value)) const {
+    int counter = 0;
+    num_of_values_ranged_in_order(this->root, &counter, minKey, maxKey, validationFunc);
+    return counter;
+}
+
+#endif //WET1_PERSISTENT_AVLTREE_H
@@ -1,6 +1,7 @@
 #include "Player.h"
-Player::Player(int playerId, int gamesPlayed, int goals, int cards, bool goalKeeper, Team* team) : playerId(playerId), goals(goals), cards(cards), goalKeeper(goalKeeper), initialGamesPlayed(gamesPlayed), team(team) {
-    gamesPlayedAtJoin = team->get_games_played();
+Player::Player(int playerId, int gamesPlayed, int goals, int cards, bool goalKeeper, Team* team) : playerId(playerId), goals(goals), cards(cards), goalKeeper(goalKeeper), initialGamesPlayed(gamesPlayed), group(team->get_group()) {
+    group->acquire();
+    gamesPlayedAtJoin = group->get_games();
 }
 
 
@@ -11,21 +12,44 @@ Player::Player() {
     goalKeeper = false;
     initialGamesPlayed = 0;
     gamesPlayedAtJoin = 0;
-    team = nullptr;  // TODO: check if nessesary
+    group = nullptr;
 }
 
-Player::Player(Player& refPlayer) {
+Player::Player(const Player& refPlayer) {
     playerId = refPlayer.get_player_id();
     goals = refPlayer.get_goals();
     cards = refPlayer.get_cards();
     goalKeeper = refPlayer.is_goal_keeper();
     initialGamesPlayed = refPlayer.initialGamesPlayed;
     gamesPlayedAtJoin = refPlayer.gamesPlayedAtJoin;
-    team = refPlayer.get_team();
+    group = refPlayer.group;
+    if (group != nullptr) {
+        group->acquire();
+    }
+}
+
+Player& Player::operator=(const Player& refPlayer) {
+    // Acquire first, the groups may be the same
+    if (refPlayer.group != nullptr) {
+        refPlayer.group->acquire();
+    }
+    if (group != nullptr) {
+        group->release();
+    }
+    playerId = refPlayer.playerId;
+    goals = refPlayer.goals;
+    cards = refPlayer.cards;
+    goalKeeper = refPlayer.goalKeeper;
+    initialGamesPlayed = refPlayer.initialGamesPlayed;
+    gamesPlayedAtJoin = refPlayer.gamesPlayedAtJoin;
+    group = refPlayer.group;
+    return *this;
 }
 
 Player::~Player() {
-    team = nullptr;  // TODO: check if nessesary
+    if (group != nullptr) {
+        group->release();
+    }
 }
 
 // Get Methods___________________________________________________________________________________________________
@@ -34,7 +58,7 @@ int Player::get_player_id()const {
 }
 
 int Player::get_games_played()const {
-    return initialGamesPlayed + (team->get_games_played() - gamesPlayedAtJoin);
+    return initialGamesPlayed + (group->get_games() - gamesPlayedAtJoin);
 }
 
 int Player::get_goals()const {
@@ -50,7 +74,7 @@ bool Player::is_goal_keeper()const {
 }
 
 Team* Player::get_team()const {
-    return team;
+    return group->get_team();
 }
 
 
@@ -63,12 +87,17 @@ void Player::set_cards(int newCards) {
     cards = newCards;
 }
 
-void Player::set_games_played(int newGamesPlayed) {
-    initialGamesPlayed = newGamesPlayed;
+int Player::id_of(Player* player) {
+    return player->playerId;
 }
 
-void Player::set_team(Team* newTeam) {
-    team = newTeam;
+int Player::games_played_of(Player* player) {
+    return player->get_games_played();
+}
+
+void Player::set_games_played(int newGamesPlayed) {
+    initialGamesPlayed = newGamesPlayed;
+    gamesPlayedAtJoin = group->get_games();
 }
 
 // Operators____________________________________________________________________________________________________________
@@ -107,6 +136,16 @@ bool Player::operator>(const Player& otherPlayer) const
     return false;
 }
 
+bool Player::operator<=(const Player& otherPlayer) const
+{
+    return !(*this > otherPlayer);
+}
+
+bool Player::operator>=(const Player& otherPlayer) const
+{
+    return !(*this < otherPlayer);
+}
+
 bool Player::operator==(const Player& otherPlayer) const
 {
     return playerId == otherPlayer.playerId;
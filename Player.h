@@ -2,6 +2,7 @@
 #define DATASTRUCTURESWORLDCUP__PLAYER_H_
 
 #include "Team.h"
+#include "TeamGroup.h"
 
 class Team;
 
@@ -11,14 +12,15 @@ private:
 	int goals;
 	int cards;
 	bool goalKeeper;
-	int gamesPlayedAtJoin;
+	int gamesPlayedAtJoin;  // Games of the group when initialGamesPlayed was set
 	int initialGamesPlayed;
-	Team* team;
+	TeamGroup* group;  // Group of the team the player joined, leads to the current team
 
 public:
 	Player(int playerId, int gamesPlayed, int goals, int cards, bool goalKeeper, Team* team);
 	Player();
-	Player(Player& refPlayer);
+	Player(const Player& refPlayer);
+	Player& operator=(const Player& refPlayer);
 	virtual ~Player();
 
 	// Get methods
@@ -28,19 +30,24 @@ public:
 	int get_cards()const;
 	Team* get_team()const;
 	bool is_goal_keeper()const;
+	// Id of a player given by pointer, for callbacks over trees of players
+	static int id_of(Player* player);
+	static int games_played_of(Player* player);
 
 	// Set methods
+	// Sets the games played so far, team games count on from here
 	void set_games_played(int newGamesPlayed);
 	void set_goals(int newGoals);
 	void set_cards(int newCards);
-	void set_team(Team* team);
 
 	// Operators
 	bool operator<(const Player& otherPlayer) const;
 	bool operator>(const Player& otherPlayer) const;
+	bool operator<=(const Player& otherPlayer) const;
+	bool operator>=(const Player& otherPlayer) const;
 	bool operator==(const Player& otherPlayer) const;
 	bool operator!=(const Player& otherPlayer) const;
 };
 
 
-#endif //DATASTRUCTURESWORLDCUP_PLAYER_H_
\ No newline at end of file
+#endif //DATASTRUCTURESWORLDCUP_PLAYER_H_
\ No newline at end of file
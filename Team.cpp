@@ -1,15 +1,22 @@
 #include "Team.h"
 
 
-Team::Team(int teamId, int points) : teamId(teamId), points(points) {
+Team::Team(int teamId, int points, ObjectPool<TeamGroup>* groupPool, AvlNodePool<Player, Player*>* scoreNodePool,
+	AvlNodePool<int, Player*>* idNodePool) : teamId(teamId), playersByScore(scoreNodePool), playersById(idNodePool), points(points) {
 	playerCounter = 0;
 	gamesCounter = 0;
 	goalsCounter = 0;
 	cardsCounter = 0;
 	goalKeeperCounter = 0;
 	topScorerId = 0;
-	playersByScore = AvlTree<Player, Player*>();
-	playersById = AvlTree<int, Player*>();
+	pointsStanding = current_points_standing();
+	strengthStanding = current_strength_standing();
+	group = groupPool != NULL ? groupPool->create(this, groupPool) : new TeamGroup(this, NULL);
+}
+
+Team::~Team() {
+	// Players that joined this team may still hold the group after a unite
+	group->release();
 }
 
 
@@ -18,16 +25,13 @@ StatusType Team::add_player(Player* newPlayer) {
 	int playerId = newPlayer->get_player_id();
 	TreeStatusType playersByIdAddResult = playersById.insert(playerId, newPlayer);
 	if (playersByIdAddResult == TreeStatusType::TREE_FAILURE) {
-		delete newPlayer;
 		return StatusType::FAILURE;
 	}
 	else if (playersByIdAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
-		delete newPlayer;
 		return StatusType::ALLOCATION_ERROR;
 	}
 	TreeStatusType playersByScoreAddResult = playersByScore.insert(*newPlayer, newPlayer);
 	if (playersByScoreAddResult == TreeStatusType::TREE_FAILURE) {
-		delete newPlayer;
 		TreeStatusType playersByIdRemoveResult = playersById.remove(playerId);
 		if (playersByIdRemoveResult != TreeStatusType::TREE_SUCCESS) {
 			// throw exception
@@ -35,7 +39,6 @@ StatusType Team::add_player(Player* newPlayer) {
 		return StatusType::FAILURE;
 	}
 	else if (playersByScoreAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
-		delete newPlayer;
 		TreeStatusType playersByIdRemoveResult = playersById.remove(playerId);
 		if (playersByIdRemoveResult != TreeStatusType::TREE_SUCCESS) {
 			// throw exception
@@ -75,9 +78,7 @@ StatusType Team::remove_player(int playerId) {
 	}
 	// Update top scorer
 	Player* topScorer = playersByScore.find_max();
-	if (topScorer != NULL) {
-		topScorerId = topScorer->get_player_id();
-	}
+	topScorerId = topScorer != NULL ? topScorer->get_player_id() : 0;
 	playerCounter--;
 	return StatusType::SUCCESS;
 }
@@ -126,6 +127,14 @@ int Team::get_points()const {
 	return points;
 }
 
+int Team::points_of(Team* team) {
+	return team->points;
+}
+
+int Team::id_of(Team* team) {
+	return team->teamId;
+}
+
 output_t<int> Team::get_top_scorer_id()const {
 	if (topScorerId == 0) {
 		return output_t<int>(StatusType::FAILURE);
@@ -141,13 +150,16 @@ int Team::get_games_played()const {
 	return gamesCounter;
 }
 
+TeamGroup* Team::get_group()const {
+	return group;
+}
+
 void Team::get_all_players_id(int* const output)const {
-	Player* allPlayers = new Player [playerCounter];
-	playersByScore.get_tree_keys_in_order(allPlayers);
-	for (int playerIdx = 0; playerIdx < playerCounter; playerIdx++) {
-		output[playerIdx] = allPlayers[playerIdx].get_player_id();
-	}
-	delete[] allPlayers;
+	playersByScore.map_values_in_order(output, Player::id_of, NULL);
+}
+
+int Team::get_players_id_by_rank(int* const output, int firstRank, int count)const {
+	return playersByScore.map_values_by_rank_desc(output, firstRank, count, Player::id_of);
 }
 
 int Team::get_team_goals()const {
@@ -163,15 +175,51 @@ int Team::get_team_goalkeepers_num()const {
 	return goalKeeperCounter;
 }
 
+TreeStats Team::get_players_by_score_stats()const {
+	return playersByScore.get_stats();
+}
+
+TreeStats Team::get_players_by_id_stats()const {
+	return playersById.get_stats();
+}
+
+TeamStanding Team::current_points_standing()const {
+	TeamStanding standing = { points, teamId };
+	return standing;
+}
+
+TeamStanding Team::current_strength_standing()const {
+	TeamStanding standing = { sum_for_match(), teamId };
+	return standing;
+}
+
+TeamStanding Team::get_points_standing()const {
+	return pointsStanding;
+}
+
+TeamStanding Team::get_strength_standing()const {
+	return strengthStanding;
+}
+
 // Set Methods______________________________________________________________________________________________________
 void Team::set_points(int newPoints) {
 	points = newPoints;
 }
 
 void Team::set_games_played_after_update(int gamesPlayed) {
+	// The players' games grow with the root of their group
+	group->add_games(gamesPlayed - gamesCounter);
 	gamesCounter = gamesPlayed;
 }
 
+void Team::set_points_standing(TeamStanding standing) {
+	pointsStanding = standing;
+}
+
+void Team::set_strength_standing(TeamStanding standing) {
+	strengthStanding = standing;
+}
+
 // Operators_______________________________________________________________________________________________________
 bool Team::operator<(const Team& otherTeam) const {
 	return teamId < otherTeam.teamId;
@@ -189,18 +237,35 @@ bool Team::operator!=(const Team& otherTeam) const {
 	return teamId != otherTeam.teamId;
 }
 
+bool TeamStanding::operator<(const TeamStanding& other) const {
+	return score < other.score || (score == other.score && teamId < other.teamId);
+}
+
+bool TeamStanding::operator>(const TeamStanding& other) const {
+	return other < *this;
+}
+
+bool TeamStanding::operator==(const TeamStanding& other) const {
+	return score == other.score && teamId == other.teamId;
+}
+
+bool TeamStanding::operator!=(const TeamStanding& other) const {
+	return !(*this == other);
+}
+
 bool Team::is_team_valid()const {
 	return (playerCounter >= MIN_VLD_PLAYER_NUM) && (goalKeeperCounter > 0);
 }
 
 void Team::clear_players() {
-	int numPlayers = playerCounter; // Total number of players before clear
-	int* playerIds = new int[playerCounter];
-	this->get_all_players_id(playerIds);
-	for (int playerIdx = 0; playerIdx < numPlayers; playerIdx++) {
-		this->remove_player(playerIds[playerIdx]);
-	}
-	delete[] playerIds;
+	// The trees only point at the players, so they are torn down without rebalancing
+	playersByScore.clear();
+	playersById.clear();
+	playerCounter = 0;
+	goalsCounter = 0;
+	cardsCounter = 0;
+	goalKeeperCounter = 0;
+	topScorerId = 0;
 }
 
 void Team::merge_teams(Team* team1, Team* team2) {
@@ -217,96 +282,27 @@ void Team::merge_teams(Team* team1, Team* team2) {
 		return;
 	}
 
-	// Get players of each team, sorted by id and by score
-	Player** playersByIdTeam1 = new Player * [numPlayersTeam1];
-	Player** playersByIdTeam2 = new Player * [numPlayersTeam2];
-	Player** playersByScoreTeam1 = new Player * [numPlayersTeam1];
-	Player** playersByScoreTeam2 = new Player * [numPlayersTeam2];
-	team1->get_all_players(playersByIdTeam1, playersByScoreTeam1);
-	team2->get_all_players(playersByIdTeam2, playersByScoreTeam2);
-
-	// Update player's games played at join
-	for (int team1PlayerIdx = 0; team1PlayerIdx < numPlayersTeam1; team1PlayerIdx++) {
-		int currGamesPlayed1 = playersByIdTeam1[team1PlayerIdx]->get_games_played();
-		playersByIdTeam1[team1PlayerIdx]->set_games_played(currGamesPlayed1);
-	}
-	for (int team2PlayerIdx = 0; team2PlayerIdx < numPlayersTeam2; team2PlayerIdx++) {
-		int currGamesPlayed2 = playersByIdTeam2[team2PlayerIdx]->get_games_played();
-		playersByIdTeam2[team2PlayerIdx]->set_games_played(currGamesPlayed2);
-	}
-	// Merge sorted Player pointer arrays into single sorted array (for sort by id and by score)
-	Player** playersMergedById = merge_arrays(playersByIdTeam1, playersByIdTeam2, true, numPlayersTeam1, numPlayersTeam2);
-	Player** playersMergedByScore = merge_arrays(playersByScoreTeam1, playersByScoreTeam2, false, numPlayersTeam1, numPlayersTeam2);
-
-	int* sortedPlayerIds = new int[numPlayersTeam1 + numPlayersTeam2];  	// Create array of player IDs, sorted
-	Player* sortedPlayers = new Player[numPlayersTeam1 + numPlayersTeam2];  // Create array of players, sorted by score
-	for (int i = 0; i < numPlayersTeam1 + numPlayersTeam2; i++) {
-		// Create sorted key arrays (id and score) for merged value array
-		sortedPlayerIds[i] = playersMergedById[i]->get_player_id();
-		Player* sortedPlayer = new Player(*playersMergedByScore[i]);
-		sortedPlayers[i] = *sortedPlayer;
-		// Upate team of players
-		playersMergedById[i]->set_team(this);
-		playersMergedByScore[i]->set_team(this);
-	}
-
-	// Create merged trees out of sorted merged array
-	TreeStatusType playersByIdMergeResult = playersById.create_tree_from_sorted_array(sortedPlayerIds, playersMergedById, numPlayersTeam1 + numPlayersTeam2);
-	TreeStatusType playersByScoreMergeResult = playersByScore.create_tree_from_sorted_array(sortedPlayers, playersMergedByScore, numPlayersTeam1 + numPlayersTeam2);
-	if (playersByIdMergeResult != TreeStatusType::TREE_SUCCESS || playersByScoreMergeResult != TreeStatusType::TREE_SUCCESS) {
-		// throw exception
-	}
-
-	delete[] playersByIdTeam1;
-	delete[] playersByIdTeam2;
-	delete[] playersByScoreTeam1;
-	delete[] playersByScoreTeam2;
-	delete[] sortedPlayerIds;
-	delete[] sortedPlayers;
-
-
 	// Update other feilds
 	playerCounter = numPlayersTeam1 + numPlayersTeam2;
 	goalsCounter = team1->get_team_goals() + team2->get_team_goals();
 	cardsCounter = team1->get_team_cards() + team2->get_team_cards();
 	goalKeeperCounter = team1->get_team_goalkeepers_num() + team2->get_team_goalkeepers_num();
-	topScorerId = playersByScore.find_max()->get_player_id();
-}
-
-
-Player** Team::merge_arrays(Player** arr1, Player** arr2, bool sortById, int arr1Len, int arr2Len) {
-	Player** mergedArr = new Player* [arr1Len + arr2Len];
-	int i = 0, j = 0, k = 0;
 
-	while (i < arr1Len && j < arr2Len)
-	{
-		// Pick the smaller element and put it in mergedArr
-		if (sortById ? arr1[i]->get_player_id() < arr2[j]->get_player_id() : *arr1[i] < *arr2[j])
-		{
-			mergedArr[k] = arr1[i];
-			i++;
-		}
-		else
-		{
-			mergedArr[k] = arr2[j];
-			j++;
-		}
-		k++;
-	}
-
-	// Insert leftovers from both input arrays
-	while (i < arr1Len)
-	{
-		mergedArr[k] = arr1[i];
-		i++; k++;
-	}
-
-	while (j < arr2Len)
-	{
-		mergedArr[k] = arr2[j];
-		j++; k++;
-	}
-	return mergedArr;
+	// Take the nodes of both teams' trees, relinking them into balanced merged trees without
+	// allocating (the trees only point at the players, so both teams keep their players)
+	playersById.steal(team1->playersById);
+	playersById.merge(team2->playersById);
+	playersByScore.steal(team1->playersByScore);
+	playersByScore.merge(team2->playersByScore);
+	team1->clear_players();
+	team2->clear_players();
+
+	// The players stay in the groups they joined, linking the groups moves them all to this team
+	TeamGroup* united = TeamGroup::unite(team1->group, team2->group, this);
+	united->acquire();
+	group->release();
+	group = united;
+	topScorerId = playersByScore.find_max()->get_player_id();
 }
 
 void Team::get_all_players(Player** const byIdOutput, Player** const byScoreOutput)const {
@@ -316,4 +312,4 @@ void Team::get_all_players(Player** const byIdOutput, Player** const byScoreOutp
 
 int Team::sum_for_match()const {
 	return points + (goalsCounter - cardsCounter);
-}
\ No newline at end of file
+}
\ No newline at end of file
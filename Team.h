@@ -4,12 +4,24 @@
 #define MIN_VLD_PLAYER_NUM 11
 
 #include "Player.h"
+#include "TeamGroup.h"
 #include "AVLTree.h"
 #include "wet1util.h"
 
 
 class Player;
 
+// Key of a team in a standings table: a score, ties broken by the team id
+struct TeamStanding {
+	int score;
+	int teamId;
+
+	bool operator<(const TeamStanding& other) const;
+	bool operator>(const TeamStanding& other) const;
+	bool operator==(const TeamStanding& other) const;
+	bool operator!=(const TeamStanding& other) const;
+};
+
 class Team {
 private:
 	int teamId;
@@ -22,35 +34,57 @@ private:
 	int cardsCounter;
 	int goalKeeperCounter;
 	int topScorerId;
+	TeamGroup* group;  // Root of the group its players point at
+	// Keys the team was last put under in the standings of world_cup_t
+	TeamStanding pointsStanding;
+	TeamStanding strengthStanding;
 	
 public:
-	Team(int teamId, int points);
-	virtual ~Team() = default;
+	// The team's group comes from groupPool and the nodes of its trees from the node pools when given
+	Team(int teamId, int points, ObjectPool<TeamGroup>* groupPool = NULL, AvlNodePool<Player, Player*>* scoreNodePool = NULL,
+		AvlNodePool<int, Player*>* idNodePool = NULL);
+	virtual ~Team();
+	Team(const Team&) = delete;
+	Team& operator=(const Team&) = delete;
 
-	// Player management
+	// Player management, the players stay owned by the caller also when adding fails
 	StatusType add_player(Player* newPlayer);
 	StatusType remove_player(int playerId);
 	StatusType update_player_stats(int playerId, int gamesPlayed, int scoredGoals, int cardsReceived);
 	void merge_teams(Team* team1, Team* team2);
 	void clear_players();
-	Player** merge_arrays(Player** arr1, Player** arr2, bool sort_by_id, int arr1_len, int arr2_len);
 
 	// Get methods
 	int get_team_id()const;
 	int get_points()const;
+	// Points and id of a team given by pointer, for callbacks over trees of teams
+	static int points_of(Team* team);
+	static int id_of(Team* team);
 	output_t<int> get_top_scorer_id()const;
 	int get_all_players_count()const;
 	int get_games_played()const;
+	TeamGroup* get_group()const;
 	void get_all_players_id(int* const output)const;
+	// Ids of the players ranked firstRank (0 is the top scorer) onwards, see AvlTree::map_values_by_rank_desc
+	int get_players_id_by_rank(int* const output, int firstRank, int count)const;
 	void get_all_players(Player** const byIdOutput, Player** const byScoreOutput)const;
 	int get_team_goals()const;
 	int get_team_cards()const;
 	int get_team_goalkeepers_num()const;
+	TreeStats get_players_by_score_stats()const;
+	TreeStats get_players_by_id_stats()const;
+	// Standings keys: (points, id) and (sum_for_match, id) as they are now, and as last indexed
+	TeamStanding current_points_standing()const;
+	TeamStanding current_strength_standing()const;
+	TeamStanding get_points_standing()const;
+	TeamStanding get_strength_standing()const;
 
 
 	// Set methods
 	void set_points(int newPoints);
 	void set_games_played_after_update(int gamesPlayed);
+	void set_points_standing(TeamStanding standing);
+	void set_strength_standing(TeamStanding standing);
 
 	// Match management methods
 	bool is_team_valid()const;
@@ -64,4 +98,4 @@ public:
 
 };
 
-#endif //DATASTRUCTURESWORLDCUP_TEAM_H_
\ No newline at end of file
+#endif //DATASTRUCTURESWORLDCUP_TEAM_H_
\ No newline at end of file
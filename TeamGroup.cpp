@@ -0,0 +1,77 @@
+#include "TeamGroup.h"
+
+#include <cassert>
+#include <cstddef>
+
+TeamGroup::TeamGroup(Team* team, ObjectPool<TeamGroup>* pool) : parent(NULL), team(team), pool(pool), gamesOffset(0), rank(0), references(1) {}
+
+void TeamGroup::acquire() {
+	references++;
+}
+
+void TeamGroup::release() {
+	assert(references > 0);
+	references--;
+	if (references == 0) {
+		if (parent != NULL) {
+			parent->release();
+		}
+		if (pool != NULL) {
+			pool->destroy(this);
+		}
+		else {
+			delete this;
+		}
+	}
+}
+
+TeamGroup* TeamGroup::find_root() {
+	if (parent == NULL) {
+		return this;
+	}
+	if (parent->parent == NULL) {
+		return parent;
+	}
+	// The parent's offset is relative to the root once its own path is compressed
+	TeamGroup* root = parent->find_root();
+	TeamGroup* oldParent = parent;
+	gamesOffset += oldParent->gamesOffset;
+	parent = root;
+	root->acquire();
+	oldParent->release();
+	return root;
+}
+
+Team* TeamGroup::get_team() {
+	return find_root()->team;
+}
+
+int TeamGroup::get_games() {
+	TeamGroup* root = find_root();
+	return this == root ? gamesOffset : gamesOffset + root->gamesOffset;
+}
+
+void TeamGroup::add_games(int games) {
+	assert(parent == NULL);
+	gamesOffset += games;
+}
+
+TeamGroup* TeamGroup::unite(TeamGroup* root1, TeamGroup* root2, Team* team) {
+	assert(root1->parent == NULL && root2->parent == NULL && root1 != root2);
+	TeamGroup* root = root1;
+	TeamGroup* child = root2;
+	if (root1->rank < root2->rank) {
+		root = root2;
+		child = root1;
+	}
+	else if (root1->rank == root2->rank) {
+		root1->rank++;
+	}
+	// Keep the sums of the child's set
+	child->gamesOffset -= root->gamesOffset;
+	child->parent = root;
+	child->team = NULL;
+	root->acquire();
+	root->team = team;
+	return root;
+}
@@ -0,0 +1,55 @@
+#ifndef WET1_TEAM_GROUP_H_
+#define WET1_TEAM_GROUP_H_
+
+#include "ObjectPool.h"
+
+class Team;
+
+// Union find node tying players to their current team across unite_teams.
+//
+// Every team starts with a group of its own, players point at the group of the
+// team they joined, and uniting teams links the root of one group under the
+// root of the other, so no player is touched. The root of a set points at the
+// team all of its players play for now.
+//
+// Games played are stored as offsets: the games of a group are the sum of the
+// offsets on its path to the root, and a match adds to the root offset only.
+// Linking and path compression adjust the offsets so those sums never change,
+// so a player's games are its games at join plus how much its group's sum grew.
+//
+// Groups are reference counted by the players pointing at them, by their child
+// groups and by the team owning a root, and free themselves with the last one.
+class TeamGroup {
+	TeamGroup* parent;  // NULL for a root
+	Team* team;         // Current team of the set, kept at the root only
+	ObjectPool<TeamGroup>* pool;  // Pool the group came from, NULL when allocated with new
+	int gamesOffset;
+	int rank;           // Union by rank bound on the height under a root
+	int references;
+
+	~TeamGroup() = default;
+	friend class ObjectPool<TeamGroup>;
+
+public:
+	// A root of its own, with the reference of its team
+	TeamGroup(Team* team, ObjectPool<TeamGroup>* pool);
+	TeamGroup(const TeamGroup&) = delete;
+	TeamGroup& operator=(const TeamGroup&) = delete;
+
+	void acquire();
+	// Frees the group when this was the last reference
+	void release();
+
+	// Root of the set, compressing the path to it
+	TeamGroup* find_root();
+	Team* get_team();
+	// Games played by the set since this group was created
+	int get_games();
+	// Adds games to a root
+	void add_games(int games);
+
+	// Links two roots (of different sets) into one set of the given team and returns its root
+	static TeamGroup* unite(TeamGroup* root1, TeamGroup* root2, Team* team);
+};
+
+#endif // WET1_TEAM_GROUP_H_
@@ -0,0 +1,88 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads) : task(NULL), context(NULL), numTasks(0), nextTask(0), finishedTasks(0), batchId(0), stopping(false) {
+	try {
+		for (int threadIdx = 1; threadIdx < numThreads; threadIdx++) {
+			workers.push_back(std::thread(&ThreadPool::worker_loop, this));
+		}
+	}
+	catch (...) {
+		// The destructor does not run for a failed constructor, stop the started workers here
+		stop_workers();
+		throw;
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	stop_workers();
+}
+
+void ThreadPool::stop_workers() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	batchReady.notify_all();
+	for (size_t workerIdx = 0; workerIdx < workers.size(); workerIdx++) {
+		workers[workerIdx].join();
+	}
+}
+
+int ThreadPool::get_num_threads() const {
+	return static_cast<int>(workers.size()) + 1;
+}
+
+int ThreadPool::hardware_threads() {
+	unsigned int numThreads = std::thread::hardware_concurrency();
+	return numThreads == 0 ? 1 : static_cast<int>(numThreads);
+}
+
+void ThreadPool::run_tasks(std::unique_lock<std::mutex>& lock, unsigned long long runBatchId) {
+	while (batchId == runBatchId && nextTask < numTasks) {
+		int taskIdx = nextTask++;
+		void (*batchTask)(int taskIdx, void* context) = task;
+		void* batchContext = context;
+		lock.unlock();
+		batchTask(taskIdx, batchContext);
+		lock.lock();
+		finishedTasks++;
+		if (finishedTasks == numTasks) {
+			batchDone.notify_all();
+		}
+	}
+}
+
+void ThreadPool::worker_loop() {
+	unsigned long long seenBatchId = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		while (!stopping && batchId == seenBatchId) {
+			batchReady.wait(lock);
+		}
+		if (stopping) {
+			return;
+		}
+		seenBatchId = batchId;
+		run_tasks(lock, seenBatchId);
+	}
+}
+
+void ThreadPool::run(int numTasks, void (*task)(int taskIdx, void* context), void* context) {
+	if (numTasks <= 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> runLock(runMutex);
+	std::unique_lock<std::mutex> lock(mutex);
+	this->task = task;
+	this->context = context;
+	this->numTasks = numTasks;
+	this->nextTask = 0;
+	this->finishedTasks = 0;
+	batchId++;
+	batchReady.notify_all();
+
+	run_tasks(lock, batchId);
+	while (finishedTasks < numTasks) {
+		batchDone.wait(lock);
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef WET1_THREAD_POOL_H_
+#define WET1_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads running batches of indexed tasks.
+// run() hands out the task indices of a batch to the workers and to the calling
+// thread, and returns once all of them finished. One batch runs at a time.
+// Builds need -pthread.
+
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable batchReady;
+	std::condition_variable batchDone;
+	std::mutex runMutex;  // Serializes run() calls
+
+	// Current batch
+	void (*task)(int taskIdx, void* context);
+	void* context;
+	int numTasks;
+	int nextTask;
+	int finishedTasks;
+	unsigned long long batchId;
+	bool stopping;
+
+	void worker_loop();
+	void stop_workers();
+	// Runs tasks of the given batch until none are left, lock must hold mutex.
+	// Tasks are claimed under the lock, so a late thread cannot run tasks of a newer batch.
+	void run_tasks(std::unique_lock<std::mutex>& lock, unsigned long long runBatchId);
+
+public:
+	// Starts numThreads - 1 workers, the thread calling run() is the last one
+	explicit ThreadPool(int numThreads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int get_num_threads() const;
+
+	// Calls task(taskIdx, context) for every taskIdx in [0, numTasks) and waits for all of them
+	void run(int numTasks, void (*task)(int taskIdx, void* context), void* context);
+
+	// Threads the hardware runs at once (at least 1)
+	static int hardware_threads();
+};
+
+#endif // WET1_THREAD_POOL_H_
@@ -0,0 +1,115 @@
+#include "WorkStealingPool.h"
+
+// Pool and index of the worker running on this thread, if any
+static thread_local WorkStealingPool* currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+WorkStealingPool::WorkStealingPool(int numThreads) : queuedTasks(0), nextWorker(0), stopping(false) {
+	if (numThreads < 1) {
+		numThreads = 1;
+	}
+	try {
+		for (int workerIdx = 0; workerIdx < numThreads; workerIdx++) {
+			workers.push_back(new Worker());
+		}
+		for (int workerIdx = 0; workerIdx < numThreads; workerIdx++) {
+			workers[workerIdx]->thread = std::thread(&WorkStealingPool::worker_loop, this, workerIdx);
+		}
+	}
+	catch (...) {
+		// The destructor does not run for a failed constructor, stop the started workers here
+		stop_workers();
+		throw;
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	stop_workers();
+}
+
+void WorkStealingPool::stop_workers() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (size_t workerIdx = 0; workerIdx < workers.size(); workerIdx++) {
+		if (workers[workerIdx]->thread.joinable()) {
+			workers[workerIdx]->thread.join();
+		}
+	}
+	// Deleted once all are joined, a worker on its way out may still look into the others' deques
+	for (size_t workerIdx = 0; workerIdx < workers.size(); workerIdx++) {
+		delete workers[workerIdx];
+	}
+	workers.clear();
+}
+
+int WorkStealingPool::get_num_threads() const {
+	return static_cast<int>(workers.size());
+}
+
+int WorkStealingPool::get_current_worker() const {
+	return currentPool == this ? currentWorker : -1;
+}
+
+void WorkStealingPool::submit(void (*run)(void* context), void* context) {
+	Task task = { run, context };
+	int workerIdx = currentPool == this ? currentWorker : static_cast<int>(nextWorker++ % workers.size());
+	{
+		std::lock_guard<std::mutex> lock(workers[workerIdx]->mutex);
+		workers[workerIdx]->tasks.push_back(task);
+	}
+	{
+		// Counted under the sleep lock, so a worker going to sleep cannot miss it
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedTasks++;
+	}
+	workAvailable.notify_one();
+}
+
+bool WorkStealingPool::take_task(int workerIdx, Task* task) {
+	// Newest task of our own first
+	{
+		Worker* worker = workers[workerIdx];
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		if (!worker->tasks.empty()) {
+			*task = worker->tasks.back();
+			worker->tasks.pop_back();
+			queuedTasks--;
+			return true;
+		}
+	}
+	// Then the oldest task of another worker
+	int numWorkers = static_cast<int>(workers.size());
+	for (int offset = 1; offset < numWorkers; offset++) {
+		Worker* victim = workers[(workerIdx + offset) % numWorkers];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (!victim->tasks.empty()) {
+			*task = victim->tasks.front();
+			victim->tasks.pop_front();
+			queuedTasks--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::worker_loop(int workerIdx) {
+	currentPool = this;
+	currentWorker = workerIdx;
+	Task task;
+	while (true) {
+		if (take_task(workerIdx, &task)) {
+			task.run(task.context);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		while (queuedTasks == 0 && !stopping) {
+			workAvailable.wait(lock);
+		}
+		if (queuedTasks == 0 && stopping) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef WET1_WORK_STEALING_POOL_H_
+#define WET1_WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads running independent tasks.
+// Every worker has its own deque: tasks submitted from a worker go to the
+// back of its deque and it runs them newest first, while idle workers steal
+// the oldest tasks of the others. Tasks submitted from other threads are
+// spread over the workers. Workers with nothing to run or steal sleep.
+// Builds need -pthread.
+
+class WorkStealingPool {
+	struct Task {
+		void (*run)(void* context);
+		void* context;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+
+	std::vector<Worker*> workers;
+	std::atomic<int> queuedTasks;
+	std::atomic<unsigned int> nextWorker;  // Round robin target of outside submissions
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	bool stopping;
+
+	void worker_loop(int workerIdx);
+	bool take_task(int workerIdx, Task* task);
+	void stop_workers();
+
+public:
+	// Starts numThreads workers (at least 1)
+	explicit WorkStealingPool(int numThreads);
+	// Runs the queued tasks before returning
+	~WorkStealingPool();
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	int get_num_threads() const;
+	// Index (below get_num_threads()) of the worker of this pool running the caller, -1 outside the workers
+	int get_current_worker() const;
+
+	// Queues run(context), may be called from any thread including from a task
+	void submit(void (*run)(void* context), void* context);
+};
+
+#endif // WET1_WORK_STEALING_POOL_H_
@@ -0,0 +1,146 @@
+#include "WorldCupMetrics.h"
+
+#include <cstring>
+#include <iomanip>
+
+static const char* const OP_NAMES[WORLDCUP_NUM_OPS] = {
+	"add_team",
+	"remove_team",
+	"add_player",
+	"remove_player",
+	"update_player_stats",
+	"play_match",
+	"get_num_played_games",
+	"get_team_points",
+	"unite_teams",
+	"get_top_scorer",
+	"get_all_players_count",
+	"get_all_players",
+	"get_closest_player",
+	"knockout_winner",
+	"get_scorers_page",
+	"get_top_scorers",
+	"play_matches",
+	"get_num_played_games_batch",
+	"get_team_points_batch",
+	"get_teams_by_points",
+	"get_teams_by_strength",
+	"get_team_points_rank",
+	"get_team_strength_rank"
+};
+
+unsigned long long OpStats::percentile_ns(double fraction) const {
+	if (calls == 0) {
+		return 0;
+	}
+	unsigned long long target = static_cast<unsigned long long>(fraction * calls);
+	unsigned long long seen = 0;
+	for (int bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++) {
+		seen += latencyHistogram[bucket];
+		if (seen > target) {
+			unsigned long long upperBound = 2ULL << bucket;
+			return upperBound < maxNs ? upperBound : maxNs;
+		}
+	}
+	return maxNs;
+}
+
+WorldCupStats::WorldCupStats() {
+#ifdef WORLDCUP_METRICS
+	enabled = true;
+#else
+	enabled = false;
+#endif
+	reset();
+}
+
+void WorldCupStats::reset() {
+	memset(ops, 0, sizeof(ops));
+}
+
+const char* WorldCupStats::op_name(WorldCupOp op) {
+	return OP_NAMES[static_cast<int>(op)];
+}
+
+void WorldCupStats::dump(std::ostream& out) const {
+	if (!enabled) {
+		out << "world_cup_t metrics are disabled (build with -DWORLDCUP_METRICS)\n";
+		return;
+	}
+	out << std::left << std::setw(22) << "operation" << std::right
+		<< std::setw(12) << "calls" << std::setw(10) << "success" << std::setw(10) << "invalid"
+		<< std::setw(10) << "failure" << std::setw(10) << "alloc"
+		<< std::setw(12) << "mean(ns)" << std::setw(12) << "p50(ns)" << std::setw(12) << "p99(ns)"
+		<< std::setw(12) << "p999(ns)" << std::setw(12) << "max(ns)" << '\n';
+	for (int opIdx = 0; opIdx < WORLDCUP_NUM_OPS; opIdx++) {
+		const OpStats& opStats = ops[opIdx];
+		if (opStats.calls == 0) {
+			continue;
+		}
+		out << std::left << std::setw(22) << OP_NAMES[opIdx] << std::right
+			<< std::setw(12) << opStats.calls
+			<< std::setw(10) << opStats.statusCounts[static_cast<int>(StatusType::SUCCESS)]
+			<< std::setw(10) << opStats.statusCounts[static_cast<int>(StatusType::INVALID_INPUT)]
+			<< std::setw(10) << opStats.statusCounts[static_cast<int>(StatusType::FAILURE)]
+			<< std::setw(10) << opStats.statusCounts[static_cast<int>(StatusType::ALLOCATION_ERROR)]
+			<< std::setw(12) << opStats.totalNs / opStats.calls
+			<< std::setw(12) << opStats.percentile_ns(0.50)
+			<< std::setw(12) << opStats.percentile_ns(0.99)
+			<< std::setw(12) << opStats.percentile_ns(0.999)
+			<< std::setw(12) << opStats.maxNs << '\n';
+	}
+
+	// Histograms, one line per non empty bucket: "<op> [low, high) count"
+	for (int opIdx = 0; opIdx < WORLDCUP_NUM_OPS; opIdx++) {
+		const OpStats& opStats = ops[opIdx];
+		if (opStats.calls == 0) {
+			continue;
+		}
+		out << OP_NAMES[opIdx] << " latency histogram (ns):\n";
+		for (int bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++) {
+			if (opStats.latencyHistogram[bucket] == 0) {
+				continue;
+			}
+			unsigned long long low = bucket == 0 ? 0 : 1ULL << bucket;
+			out << "  [" << low << ", " << (2ULL << bucket) << ") " << opStats.latencyHistogram[bucket] << '\n';
+		}
+	}
+}
+
+void add_tree_stats(TreeStats& total, const TreeStats& treeStats) {
+	total.comparisons += treeStats.comparisons;
+	total.lookups += treeStats.lookups;
+	total.nodesVisited += treeStats.nodesVisited;
+	total.leftLeftRolls += treeStats.leftLeftRolls;
+	total.leftRightRolls += treeStats.leftRightRolls;
+	total.rightLeftRolls += treeStats.rightLeftRolls;
+	total.rightRightRolls += treeStats.rightRightRolls;
+	total.retraces += treeStats.retraces;
+	total.retraceLength += treeStats.retraceLength;
+	if (treeStats.maxHeight > total.maxHeight) {
+		total.maxHeight = treeStats.maxHeight;
+	}
+	total.liveBytes += treeStats.liveBytes;
+}
+
+void dump_tree_stats(std::ostream& out, const char* name, int numTrees, const TreeStats& treeStats) {
+	out << std::left << std::setw(24) << name << std::right
+		<< " trees=" << numTrees
+		<< " lookups=" << treeStats.lookups
+		<< " visited/lookup=" << std::fixed << std::setprecision(2)
+		<< (treeStats.lookups == 0 ? 0.0 : (double)treeStats.nodesVisited / treeStats.lookups)
+		<< " comparisons=" << treeStats.comparisons
+		<< " rolls(LL/LR/RL/RR)=" << treeStats.leftLeftRolls << '/' << treeStats.leftRightRolls
+		<< '/' << treeStats.rightLeftRolls << '/' << treeStats.rightRightRolls
+		<< " retrace/op=" << (treeStats.retraces == 0 ? 0.0 : (double)treeStats.retraceLength / treeStats.retraces)
+		<< " maxHeight=" << treeStats.maxHeight
+		<< " liveBytes=" << treeStats.liveBytes << '\n';
+	out.unsetf(std::ios::floatfield);
+}
+
+void dump_pool_stats(std::ostream& out, const char* name, const PoolStats& poolStats) {
+	out << std::left << std::setw(24) << name << std::right
+		<< " live=" << poolStats.liveObjects
+		<< " capacity=" << poolStats.capacity
+		<< " heapAllocations=" << poolStats.heapAllocations << '\n';
+}
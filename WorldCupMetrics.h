@@ -0,0 +1,138 @@
+#ifndef WORLDCUP_METRICS_H_
+#define WORLDCUP_METRICS_H_
+
+#include "wet1util.h"
+#include "AVLTree.h"
+#include "ObjectPool.h"
+
+#include <chrono>
+#include <ostream>
+
+// Per API call counters and latency histograms of world_cup_t.
+// Recording is compiled in only when WORLDCUP_METRICS is defined, otherwise
+// the public APIs call their implementation directly and world_cup_t holds no
+// stats of its own (get_stats() returns an empty instance).
+
+#define METRICS_NUM_STATUS_TYPES 4
+// Bucket b counts latencies in [2^b, 2^(b+1)) nanoseconds (bucket 0 also holds 0ns)
+#define METRICS_HISTOGRAM_BUCKETS 40
+
+enum struct WorldCupOp {
+	ADD_TEAM = 0,
+	REMOVE_TEAM,
+	ADD_PLAYER,
+	REMOVE_PLAYER,
+	UPDATE_PLAYER_STATS,
+	PLAY_MATCH,
+	GET_NUM_PLAYED_GAMES,
+	GET_TEAM_POINTS,
+	UNITE_TEAMS,
+	GET_TOP_SCORER,
+	GET_ALL_PLAYERS_COUNT,
+	GET_ALL_PLAYERS,
+	GET_CLOSEST_PLAYER,
+	KNOCKOUT_WINNER,
+	GET_SCORERS_PAGE,
+	GET_TOP_SCORERS,
+	PLAY_MATCHES,
+	GET_NUM_PLAYED_GAMES_BATCH,
+	GET_TEAM_POINTS_BATCH,
+	GET_TEAMS_BY_POINTS,
+	GET_TEAMS_BY_STRENGTH,
+	GET_TEAM_POINTS_RANK,
+	GET_TEAM_STRENGTH_RANK,
+	NUM_OPS
+};
+
+#define WORLDCUP_NUM_OPS (static_cast<int>(WorldCupOp::NUM_OPS))
+
+struct OpStats {
+	unsigned long long calls;
+	unsigned long long statusCounts[METRICS_NUM_STATUS_TYPES];  // Indexed by StatusType
+	unsigned long long totalNs;
+	unsigned long long maxNs;
+	unsigned long long latencyHistogram[METRICS_HISTOGRAM_BUCKETS];
+
+	// Upper bound of the bucket holding the given fraction of the calls
+	unsigned long long percentile_ns(double fraction) const;
+};
+
+struct WorldCupStats {
+	bool enabled;
+	OpStats ops[WORLDCUP_NUM_OPS];
+
+	WorldCupStats();
+	void reset();
+
+	void record(WorldCupOp op, StatusType status, unsigned long long elapsedNs) {
+		OpStats& opStats = ops[static_cast<int>(op)];
+		opStats.calls++;
+		opStats.statusCounts[static_cast<int>(status)]++;
+		opStats.totalNs += elapsedNs;
+		if (elapsedNs > opStats.maxNs) {
+			opStats.maxNs = elapsedNs;
+		}
+		opStats.latencyHistogram[latency_bucket(elapsedNs)]++;
+	}
+
+	// Writes a table of all APIs that were called, followed by their histograms
+	void dump(std::ostream& out) const;
+
+	static const char* op_name(WorldCupOp op);
+
+	static int latency_bucket(unsigned long long elapsedNs) {
+		int bucket = 0;
+		while (elapsedNs > 1 && bucket < METRICS_HISTOGRAM_BUCKETS - 1) {
+			elapsedNs >>= 1;
+			bucket++;
+		}
+		return bucket;
+	}
+};
+
+#ifdef WORLDCUP_METRICS
+
+// Measures a single API call from its construction until done() is handed the result
+class OpTimer {
+	WorldCupStats& stats;
+	WorldCupOp op;
+	std::chrono::steady_clock::time_point start;
+
+	unsigned long long elapsed_ns() const {
+		return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+
+public:
+	OpTimer(WorldCupStats& stats, WorldCupOp op) : stats(stats), op(op), start(std::chrono::steady_clock::now()) {}
+
+	StatusType done(StatusType status) {
+		stats.record(op, status, elapsed_ns());
+		return status;
+	}
+
+	output_t<int> done(output_t<int> result) {
+		stats.record(op, result.status(), elapsed_ns());
+		return result;
+	}
+};
+
+#define WORLDCUP_MEASURED(stats, op, call) \
+	do { OpTimer opTimer(stats, WorldCupOp::op); return opTimer.done(call); } while (0)
+
+#else
+
+#define WORLDCUP_MEASURED(stats, op, call) return call
+
+#endif // WORLDCUP_METRICS
+
+// Adds the counters of a tree to a running total (maxHeight keeps the largest)
+void add_tree_stats(TreeStats& total, const TreeStats& treeStats);
+
+// Writes one line with the counters of a tree (or of a group of trees)
+void dump_tree_stats(std::ostream& out, const char* name, int numTrees, const TreeStats& treeStats);
+
+// Writes one line with the counters of an object pool
+void dump_pool_stats(std::ostream& out, const char* name, const PoolStats& poolStats);
+
+#endif // WORLDCUP_METRICS_H_
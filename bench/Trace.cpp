@@ -0,0 +1,207 @@
+#include "Trace.h"
+
+#include <cstring>
+#include <cstdlib>
+
+static const char* const OP_NAMES[TRACE_NUM_OPS] = {
+	"add_team",
+	"remove_team",
+	"add_player",
+	"remove_player",
+	"update_player_stats",
+	"play_match",
+	"get_num_played_games",
+	"get_team_points",
+	"unite_teams",
+	"get_top_scorer",
+	"get_all_players_count",
+	"get_all_players",
+	"get_closest_player",
+	"knockout_winner"
+};
+
+static const int OP_ARITIES[TRACE_NUM_OPS] = {
+	2, // add_team
+	1, // remove_team
+	6, // add_player
+	1, // remove_player
+	4, // update_player_stats
+	2, // play_match
+	1, // get_num_played_games
+	1, // get_team_points
+	3, // unite_teams
+	1, // get_top_scorer
+	1, // get_all_players_count
+	1, // get_all_players
+	2, // get_closest_player
+	2  // knockout_winner
+};
+
+// Size of a single binary record: opcode, padding and arguments
+#define TRACE_RECORD_SIZE (4 + 4 * TRACE_MAX_ARGS)
+
+const char* trace_op_name(TraceOp op) {
+	return OP_NAMES[static_cast<int>(op)];
+}
+
+int trace_op_arity(TraceOp op) {
+	return OP_ARITIES[static_cast<int>(op)];
+}
+
+bool trace_op_from_name(const char* name, TraceOp* op) {
+	for (int opIdx = 0; opIdx < TRACE_NUM_OPS; opIdx++) {
+		if (strcmp(name, OP_NAMES[opIdx]) == 0) {
+			*op = static_cast<TraceOp>(opIdx);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void put_int32(unsigned char* buffer, int value) {
+	unsigned int bits = static_cast<unsigned int>(value);
+	buffer[0] = static_cast<unsigned char>(bits);
+	buffer[1] = static_cast<unsigned char>(bits >> 8);
+	buffer[2] = static_cast<unsigned char>(bits >> 16);
+	buffer[3] = static_cast<unsigned char>(bits >> 24);
+}
+
+static int get_int32(const unsigned char* buffer) {
+	unsigned int bits = static_cast<unsigned int>(buffer[0])
+		| (static_cast<unsigned int>(buffer[1]) << 8)
+		| (static_cast<unsigned int>(buffer[2]) << 16)
+		| (static_cast<unsigned int>(buffer[3]) << 24);
+	return static_cast<int>(bits);
+}
+
+static bool read_binary_trace(FILE* in, const char* path, std::vector<TraceCommand>& commands) {
+	unsigned char header[12];
+	if (fread(header, 1, sizeof(header), in) != sizeof(header)) {
+		fprintf(stderr, "%s: truncated binary header\n", path);
+		return false;
+	}
+	int version = get_int32(header);
+	if (version != TRACE_BINARY_VERSION) {
+		fprintf(stderr, "%s: unsupported binary trace version %d\n", path, version);
+		return false;
+	}
+	unsigned long long numCommands = static_cast<unsigned int>(get_int32(header + 4))
+		| (static_cast<unsigned long long>(static_cast<unsigned int>(get_int32(header + 8))) << 32);
+	commands.reserve(commands.size() + numCommands);
+
+	unsigned char record[TRACE_RECORD_SIZE];
+	for (unsigned long long commandIdx = 0; commandIdx < numCommands; commandIdx++) {
+		if (fread(record, 1, sizeof(record), in) != sizeof(record)) {
+			fprintf(stderr, "%s: truncated after %llu of %llu commands\n", path, commandIdx, numCommands);
+			return false;
+		}
+		if (record[0] >= TRACE_NUM_OPS) {
+			fprintf(stderr, "%s: bad opcode %d in command %llu\n", path, record[0], commandIdx);
+			return false;
+		}
+		TraceCommand command;
+		command.op = static_cast<TraceOp>(record[0]);
+		for (int argIdx = 0; argIdx < TRACE_MAX_ARGS; argIdx++) {
+			command.args[argIdx] = get_int32(record + 4 + 4 * argIdx);
+		}
+		commands.push_back(command);
+	}
+	return true;
+}
+
+static bool read_text_trace(FILE* in, const char* path, std::vector<TraceCommand>& commands) {
+	char line[512];
+	int lineNum = 0;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		lineNum++;
+		char* cursor = line;
+		while (*cursor == ' ' || *cursor == '\t') {
+			cursor++;
+		}
+		if (*cursor == '#' || *cursor == '\n' || *cursor == '\r' || *cursor == '\0') {
+			continue;
+		}
+
+		// Split the API name from its arguments
+		char* nameEnd = cursor;
+		while (*nameEnd != '\0' && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\n' && *nameEnd != '\r') {
+			nameEnd++;
+		}
+		char savedChar = *nameEnd;
+		*nameEnd = '\0';
+		TraceCommand command;
+		if (!trace_op_from_name(cursor, &command.op)) {
+			fprintf(stderr, "%s:%d: unknown command '%s'\n", path, lineNum, cursor);
+			return false;
+		}
+		*nameEnd = savedChar;
+		cursor = nameEnd;
+
+		int arity = trace_op_arity(command.op);
+		for (int argIdx = 0; argIdx < TRACE_MAX_ARGS; argIdx++) {
+			command.args[argIdx] = 0;
+			if (argIdx >= arity) {
+				continue;
+			}
+			char* argEnd;
+			long value = strtol(cursor, &argEnd, 10);
+			if (argEnd == cursor) {
+				fprintf(stderr, "%s:%d: %s expects %d arguments\n", path, lineNum, trace_op_name(command.op), arity);
+				return false;
+			}
+			command.args[argIdx] = static_cast<int>(value);
+			cursor = argEnd;
+		}
+		commands.push_back(command);
+	}
+	return true;
+}
+
+bool read_trace(const char* path, std::vector<TraceCommand>& commands) {
+	FILE* in = fopen(path, "rb");
+	if (in == NULL) {
+		fprintf(stderr, "%s: cannot open trace\n", path);
+		return false;
+	}
+	char magic[4];
+	bool isBinary = fread(magic, 1, sizeof(magic), in) == sizeof(magic)
+		&& memcmp(magic, TRACE_BINARY_MAGIC, sizeof(magic)) == 0;
+	bool result;
+	if (isBinary) {
+		result = read_binary_trace(in, path, commands);
+	}
+	else {
+		rewind(in);
+		result = read_text_trace(in, path, commands);
+	}
+	fclose(in);
+	return result;
+}
+
+void write_trace_text_command(FILE* out, const TraceCommand& command) {
+	fputs(trace_op_name(command.op), out);
+	int arity = trace_op_arity(command.op);
+	for (int argIdx = 0; argIdx < arity; argIdx++) {
+		fprintf(out, " %d", command.args[argIdx]);
+	}
+	fputc('\n', out);
+}
+
+void write_trace_binary_header(FILE* out, unsigned long long numCommands) {
+	unsigned char header[16];
+	memcpy(header, TRACE_BINARY_MAGIC, 4);
+	put_int32(header + 4, TRACE_BINARY_VERSION);
+	put_int32(header + 8, static_cast<int>(numCommands & 0xFFFFFFFFULL));
+	put_int32(header + 12, static_cast<int>(numCommands >> 32));
+	fwrite(header, 1, sizeof(header), out);
+}
+
+void write_trace_binary_command(FILE* out, const TraceCommand& command) {
+	unsigned char record[TRACE_RECORD_SIZE];
+	memset(record, 0, sizeof(record));
+	record[0] = static_cast<unsigned char>(command.op);
+	for (int argIdx = 0; argIdx < TRACE_MAX_ARGS; argIdx++) {
+		put_int32(record + 4 + 4 * argIdx, command.args[argIdx]);
+	}
+	fwrite(record, 1, sizeof(record), out);
+}
@@ -0,0 +1,68 @@
+#ifndef WET1_BENCH_TRACE_H_
+#define WET1_BENCH_TRACE_H_
+
+#include <cstdio>
+#include <vector>
+
+// A command trace is a sequence of world_cup_t API calls.
+//
+// Text traces hold one command per line, using the API name followed by its
+// integer arguments (boolean arguments are written as 0/1), e.g.
+//     add_team 1 0
+//     add_player 7 1 3 2 0 1
+//     knockout_winner 1 100
+// Empty lines and lines starting with '#' are ignored.
+//
+// Binary traces start with TRACE_BINARY_MAGIC, a 32-bit version and a 64-bit
+// command count, followed by fixed size records (1 byte opcode, 3 bytes
+// padding and TRACE_MAX_ARGS 32-bit arguments, little endian).
+
+#define TRACE_MAX_ARGS 6
+#define TRACE_BINARY_MAGIC "WCTR"
+#define TRACE_BINARY_VERSION 1
+
+enum struct TraceOp {
+	ADD_TEAM = 0,
+	REMOVE_TEAM,
+	ADD_PLAYER,
+	REMOVE_PLAYER,
+	UPDATE_PLAYER_STATS,
+	PLAY_MATCH,
+	GET_NUM_PLAYED_GAMES,
+	GET_TEAM_POINTS,
+	UNITE_TEAMS,
+	GET_TOP_SCORER,
+	GET_ALL_PLAYERS_COUNT,
+	GET_ALL_PLAYERS,
+	GET_CLOSEST_PLAYER,
+	KNOCKOUT_WINNER,
+	NUM_OPS
+};
+
+#define TRACE_NUM_OPS (static_cast<int>(TraceOp::NUM_OPS))
+
+struct TraceCommand {
+	TraceOp op;
+	int args[TRACE_MAX_ARGS];
+};
+
+// Name of the API an opcode stands for (as written in text traces)
+const char* trace_op_name(TraceOp op);
+
+// Number of integer arguments the API takes
+int trace_op_arity(TraceOp op);
+
+// Parses an API name, returns false if it is unknown
+bool trace_op_from_name(const char* name, TraceOp* op);
+
+// Reads a text or binary trace (detected by the magic), appending to commands.
+// Returns false and prints the reason to stderr on malformed input.
+bool read_trace(const char* path, std::vector<TraceCommand>& commands);
+
+// Trace writers, used by the generator. Binary writers need the total number
+// of commands up front since it is stored in the header.
+void write_trace_text_command(FILE* out, const TraceCommand& command);
+void write_trace_binary_header(FILE* out, unsigned long long numCommands);
+void write_trace_binary_command(FILE* out, const TraceCommand& command);
+
+#endif // WET1_BENCH_TRACE_H_
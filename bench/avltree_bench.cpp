@@ -0,0 +1,748 @@
+// Microbenchmarks of AvlTree against std::map / std::set baselines.
+//
+// Every operation is measured for int keys (AvlTree<int, int>) and Player keys
+// (AvlTree<Player, Player*>, the ranking trees of world_cup_t), with keys
+// inserted in sequential, random and adversarial (zig-zag, alternating between
+// the smallest and largest remaining key) order, for sizes growing by 10x up
+// to --max-size. Results are in nanoseconds per element. The find_many row
+// runs the lookups of the find row as one interleaved batch, it has no
+// baselines. The insert_near_last row compares finger search inserts with
+// the std containers' inserts hinted at end().
+//
+// Rows starting with "p." measure PersistentAvlTree in the AvlTree
+// column: plain inserts, inserts while a snapshot of the previous version is
+// alive (every insert path copies) and taking a snapshot, against copying the
+// std containers. Rows starting with "c." measure CompactAvlTree (index
+// linked nodes in one vector) the same way; bench/memory_bench.cpp compares
+// the memory of both layouts. Rows starting with "a." and "w." measure AvlTree
+// with AvlBalance and WavlBalance on the update mix of the score trees: every
+// key is removed and inserted again a little larger, as update_player_stats
+// does.
+//
+// Build from the repository root (wet1util.h must be on the include path):
+//     g++ -std=c++11 -O2 -DNDEBUG -I. bench/avltree_bench.cpp Team.cpp TeamGroup.cpp Player.cpp ThreadPool.cpp -pthread -o avltree_bench
+//
+// Usage: avltree_bench [--max-size N] [--min-size N] [--keys int|player|all] [--seed N]
+
+#include "../AVLTree.h"
+#include "../CompactAvlTree.h"
+#include "../PersistentAvlTree.h"
+#include "../Player.h"
+#include "../Team.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+enum struct KeyOrder {
+	SEQUENTIAL,
+	RANDOM,
+	ADVERSARIAL
+};
+
+static const char* order_name(KeyOrder order) {
+	switch (order) {
+	case KeyOrder::SEQUENTIAL:
+		return "sequential";
+	case KeyOrder::RANDOM:
+		return "random";
+	default:
+		return "adversarial";
+	}
+}
+
+// Consumes results so the compiler cannot drop the measured work
+static volatile long long benchSink = 0;
+
+static double now_seconds() {
+	return std::chrono::duration_cast<std::chrono::duration<double> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void print_row(const char* keyName, KeyOrder order, int n, const char* opName, double avlNs, double mapNs, double setNs) {
+	printf("%-7s %-12s %9d %-16s %10.1f %10.1f %10.1f %8.2fx\n",
+		keyName, order_name(order), n, opName, avlNs, mapNs, setNs, mapNs > 0 ? avlNs / mapNs : 0.0);
+	fflush(stdout);
+}
+
+// Key traits: keys are generated from ranks, a larger rank gives a larger key.
+// Trees hold the even ranks so odd ranks can be used to query missing keys.
+template <class KeyType, class ValueType>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int, int> {
+	static const char* name() {
+		return "int";
+	}
+	static int make_key(int rank) {
+		return rank;
+	}
+	static int make_value(int rank) {
+		return rank;
+	}
+	static int key_rank(const int& key) {
+		return key;
+	}
+	static int compare(int* key1, int* key2, int* refKey) {
+		int diff1 = abs(*key1 - *refKey);
+		int diff2 = abs(*key2 - *refKey);
+		if (diff1 != diff2) {
+			return diff1 < diff2 ? 1 : -1;
+		}
+		return *key1 > *key2 ? 1 : -1;
+	}
+};
+
+// Player keys need a team for their games played bookkeeping
+static Team benchTeam(1, 0);
+
+template <>
+struct KeyTraits<Player, Player*> {
+	static const char* name() {
+		return "Player";
+	}
+	// Ranks map to (goals, cards, id) so that the key order follows the rank
+	static Player make_key(int rank) {
+		return Player(rank + 1, 1, rank / 4, 3 - rank % 4, false, &benchTeam);
+	}
+	static Player* make_value(int rank) {
+		return reinterpret_cast<Player*>(static_cast<size_t>(rank + 1) * 8);
+	}
+	static int key_rank(const Player& key) {
+		return key.get_player_id() - 1;
+	}
+	static int compare(Player* key1, Player* key2, Player* refKey) {
+		int diff1 = abs(key_rank(*key1) - key_rank(*refKey));
+		int diff2 = abs(key_rank(*key2) - key_rank(*refKey));
+		if (diff1 != diff2) {
+			return diff1 < diff2 ? 1 : -1;
+		}
+		return key_rank(*key1) > key_rank(*key2) ? 1 : -1;
+	}
+};
+
+template <class ValueType>
+static bool accept_all(ValueType value) {
+	(void)value;
+	return true;
+}
+
+// Ranks of the keys held by the trees (even numbers) in insertion order
+static std::vector<int> make_ranks(int n, KeyOrder order, std::mt19937_64& random) {
+	std::vector<int> ranks(n);
+	if (order == KeyOrder::ADVERSARIAL) {
+		int low = 0;
+		int high = n - 1;
+		for (int rankIdx = 0; rankIdx < n; rankIdx++) {
+			ranks[rankIdx] = 2 * ((rankIdx % 2 == 0) ? low++ : high--);
+		}
+		return ranks;
+	}
+	for (int rankIdx = 0; rankIdx < n; rankIdx++) {
+		ranks[rankIdx] = 2 * rankIdx;
+	}
+	if (order == KeyOrder::RANDOM) {
+		std::shuffle(ranks.begin(), ranks.end(), random);
+	}
+	return ranks;
+}
+
+template <class KeyType, class ValueType>
+static void run_persistent_benchmarks(int n, KeyOrder order, const std::vector<KeyType>& keys, const std::vector<ValueType>& values) {
+	typedef KeyTraits<KeyType, ValueType> Traits;
+	typedef std::map<KeyType, ValueType> Map;
+	typedef std::set<KeyType> Set;
+	const char* keyName = Traits::name();
+	double start;
+	double treeSeconds;
+	double mapSeconds;
+	double setSeconds;
+
+	// insert, without snapshots every node is owned by the tree alone and updated in place
+	PersistentAvlTree<KeyType, ValueType>* tree = new PersistentAvlTree<KeyType, ValueType>();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		tree->insert(keys[keyIdx], values[keyIdx]);
+	}
+	treeSeconds = now_seconds() - start;
+	Map* map = new Map();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		map->insert(std::make_pair(keys[keyIdx], values[keyIdx]));
+	}
+	mapSeconds = now_seconds() - start;
+	Set* set = new Set();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		set->insert(keys[keyIdx]);
+	}
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "p.insert", treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// snapshot, against a full copy of the std containers
+	start = now_seconds();
+	PersistentAvlTree<KeyType, ValueType>* snapshot = new PersistentAvlTree<KeyType, ValueType>(tree->snapshot());
+	treeSeconds = now_seconds() - start;
+	start = now_seconds();
+	Map* mapCopy = new Map(*map);
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	Set* setCopy = new Set(*set);
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "p.snapshot", treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+	delete snapshot;
+	delete mapCopy;
+	delete setCopy;
+	delete tree;
+
+	// insert while the previous version is kept alive, every insert copies its search path
+	tree = new PersistentAvlTree<KeyType, ValueType>();
+	start = now_seconds();
+	{
+		PersistentAvlTree<KeyType, ValueType> previous;
+		for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+			previous = *tree;
+			tree->insert(keys[keyIdx], values[keyIdx]);
+		}
+	}
+	treeSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "p.insert+snap", treeSeconds * 1e9 / n, 0.0, 0.0);
+	delete tree;
+	delete map;
+	delete set;
+}
+
+// CompactAvlTree in the AvlTree column, against the same std containers
+template <class KeyType, class ValueType>
+static void run_compact_benchmarks(int n, KeyOrder order, const std::vector<KeyType>& keys, const std::vector<ValueType>& values, const std::vector<int>& lookupOrder) {
+	typedef KeyTraits<KeyType, ValueType> Traits;
+	typedef std::map<KeyType, ValueType> Map;
+	typedef std::set<KeyType> Set;
+	const char* keyName = Traits::name();
+	double start;
+	double treeSeconds;
+	double mapSeconds;
+	double setSeconds;
+
+	CompactAvlTree<KeyType, ValueType>* tree = new CompactAvlTree<KeyType, ValueType>();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		tree->insert(keys[keyIdx], values[keyIdx]);
+	}
+	treeSeconds = now_seconds() - start;
+	Map* map = new Map();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		map->insert(std::make_pair(keys[keyIdx], values[keyIdx]));
+	}
+	mapSeconds = now_seconds() - start;
+	Set* set = new Set();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		set->insert(keys[keyIdx]);
+	}
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "c.insert", treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// find, hits in random order
+	long long found = 0;
+	ValueType value;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += tree->find(keys[lookupOrder[lookupIdx]], &value) == TreeStatusType::TREE_SUCCESS;
+	}
+	treeSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += map->find(keys[lookupOrder[lookupIdx]]) != map->end();
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += set->find(keys[lookupOrder[lookupIdx]]) != set->end();
+	}
+	setSeconds = now_seconds() - start;
+	benchSink += found;
+	print_row(keyName, order, n, "c.find", treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// remove, in random order
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		tree->remove(keys[lookupOrder[lookupIdx]]);
+	}
+	treeSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		map->erase(keys[lookupOrder[lookupIdx]]);
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		set->erase(keys[lookupOrder[lookupIdx]]);
+	}
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "c.remove", treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+	delete tree;
+	delete map;
+	delete set;
+}
+
+// AvlTree with the given balance policy in the AvlTree column, against the same std containers
+template <class KeyType, class ValueType, class BalancePolicy>
+static void run_balance_benchmarks(int n, KeyOrder order, const std::vector<KeyType>& keys, const std::vector<ValueType>& values, const std::vector<int>& lookupOrder, const char* rowPrefix) {
+	typedef KeyTraits<KeyType, ValueType> Traits;
+	typedef std::map<KeyType, ValueType> Map;
+	typedef std::set<KeyType> Set;
+	const char* keyName = Traits::name();
+	char rowName[32];
+	double start;
+	double treeSeconds;
+	double mapSeconds;
+	double setSeconds;
+
+	AvlTree<KeyType, ValueType, BalancePolicy>* tree = new AvlTree<KeyType, ValueType, BalancePolicy>();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		tree->insert(keys[keyIdx], values[keyIdx]);
+	}
+	treeSeconds = now_seconds() - start;
+	Map* map = new Map();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		map->insert(std::make_pair(keys[keyIdx], values[keyIdx]));
+	}
+	mapSeconds = now_seconds() - start;
+	Set* set = new Set();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		set->insert(keys[keyIdx]);
+	}
+	setSeconds = now_seconds() - start;
+	snprintf(rowName, sizeof(rowName), "%sinsert", rowPrefix);
+	print_row(keyName, order, n, rowName, treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// update, in random order each key moves to the next (odd, missing) rank
+	std::vector<KeyType> updatedKeys;
+	updatedKeys.reserve(n);
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		updatedKeys.push_back(Traits::make_key(Traits::key_rank(keys[keyIdx]) + 1));
+	}
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		int keyIdx = lookupOrder[lookupIdx];
+		tree->remove(keys[keyIdx]);
+		tree->insert(updatedKeys[keyIdx], values[keyIdx]);
+	}
+	treeSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		int keyIdx = lookupOrder[lookupIdx];
+		map->erase(keys[keyIdx]);
+		map->insert(std::make_pair(updatedKeys[keyIdx], values[keyIdx]));
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		int keyIdx = lookupOrder[lookupIdx];
+		set->erase(keys[keyIdx]);
+		set->insert(updatedKeys[keyIdx]);
+	}
+	setSeconds = now_seconds() - start;
+	snprintf(rowName, sizeof(rowName), "%supdate", rowPrefix);
+	print_row(keyName, order, n, rowName, treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// find, hits in random order
+	long long found = 0;
+	ValueType value;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += tree->find(updatedKeys[lookupOrder[lookupIdx]], &value) == TreeStatusType::TREE_SUCCESS;
+	}
+	treeSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += map->find(updatedKeys[lookupOrder[lookupIdx]]) != map->end();
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += set->find(updatedKeys[lookupOrder[lookupIdx]]) != set->end();
+	}
+	setSeconds = now_seconds() - start;
+	benchSink += found;
+	snprintf(rowName, sizeof(rowName), "%sfind", rowPrefix);
+	print_row(keyName, order, n, rowName, treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// remove, in random order
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		tree->remove(updatedKeys[lookupOrder[lookupIdx]]);
+	}
+	treeSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		map->erase(updatedKeys[lookupOrder[lookupIdx]]);
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		set->erase(updatedKeys[lookupOrder[lookupIdx]]);
+	}
+	setSeconds = now_seconds() - start;
+	snprintf(rowName, sizeof(rowName), "%sremove", rowPrefix);
+	print_row(keyName, order, n, rowName, treeSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+	delete tree;
+	delete map;
+	delete set;
+}
+
+template <class KeyType, class ValueType>
+static void run_benchmarks(int n, KeyOrder order, std::mt19937_64& random) {
+	typedef KeyTraits<KeyType, ValueType> Traits;
+	typedef std::map<KeyType, ValueType> Map;
+	typedef std::set<KeyType> Set;
+	const char* keyName = Traits::name();
+
+	std::vector<int> ranks = make_ranks(n, order, random);
+	std::vector<KeyType> keys;
+	std::vector<ValueType> values;
+	keys.reserve(n);
+	values.reserve(n);
+	for (int rankIdx = 0; rankIdx < n; rankIdx++) {
+		keys.push_back(Traits::make_key(ranks[rankIdx]));
+		values.push_back(Traits::make_value(ranks[rankIdx]));
+	}
+	std::vector<int> lookupOrder(n);
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		lookupOrder[lookupIdx] = lookupIdx;
+	}
+	std::shuffle(lookupOrder.begin(), lookupOrder.end(), random);
+
+	AvlTree<KeyType, ValueType>* tree = new AvlTree<KeyType, ValueType>();
+	Map* map = new Map();
+	Set* set = new Set();
+	double start;
+	double avlSeconds;
+	double mapSeconds;
+	double setSeconds;
+
+	// insert
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		tree->insert(keys[keyIdx], values[keyIdx]);
+	}
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		map->insert(std::make_pair(keys[keyIdx], values[keyIdx]));
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		set->insert(keys[keyIdx]);
+	}
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "insert", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// insert_near_last, against the std containers hinted at their end
+	{
+		AvlTree<KeyType, ValueType>* hintedTree = new AvlTree<KeyType, ValueType>();
+		Map* hintedMap = new Map();
+		Set* hintedSet = new Set();
+		start = now_seconds();
+		for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+			hintedTree->insert_near_last(keys[keyIdx], values[keyIdx]);
+		}
+		avlSeconds = now_seconds() - start;
+		start = now_seconds();
+		for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+			hintedMap->insert(hintedMap->end(), std::make_pair(keys[keyIdx], values[keyIdx]));
+		}
+		mapSeconds = now_seconds() - start;
+		start = now_seconds();
+		for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+			hintedSet->insert(hintedSet->end(), keys[keyIdx]);
+		}
+		setSeconds = now_seconds() - start;
+		print_row(keyName, order, n, "insert_near_last", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+		delete hintedTree;
+		delete hintedMap;
+		delete hintedSet;
+	}
+
+	// find, hits in random order
+	long long found = 0;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		ValueType value;
+		found += tree->find(keys[lookupOrder[lookupIdx]], &value) == TreeStatusType::TREE_SUCCESS;
+	}
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += map->find(keys[lookupOrder[lookupIdx]]) != map->end();
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += set->find(keys[lookupOrder[lookupIdx]]) != set->end();
+	}
+	setSeconds = now_seconds() - start;
+	benchSink += found;
+	print_row(keyName, order, n, "find", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// find_many, the same hits as one batch (the baselines have no batched lookup)
+	std::vector<KeyType> lookupKeys;
+	lookupKeys.reserve(n);
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		lookupKeys.push_back(keys[lookupOrder[lookupIdx]]);
+	}
+	std::vector<ValueType> foundValues(n);
+	std::vector<TreeStatusType> findResults(n);
+	start = now_seconds();
+	tree->find_many(&lookupKeys[0], n, &foundValues[0], &findResults[0]);
+	avlSeconds = now_seconds() - start;
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		found += findResults[lookupIdx] == TreeStatusType::TREE_SUCCESS;
+	}
+	benchSink += found;
+	print_row(keyName, order, n, "find_many", avlSeconds * 1e9 / n, 0, 0);
+
+	// find_max
+	long long maxRanks = 0;
+	start = now_seconds();
+	for (int repeatIdx = 0; repeatIdx < n; repeatIdx++) {
+		maxRanks += Traits::key_rank(*tree->find_max());
+	}
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int repeatIdx = 0; repeatIdx < n; repeatIdx++) {
+		maxRanks += Traits::key_rank(map->rbegin()->first);
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int repeatIdx = 0; repeatIdx < n; repeatIdx++) {
+		maxRanks += Traits::key_rank(*set->rbegin());
+	}
+	setSeconds = now_seconds() - start;
+	benchSink += maxRanks;
+	print_row(keyName, order, n, "find_max", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// get_tree_values_ranged_in_order, ranges of ~1% of the keys
+	int numRanges = std::max(1, std::min(n, 1000));
+	int rangeWidth = std::max(10, n / 100);
+	std::vector<int> rangeStarts(numRanges);
+	for (int rangeIdx = 0; rangeIdx < numRanges; rangeIdx++) {
+		rangeStarts[rangeIdx] = static_cast<int>(random() % (2 * n));
+	}
+	long long rangedValues = 0;
+	start = now_seconds();
+	for (int rangeIdx = 0; rangeIdx < numRanges; rangeIdx++) {
+		int counter = 0;
+		ValueType* ranged = tree->get_tree_values_ranged_in_order(&counter,
+			Traits::make_key(rangeStarts[rangeIdx]), Traits::make_key(rangeStarts[rangeIdx] + 2 * rangeWidth), accept_all<ValueType>);
+		rangedValues += counter;
+		delete[] ranged;
+	}
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int rangeIdx = 0; rangeIdx < numRanges; rangeIdx++) {
+		std::vector<ValueType> ranged;
+		typename Map::iterator end = map->upper_bound(Traits::make_key(rangeStarts[rangeIdx] + 2 * rangeWidth));
+		for (typename Map::iterator it = map->lower_bound(Traits::make_key(rangeStarts[rangeIdx])); it != end; ++it) {
+			ranged.push_back(it->second);
+		}
+		rangedValues += ranged.size();
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int rangeIdx = 0; rangeIdx < numRanges; rangeIdx++) {
+		std::vector<KeyType> ranged;
+		typename Set::iterator end = set->upper_bound(Traits::make_key(rangeStarts[rangeIdx] + 2 * rangeWidth));
+		for (typename Set::iterator it = set->lower_bound(Traits::make_key(rangeStarts[rangeIdx])); it != end; ++it) {
+			ranged.push_back(*it);
+		}
+		rangedValues += ranged.size();
+	}
+	setSeconds = now_seconds() - start;
+	benchSink += rangedValues;
+	print_row(keyName, order, n, "ranged(per key)", avlSeconds * 1e9 / (numRanges * (double)rangeWidth),
+		mapSeconds * 1e9 / (numRanges * (double)rangeWidth), setSeconds * 1e9 / (numRanges * (double)rangeWidth));
+
+	// find_closest_key, queries of missing (odd rank) keys
+	std::vector<KeyType> queries;
+	queries.reserve(n);
+	for (int queryIdx = 0; queryIdx < n; queryIdx++) {
+		queries.push_back(Traits::make_key(2 * static_cast<int>(random() % n) + 1));
+	}
+	long long closestRanks = 0;
+	start = now_seconds();
+	for (int queryIdx = 0; queryIdx < n; queryIdx++) {
+		closestRanks += Traits::key_rank(*tree->find_closest_key(&queries[queryIdx], Traits::compare));
+	}
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int queryIdx = 0; queryIdx < n; queryIdx++) {
+		typename Map::iterator above = map->lower_bound(queries[queryIdx]);
+		KeyType* closest = above == map->end() ? NULL : const_cast<KeyType*>(&above->first);
+		if (above != map->begin()) {
+			--above;
+			KeyType* below = const_cast<KeyType*>(&above->first);
+			if (closest == NULL || Traits::compare(below, closest, &queries[queryIdx]) > 0) {
+				closest = below;
+			}
+		}
+		closestRanks += Traits::key_rank(*closest);
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int queryIdx = 0; queryIdx < n; queryIdx++) {
+		typename Set::iterator above = set->lower_bound(queries[queryIdx]);
+		KeyType* closest = above == set->end() ? NULL : const_cast<KeyType*>(&*above);
+		if (above != set->begin()) {
+			--above;
+			KeyType* below = const_cast<KeyType*>(&*above);
+			if (closest == NULL || Traits::compare(below, closest, &queries[queryIdx]) > 0) {
+				closest = below;
+			}
+		}
+		closestRanks += Traits::key_rank(*closest);
+	}
+	setSeconds = now_seconds() - start;
+	benchSink += closestRanks;
+	print_row(keyName, order, n, "find_closest_key", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	// copy constructor and assignment
+	start = now_seconds();
+	AvlTree<KeyType, ValueType>* treeCopy = new AvlTree<KeyType, ValueType>(*tree);
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	Map* mapCopy = new Map(*map);
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	Set* setCopy = new Set(*set);
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "copy", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+
+	start = now_seconds();
+	*treeCopy = *tree;
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	*mapCopy = *map;
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	*setCopy = *set;
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "assign", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+	delete treeCopy;
+	delete mapCopy;
+	delete setCopy;
+
+	run_persistent_benchmarks<KeyType, ValueType>(n, order, keys, values);
+	run_compact_benchmarks<KeyType, ValueType>(n, order, keys, values, lookupOrder);
+	run_balance_benchmarks<KeyType, ValueType, AvlBalance>(n, order, keys, values, lookupOrder, "a.");
+	run_balance_benchmarks<KeyType, ValueType, WavlBalance>(n, order, keys, values, lookupOrder, "w.");
+
+	// remove, in random order
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		tree->remove(keys[lookupOrder[lookupIdx]]);
+	}
+	avlSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		map->erase(keys[lookupOrder[lookupIdx]]);
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	for (int lookupIdx = 0; lookupIdx < n; lookupIdx++) {
+		set->erase(keys[lookupOrder[lookupIdx]]);
+	}
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "remove", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+	delete tree;
+	delete map;
+	delete set;
+
+	// create_tree_from_sorted_array (std containers get sorted input with an end hint)
+	std::vector<KeyType> sortedKeys;
+	std::vector<ValueType> sortedValues;
+	sortedKeys.reserve(n);
+	sortedValues.reserve(n);
+	for (int rankIdx = 0; rankIdx < n; rankIdx++) {
+		sortedKeys.push_back(Traits::make_key(2 * rankIdx));
+		sortedValues.push_back(Traits::make_value(2 * rankIdx));
+	}
+	tree = new AvlTree<KeyType, ValueType>();
+	start = now_seconds();
+	tree->create_tree_from_sorted_array(&sortedKeys[0], &sortedValues[0], n);
+	avlSeconds = now_seconds() - start;
+	map = new Map();
+	start = now_seconds();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		map->insert(map->end(), std::make_pair(sortedKeys[keyIdx], sortedValues[keyIdx]));
+	}
+	mapSeconds = now_seconds() - start;
+	start = now_seconds();
+	set = new Set(sortedKeys.begin(), sortedKeys.end());
+	setSeconds = now_seconds() - start;
+	print_row(keyName, order, n, "from_sorted", avlSeconds * 1e9 / n, mapSeconds * 1e9 / n, setSeconds * 1e9 / n);
+	delete tree;
+	delete map;
+	delete set;
+}
+
+int main(int argc, char** argv) {
+	long long maxSize = 1000000;
+	long long minSize = 1000;
+	const char* keys = "all";
+	unsigned long long seed = 1;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		bool hasValue = argIdx + 1 < argc;
+		if (strcmp(argv[argIdx], "--max-size") == 0 && hasValue) {
+			maxSize = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--min-size") == 0 && hasValue) {
+			minSize = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--keys") == 0 && hasValue) {
+			keys = argv[++argIdx];
+		}
+		else if (strcmp(argv[argIdx], "--seed") == 0 && hasValue) {
+			seed = static_cast<unsigned long long>(strtod(argv[++argIdx], NULL));
+		}
+		else {
+			fprintf(stderr, "usage: %s [--max-size N] [--min-size N] [--keys int|player|all] [--seed N]\n", argv[0]);
+			return 1;
+		}
+	}
+	// Ranks go up to 2 * size and must fit in an int
+	if (minSize < 1 || maxSize < minSize || maxSize > 100000000) {
+		fprintf(stderr, "sizes must satisfy 1 <= min-size <= max-size <= 1e8\n");
+		return 1;
+	}
+	bool intKeys = strcmp(keys, "int") == 0 || strcmp(keys, "all") == 0;
+	bool playerKeys = strcmp(keys, "player") == 0 || strcmp(keys, "all") == 0;
+
+	std::mt19937_64 random(seed);
+	printf("%-7s %-12s %9s %-16s %10s %10s %10s %9s\n", "keys", "order", "size", "operation", "AvlTree", "std::map", "std::set", "tree/map");
+	const KeyOrder orders[] = { KeyOrder::SEQUENTIAL, KeyOrder::RANDOM, KeyOrder::ADVERSARIAL };
+	for (long long n = minSize; n <= maxSize; n *= 10) {
+		for (int orderIdx = 0; orderIdx < 3; orderIdx++) {
+			if (intKeys) {
+				run_benchmarks<int, int>(static_cast<int>(n), orders[orderIdx], random);
+			}
+			if (playerKeys) {
+				run_benchmarks<Player, Player*>(static_cast<int>(n), orders[orderIdx], random);
+			}
+		}
+	}
+	return benchSink == 42 ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+// Throughput of ConcurrentAvlTree against an AvlTree behind one mutex.
+//
+// Both trees start with every other key of [0, 2 * size), so about half of
+// the inserts and removes succeed and the size stays stable. Every thread
+// then runs --ops random operations with the given share of finds, the rest
+// split evenly between inserts and removes, as the player trees see them when
+// stats are read while updates come in. Results are in million operations per
+// second over all threads.
+//
+// Build from the repository root (wet1util.h must be on the include path):
+//     g++ -std=c++11 -O2 -DNDEBUG -I. bench/concurrent_bench.cpp EpochReclaimer.cpp -pthread -o concurrent_bench
+//
+// Usage: concurrent_bench [--size N] [--ops N] [--max-threads N] [--seed N]
+
+#include "../AVLTree.h"
+#include "../ConcurrentAvlTree.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static double now_seconds() {
+	return std::chrono::duration_cast<std::chrono::duration<double> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The single writer AvlTree made safe for threads the simple way
+class LockedAvlTree {
+	AvlTree<int, int> tree;
+	mutable std::mutex lock;
+
+public:
+	TreeStatusType insert(int key, int value) {
+		std::lock_guard<std::mutex> treeGuard(lock);
+		return tree.insert(key, value);
+	}
+	TreeStatusType find(int key, int* value) const {
+		std::lock_guard<std::mutex> treeGuard(lock);
+		return tree.find(key, value);
+	}
+	TreeStatusType remove(int key) {
+		std::lock_guard<std::mutex> treeGuard(lock);
+		return tree.remove(key);
+	}
+};
+
+static volatile long long benchSink = 0;
+
+// Runs the mix on threadCount threads, returns million operations per second
+template <class Tree>
+static double run_mix(Tree* tree, int size, int ops, int threadCount, int findPercent, unsigned long long seed) {
+	std::vector<std::thread> threads;
+	std::vector<long long> found(threadCount, 0);
+	double start = now_seconds();
+	for (int threadIdx = 0; threadIdx < threadCount; threadIdx++) {
+		threads.push_back(std::thread([=, &found]() {
+			std::mt19937_64 random(seed + threadIdx);
+			long long hits = 0;
+			for (int opIdx = 0; opIdx < ops; opIdx++) {
+				unsigned long long draw = random();
+				int key = static_cast<int>((draw >> 8) % (2ULL * size));
+				int kind = static_cast<int>(draw % 100);
+				int value;
+				if (kind < findPercent) {
+					hits += tree->find(key, &value) == TreeStatusType::TREE_SUCCESS ? value : 0;
+				}
+				else if ((kind - findPercent) % 2 == 0) {
+					tree->insert(key, key);
+				}
+				else {
+					tree->remove(key);
+				}
+			}
+			found[threadIdx] = hits;
+		}));
+	}
+	for (int threadIdx = 0; threadIdx < threadCount; threadIdx++) {
+		threads[threadIdx].join();
+		benchSink += found[threadIdx];
+	}
+	double seconds = now_seconds() - start;
+	return static_cast<double>(ops) * threadCount / seconds / 1e6;
+}
+
+template <class Tree>
+static Tree* make_tree(int size) {
+	Tree* tree = new Tree();
+	for (int key = 0; key < 2 * size; key += 2) {
+		tree->insert(key, key);
+	}
+	return tree;
+}
+
+int main(int argc, char** argv) {
+	long long size = 100000;
+	long long ops = 1000000;
+	int maxThreads = static_cast<int>(std::thread::hardware_concurrency());
+	unsigned long long seed = 1;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		bool hasValue = argIdx + 1 < argc;
+		if (strcmp(argv[argIdx], "--size") == 0 && hasValue) {
+			size = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--ops") == 0 && hasValue) {
+			ops = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--max-threads") == 0 && hasValue) {
+			maxThreads = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--seed") == 0 && hasValue) {
+			seed = static_cast<unsigned long long>(strtod(argv[++argIdx], NULL));
+		}
+		else {
+			fprintf(stderr, "usage: %s [--size N] [--ops N] [--max-threads N] [--seed N]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (size < 1 || size > 100000000 || ops < 1 || ops > 1000000000) {
+		fprintf(stderr, "size and ops must be between 1 and 1e8 / 1e9\n");
+		return 1;
+	}
+	if (maxThreads < 1) {
+		maxThreads = 1;
+	}
+
+	const int findPercents[] = { 100, 90, 50 };
+	printf("%9s %6s %7s %12s %12s %9s\n", "size", "finds", "threads", "concurrent", "locked", "speedup");
+	for (int mixIdx = 0; mixIdx < 3; mixIdx++) {
+		for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+			ConcurrentAvlTree<int, int>* concurrentTree = make_tree<ConcurrentAvlTree<int, int> >(static_cast<int>(size));
+			double concurrentMops = run_mix(concurrentTree, static_cast<int>(size), static_cast<int>(ops), threadCount, findPercents[mixIdx], seed);
+			delete concurrentTree;
+			LockedAvlTree* lockedTree = make_tree<LockedAvlTree>(static_cast<int>(size));
+			double lockedMops = run_mix(lockedTree, static_cast<int>(size), static_cast<int>(ops), threadCount, findPercents[mixIdx], seed);
+			delete lockedTree;
+			printf("%9lld %5d%% %7d %12.2f %12.2f %8.2fx\n", size, findPercents[mixIdx], threadCount, concurrentMops, lockedMops,
+				concurrentMops / lockedMops);
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
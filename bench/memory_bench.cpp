@@ -0,0 +1,240 @@
+// Heap bytes per entry of the AvlTree node layout against CompactAvlTree and std::map.
+//
+// Global operator new / delete are replaced to count the bytes the program
+// asked for ("requested") and the bytes malloc really handed out, including
+// rounding and the chunk header ("allocated"). Each container is filled with
+// random keys and measured full, then again after half of its keys were
+// removed (CompactAvlTree keeps the removed nodes on its free list), and for
+// CompactAvlTree once more after shrink_to_fit().
+// The "stats" column is get_stats().liveBytes, the trees' own estimate.
+//
+// Build from the repository root (wet1util.h must be on the include path, glibc only):
+//     g++ -std=c++11 -O2 -DNDEBUG -I. bench/memory_bench.cpp Team.cpp TeamGroup.cpp Player.cpp ThreadPool.cpp -pthread -o memory_bench
+//
+// Usage: memory_bench [--max-size N] [--min-size N] [--seed N]
+
+#include "../AVLTree.h"
+#include "../CompactAvlTree.h"
+#include "../Player.h"
+#include "../Team.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <map>
+#include <new>
+#include <random>
+#include <vector>
+
+// Heap counters, updated by the replaced operator new / delete
+static long long requestedBytes = 0;
+static long long allocatedBytes = 0;
+
+// glibc puts a size_t header in front of every chunk
+static long long chunk_bytes(void* block) {
+	return static_cast<long long>(malloc_usable_size(block) + sizeof(size_t));
+}
+
+// Every block starts with the requested size, so delete can subtract it. The header keeps
+// the returned pointer aligned like malloc's.
+union BlockHeader {
+	size_t size;
+	max_align_t align;
+};
+
+// The user pointer <-> block conversions go through uintptr_t. Pointer arithmetic would let
+// GCC see the header read before operator new's result (-Warray-bounds) and free() of a
+// pointer that came from operator new (-Wmismatched-new-delete) once they are inlined.
+static void* user_pointer(BlockHeader* block) {
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader));
+}
+
+static BlockHeader* block_of(void* pointer) {
+	return reinterpret_cast<BlockHeader*>(reinterpret_cast<uintptr_t>(pointer) - sizeof(BlockHeader));
+}
+
+void* operator new(size_t size) {
+	BlockHeader* block = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+	if (block == NULL) {
+		throw std::bad_alloc();
+	}
+	block->size = size;
+	requestedBytes += static_cast<long long>(size);
+	allocatedBytes += chunk_bytes(block) - static_cast<long long>(sizeof(BlockHeader));
+	return user_pointer(block);
+}
+
+void operator delete(void* pointer) noexcept {
+	if (pointer == NULL) {
+		return;
+	}
+	BlockHeader* block = block_of(pointer);
+	requestedBytes -= static_cast<long long>(block->size);
+	allocatedBytes -= chunk_bytes(block) - static_cast<long long>(sizeof(BlockHeader));
+	free(block);
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept {
+	operator delete(pointer);
+}
+
+void operator delete(void* pointer, size_t size) noexcept {
+	(void)size;
+	operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t size) noexcept {
+	(void)size;
+	operator delete(pointer);
+}
+
+struct HeapSnapshot {
+	long long requested;
+	long long allocated;
+};
+
+static HeapSnapshot heap_now() {
+	HeapSnapshot snapshot = { requestedBytes, allocatedBytes };
+	return snapshot;
+}
+
+static void print_row(const char* keyName, int n, const char* layout, const char* state, int entries, HeapSnapshot before, long long statsBytes) {
+	HeapSnapshot after = heap_now();
+	double perEntry = entries > 0 ? 1.0 / entries : 0.0;
+	printf("%-7s %9d %-14s %-6s %10.1f %10.1f %10.1f\n", keyName, n, layout, state,
+		(after.requested - before.requested) * perEntry, (after.allocated - before.allocated) * perEntry, statsBytes * perEntry);
+	fflush(stdout);
+}
+
+// Player keys need a team for their games played bookkeeping
+static Team benchTeam(1, 0);
+
+template <class KeyType, class ValueType>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int, Player*> {
+	static const char* name() {
+		return "int";
+	}
+	static int make_key(int rank) {
+		return rank;
+	}
+};
+
+template <>
+struct KeyTraits<Player, Player*> {
+	static const char* name() {
+		return "Player";
+	}
+	static Player make_key(int rank) {
+		return Player(rank + 1, 1, rank / 4, 3 - rank % 4, false, &benchTeam);
+	}
+};
+
+// Packs a half empty tree where the layout supports it, returns whether it did
+template <class KeyType>
+static bool pack_tree(AvlTree<KeyType, Player*>* tree) {
+	(void)tree;
+	return false;
+}
+
+template <class KeyType>
+static bool pack_tree(CompactAvlTree<KeyType, Player*>* tree) {
+	return tree->shrink_to_fit() == TreeStatusType::TREE_SUCCESS;
+}
+
+// Measures one tree type: Container must offer insert(key, value) and remove(key)
+template <class KeyType, class Container>
+static void measure_tree(const char* layout, const std::vector<KeyType>& keys, Player* value) {
+	int n = static_cast<int>(keys.size());
+	HeapSnapshot before = heap_now();
+	Container* tree = new Container();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		tree->insert(keys[keyIdx], value);
+	}
+	print_row(KeyTraits<KeyType, Player*>::name(), n, layout, "full", n, before, tree->get_stats().liveBytes);
+	for (int keyIdx = 0; keyIdx < n; keyIdx += 2) {
+		tree->remove(keys[keyIdx]);
+	}
+	print_row(KeyTraits<KeyType, Player*>::name(), n, layout, "half", n - (n + 1) / 2, before, tree->get_stats().liveBytes);
+	if (pack_tree(tree)) {
+		print_row(KeyTraits<KeyType, Player*>::name(), n, layout, "packed", n - (n + 1) / 2, before, tree->get_stats().liveBytes);
+	}
+	delete tree;
+}
+
+template <class KeyType>
+static void measure_map(const std::vector<KeyType>& keys, Player* value) {
+	int n = static_cast<int>(keys.size());
+	HeapSnapshot before = heap_now();
+	std::map<KeyType, Player*>* map = new std::map<KeyType, Player*>();
+	for (int keyIdx = 0; keyIdx < n; keyIdx++) {
+		map->insert(std::make_pair(keys[keyIdx], value));
+	}
+	print_row(KeyTraits<KeyType, Player*>::name(), n, "std::map", "full", n, before, 0);
+	for (int keyIdx = 0; keyIdx < n; keyIdx += 2) {
+		map->erase(keys[keyIdx]);
+	}
+	print_row(KeyTraits<KeyType, Player*>::name(), n, "std::map", "half", n - (n + 1) / 2, before, 0);
+	delete map;
+}
+
+template <class KeyType>
+static void run_measurements(int n, std::mt19937_64& random) {
+	std::vector<int> ranks(n);
+	for (int rankIdx = 0; rankIdx < n; rankIdx++) {
+		ranks[rankIdx] = rankIdx;
+	}
+	std::shuffle(ranks.begin(), ranks.end(), random);
+	std::vector<KeyType> keys;
+	keys.reserve(n);
+	for (int rankIdx = 0; rankIdx < n; rankIdx++) {
+		keys.push_back(KeyTraits<KeyType, Player*>::make_key(ranks[rankIdx]));
+	}
+	Player* value = NULL;
+	measure_tree<KeyType, AvlTree<KeyType, Player*> >("AvlTree", keys, value);
+	measure_tree<KeyType, CompactAvlTree<KeyType, Player*> >("CompactAvlTree", keys, value);
+	measure_map<KeyType>(keys, value);
+}
+
+int main(int argc, char** argv) {
+	long long maxSize = 1000000;
+	long long minSize = 1000;
+	unsigned long long seed = 1;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		bool hasValue = argIdx + 1 < argc;
+		if (strcmp(argv[argIdx], "--max-size") == 0 && hasValue) {
+			maxSize = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--min-size") == 0 && hasValue) {
+			minSize = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--seed") == 0 && hasValue) {
+			seed = static_cast<unsigned long long>(strtod(argv[++argIdx], NULL));
+		}
+		else {
+			fprintf(stderr, "usage: %s [--max-size N] [--min-size N] [--seed N]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (minSize < 1 || maxSize < minSize || maxSize > 100000000) {
+		fprintf(stderr, "sizes must satisfy 1 <= min-size <= max-size <= 1e8\n");
+		return 1;
+	}
+
+	std::mt19937_64 random(seed);
+	printf("%-7s %9s %-14s %-6s %10s %10s %10s\n", "keys", "size", "layout", "state", "requested", "allocated", "stats");
+	for (long long n = minSize; n <= maxSize; n *= 10) {
+		run_measurements<int>(static_cast<int>(n), random);
+		run_measurements<Player>(static_cast<int>(n), random);
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+// Fault injection check of PersistentAvlTree's updates while snapshots are alive.
+//
+// Global operator new is replaced to fail on a chosen allocation. Every insert
+// and remove of a random sequence is first run with the 1st, 2nd, ... allocation
+// failing until it succeeds; each failure must leave the tree and all its live
+// snapshots unchanged, and every version is compared with a std::map model
+// after each step. Run it under AddressSanitizer to also catch released nodes
+// still linked from a tree, and leaked copies.
+//
+// Build from the repository root (wet1util.h must be on the include path):
+//     g++ -std=c++11 -O1 -g -fsanitize=address -I. bench/persistent_check.cpp -o persistent_check
+//
+// Usage: persistent_check [--size N] [--ops N] [--snapshots N] [--seed N]
+
+#include "../PersistentAvlTree.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <random>
+#include <vector>
+
+// Allocations left before the next one fails, negative when none should fail
+static long long allocationsLeft = -1;
+
+// Blocks carry a header as in memory_bench, the user pointer <-> block conversions through
+// uintptr_t keep GCC from flagging free() of a pointer that came from operator new
+// (-Wmismatched-new-delete) once both are inlined
+union BlockHeader {
+	max_align_t align;
+};
+
+static void* user_pointer(BlockHeader* block) {
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader));
+}
+
+static BlockHeader* block_of(void* pointer) {
+	return reinterpret_cast<BlockHeader*>(reinterpret_cast<uintptr_t>(pointer) - sizeof(BlockHeader));
+}
+
+void* operator new(size_t size) {
+	if (allocationsLeft == 0) {
+		throw std::bad_alloc();
+	}
+	if (allocationsLeft > 0) {
+		allocationsLeft--;
+	}
+	BlockHeader* block = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+	if (block == NULL) {
+		throw std::bad_alloc();
+	}
+	return user_pointer(block);
+}
+
+void operator delete(void* pointer) noexcept {
+	if (pointer != NULL) {
+		free(block_of(pointer));
+	}
+}
+
+void operator delete(void* pointer, size_t size) noexcept {
+	(void)size;
+	operator delete(pointer);
+}
+
+typedef PersistentAvlTree<int, int> Tree;
+typedef std::map<int, int> Model;
+
+struct Version {
+	Tree tree;
+	Model model;
+};
+
+static bool same_contents(const Tree& tree, const Model& model) {
+	int size = -1;
+	tree.get_size(&size);
+	if (size != static_cast<int>(model.size())) {
+		return false;
+	}
+	std::vector<int> keys(model.size() + 1);
+	std::vector<int> values(model.size() + 1);
+	tree.get_tree_keys_in_order(keys.data());
+	tree.get_tree_values_in_order(values.data());
+	int idx = 0;
+	for (Model::const_iterator it = model.begin(); it != model.end(); ++it, idx++) {
+		if (keys[idx] != it->first || values[idx] != it->second) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Compares the tree and every snapshot with their models, reports the first mismatch
+static bool check_versions(const Version& current, const std::vector<Version>& snapshots, const char* when, long long step) {
+	if (!same_contents(current.tree, current.model)) {
+		fprintf(stderr, "step %lld: tree differs from its model %s\n", step, when);
+		return false;
+	}
+	for (size_t snapshotIdx = 0; snapshotIdx < snapshots.size(); snapshotIdx++) {
+		if (!same_contents(snapshots[snapshotIdx].tree, snapshots[snapshotIdx].model)) {
+			fprintf(stderr, "step %lld: snapshot %zu differs from its model %s\n", step, snapshotIdx, when);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Runs the update with the 1st, 2nd, ... allocation failing until it succeeds.
+// Returns the number of injected failures, or -1 when a check fails.
+template <class Update>
+static long long run_with_failures(Version& current, const std::vector<Version>& snapshots, long long step, Update update) {
+	for (long long failAt = 0;; failAt++) {
+		allocationsLeft = failAt;
+		TreeStatusType status = update(current.tree);
+		allocationsLeft = -1;
+		if (status == TreeStatusType::TREE_SUCCESS) {
+			return failAt;
+		}
+		if (status != TreeStatusType::TREE_ALLOCATION_ERROR) {
+			fprintf(stderr, "step %lld: unexpected status %d\n", step, static_cast<int>(status));
+			return -1;
+		}
+		if (!check_versions(current, snapshots, "after a failed allocation", step)) {
+			return -1;
+		}
+	}
+}
+
+struct Insert {
+	int key;
+	int value;
+	TreeStatusType operator()(Tree& tree) const {
+		return tree.insert(key, value);
+	}
+};
+
+struct Remove {
+	int key;
+	TreeStatusType operator()(Tree& tree) const {
+		return tree.remove(key);
+	}
+};
+
+int main(int argc, char** argv) {
+	long long size = 64;
+	long long numOps = 20000;
+	long long maxSnapshots = 4;
+	unsigned long long seed = 1;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		bool hasValue = argIdx + 1 < argc;
+		if (strcmp(argv[argIdx], "--size") == 0 && hasValue) {
+			size = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--ops") == 0 && hasValue) {
+			numOps = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--snapshots") == 0 && hasValue) {
+			maxSnapshots = static_cast<long long>(strtod(argv[++argIdx], NULL));
+		}
+		else if (strcmp(argv[argIdx], "--seed") == 0 && hasValue) {
+			seed = static_cast<unsigned long long>(strtod(argv[++argIdx], NULL));
+		}
+		else {
+			fprintf(stderr, "usage: %s [--size N] [--ops N] [--snapshots N] [--seed N]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (size < 1 || size > 1000000 || numOps < 0 || maxSnapshots < 0) {
+		fprintf(stderr, "size must be in [1, 1e6], ops and snapshots must not be negative\n");
+		return 1;
+	}
+
+	// Keys are drawn from twice the target size, so the tree hovers around it
+	std::mt19937_64 random(seed);
+	std::uniform_int_distribution<int> keyDistribution(0, static_cast<int>(2 * size - 1));
+	Version current;
+	std::vector<Version> snapshots;
+	for (int key = 0; key < size; key++) {
+		current.tree.insert(2 * key, key);
+		current.model[2 * key] = key;
+	}
+
+	long long injectedFailures = 0;
+	for (long long step = 0; step < numOps; step++) {
+		// Replace a random snapshot, or drop one so some paths are unshared
+		unsigned long long action = random() % 8;
+		if (action == 0 && maxSnapshots > 0) {
+			Version snapshot = { current.tree.snapshot(), current.model };
+			if (static_cast<long long>(snapshots.size()) < maxSnapshots) {
+				snapshots.push_back(snapshot);
+			}
+			else {
+				snapshots[random() % snapshots.size()] = snapshot;
+			}
+		}
+		else if (action == 1 && !snapshots.empty()) {
+			snapshots.erase(snapshots.begin() + static_cast<long>(random() % snapshots.size()));
+		}
+
+		int key = keyDistribution(random);
+		long long failures;
+		if (current.model.count(key) == 0) {
+			Insert insert = { key, static_cast<int>(step) };
+			failures = run_with_failures(current, snapshots, step, insert);
+			current.model[key] = insert.value;
+		}
+		else {
+			Remove remove = { key };
+			failures = run_with_failures(current, snapshots, step, remove);
+			current.model.erase(key);
+		}
+		if (failures < 0 || !check_versions(current, snapshots, "after the update", step)) {
+			return 1;
+		}
+		injectedFailures += failures;
+	}
+	printf("%lld updates ok, %lld injected allocation failures\n", numOps, injectedFailures);
+	return 0;
+}
@@ -0,0 +1,361 @@
+// Generates synthetic world_cup_t command traces (see Trace.h) for trace_replay.
+//
+// The trace starts with a setup phase adding all teams and players (with
+// increasing ids, as real ingestion does), followed by a mixed workload:
+// update_player_stats targets follow a Zipf distribution over the players,
+// play_match is frequent and unite_teams is occasional. The generator tracks
+// which teams and players exist so most commands are valid.
+//
+// Build from the repository root:
+//     g++ -std=c++11 -O2 -I. bench/trace_generator.cpp bench/Trace.cpp -o trace_generator
+//
+// Usage: trace_generator [options] <output>
+//     --players N     number of players in the setup phase (default 100000)
+//     --teams N       number of teams (default players / 20)
+//     --ops N         number of commands after setup (default 10 * players)
+//     --zipf S        Zipf exponent of update_player_stats targets (default 0.99)
+//     --seed N        random seed (default 1)
+//     --binary        write a binary trace instead of a text one
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+// Relative weights of the commands in the mixed phase (out of their sum)
+struct OpWeight {
+	TraceOp op;
+	int weight;
+};
+
+static const OpWeight WORKLOAD_MIX[] = {
+	{ TraceOp::UPDATE_PLAYER_STATS, 4600 },
+	{ TraceOp::PLAY_MATCH, 2000 },
+	{ TraceOp::GET_NUM_PLAYED_GAMES, 800 },
+	{ TraceOp::GET_TEAM_POINTS, 600 },
+	{ TraceOp::GET_TOP_SCORER, 500 },
+	{ TraceOp::GET_CLOSEST_PLAYER, 400 },
+	{ TraceOp::ADD_PLAYER, 300 },
+	{ TraceOp::REMOVE_PLAYER, 200 },
+	{ TraceOp::GET_ALL_PLAYERS_COUNT, 200 },
+	{ TraceOp::KNOCKOUT_WINNER, 150 },
+	{ TraceOp::GET_ALL_PLAYERS, 100 },
+	{ TraceOp::ADD_TEAM, 10 },
+	{ TraceOp::REMOVE_TEAM, 10 },
+	{ TraceOp::UNITE_TEAMS, 30 }
+};
+
+#define WORKLOAD_MIX_SIZE (sizeof(WORKLOAD_MIX) / sizeof(WORKLOAD_MIX[0]))
+#define GOAL_KEEPER_PERCENT 20
+
+// Samples ranks in [1, n] with P(k) proportional to 1 / k^exponent, in O(1)
+// time and memory per sample (rejection-inversion, Hormann & Derflinger).
+class ZipfSampler {
+	double exponent;
+	double hIntegralX1;
+	double hIntegralN;
+	double s;
+	int n;
+
+	static double helper1(double x) {
+		return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+	}
+
+	static double helper2(double x) {
+		return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3.0) * (1 + 0.25 * x));
+	}
+
+	double h(double x) const {
+		return exp(-exponent * log(x));
+	}
+
+	double h_integral(double x) const {
+		double logX = log(x);
+		return helper2((1 - exponent) * logX) * logX;
+	}
+
+	double h_integral_inverse(double x) const {
+		double t = x * (1 - exponent);
+		if (t < -1) {
+			t = -1;
+		}
+		return exp(helper1(t) * x);
+	}
+
+public:
+	ZipfSampler(int n, double exponent) : exponent(exponent), n(n) {
+		hIntegralX1 = h_integral(1.5) - 1;
+		hIntegralN = h_integral(n + 0.5);
+		s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+	}
+
+	int sample(std::mt19937_64& random) {
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		while (true) {
+			double u = hIntegralN + uniform(random) * (hIntegralX1 - hIntegralN);
+			double x = h_integral_inverse(u);
+			int k = static_cast<int>(x + 0.5);
+			if (k < 1) {
+				k = 1;
+			}
+			else if (k > n) {
+				k = n;
+			}
+			if (k - x <= s || u >= h_integral(k + 0.5) - h(k)) {
+				return k;
+			}
+		}
+	}
+};
+
+// Generator side model of the tournament, just enough to emit valid commands
+struct TournamentModel {
+	std::vector<int> teamIds;             // Live team ids
+	std::vector<int> playerIds;           // Live player ids, hottest first
+	std::vector<int> playerTeams;         // Team id each player joined (parallel to playerIds)
+	std::map<int, int> unitedInto;        // Team id -> id of the team it was united into
+	int nextTeamId;
+	int nextPlayerId;
+
+	// Current id of the team a player joined, following unites
+	int current_team(int teamId) {
+		std::map<int, int>::iterator next = unitedInto.find(teamId);
+		while (next != unitedInto.end()) {
+			teamId = next->second;
+			next = unitedInto.find(teamId);
+		}
+		return teamId;
+	}
+};
+
+static long long parse_number(const char* text) {
+	return static_cast<long long>(strtod(text, NULL));
+}
+
+static TraceCommand make_command(TraceOp op, int arg0 = 0, int arg1 = 0, int arg2 = 0, int arg3 = 0, int arg4 = 0, int arg5 = 0) {
+	TraceCommand command;
+	command.op = op;
+	command.args[0] = arg0;
+	command.args[1] = arg1;
+	command.args[2] = arg2;
+	command.args[3] = arg3;
+	command.args[4] = arg4;
+	command.args[5] = arg5;
+	return command;
+}
+
+static TraceCommand make_add_player(TournamentModel& model, int teamId, std::mt19937_64& random) {
+	int playerId = model.nextPlayerId++;
+	int gamesPlayed = static_cast<int>(random() % 20);
+	int goals = gamesPlayed == 0 ? 0 : static_cast<int>(random() % (gamesPlayed + 1));
+	int cards = gamesPlayed == 0 ? 0 : static_cast<int>(random() % 3);
+	bool goalKeeper = static_cast<int>(random() % 100) < GOAL_KEEPER_PERCENT;
+	model.playerIds.push_back(playerId);
+	model.playerTeams.push_back(teamId);
+	return make_command(TraceOp::ADD_PLAYER, playerId, teamId, gamesPlayed, goals, cards, goalKeeper ? 1 : 0);
+}
+
+static int random_team(TournamentModel& model, std::mt19937_64& random) {
+	return model.teamIds[random() % model.teamIds.size()];
+}
+
+// Builds the next command of the mixed phase
+static TraceCommand next_command(TraceOp op, TournamentModel& model, ZipfSampler& zipf, std::mt19937_64& random) {
+	bool hasPlayers = !model.playerIds.empty();
+	bool hasTeams = model.teamIds.size() >= 2;
+	if ((!hasPlayers && op != TraceOp::ADD_TEAM) || (!hasTeams && op != TraceOp::ADD_TEAM)) {
+		op = TraceOp::ADD_TEAM;
+	}
+
+	switch (op) {
+	case TraceOp::UPDATE_PLAYER_STATS: {
+		size_t rank = static_cast<size_t>(zipf.sample(random)) - 1;
+		int playerId = model.playerIds[rank % model.playerIds.size()];
+		int goals = static_cast<int>(random() % 3);
+		int cards = static_cast<int>(random() % 4) == 0 ? 1 : 0;
+		return make_command(op, playerId, 1, goals, cards);
+	}
+	case TraceOp::PLAY_MATCH: {
+		int teamId1 = random_team(model, random);
+		int teamId2 = random_team(model, random);
+		while (teamId2 == teamId1) {
+			teamId2 = random_team(model, random);
+		}
+		return make_command(op, teamId1, teamId2);
+	}
+	case TraceOp::GET_NUM_PLAYED_GAMES:
+		return make_command(op, model.playerIds[random() % model.playerIds.size()]);
+	case TraceOp::GET_TEAM_POINTS:
+		return make_command(op, random_team(model, random));
+	case TraceOp::GET_TOP_SCORER:
+	case TraceOp::GET_ALL_PLAYERS_COUNT:
+	case TraceOp::GET_ALL_PLAYERS:
+		// A quarter of the queries are global ones
+		return make_command(op, random() % 4 == 0 ? -1 : random_team(model, random));
+	case TraceOp::GET_CLOSEST_PLAYER: {
+		size_t playerIdx = random() % model.playerIds.size();
+		return make_command(op, model.playerIds[playerIdx], model.current_team(model.playerTeams[playerIdx]));
+	}
+	case TraceOp::ADD_PLAYER:
+		return make_add_player(model, random_team(model, random), random);
+	case TraceOp::REMOVE_PLAYER: {
+		size_t playerIdx = random() % model.playerIds.size();
+		int playerId = model.playerIds[playerIdx];
+		model.playerIds[playerIdx] = model.playerIds.back();
+		model.playerTeams[playerIdx] = model.playerTeams.back();
+		model.playerIds.pop_back();
+		model.playerTeams.pop_back();
+		return make_command(op, playerId);
+	}
+	case TraceOp::KNOCKOUT_WINNER: {
+		int minTeamId = static_cast<int>(random() % model.nextTeamId);
+		int width = static_cast<int>(random() % (model.nextTeamId / 4 + 1));
+		return make_command(op, minTeamId, minTeamId + width);
+	}
+	case TraceOp::ADD_TEAM: {
+		int teamId = model.nextTeamId++;
+		model.teamIds.push_back(teamId);
+		return make_command(op, teamId, 0);
+	}
+	case TraceOp::REMOVE_TEAM: {
+		// Only succeeds for empty teams, most attempts fail like in real traffic
+		size_t teamIdx = random() % model.teamIds.size();
+		return make_command(op, model.teamIds[teamIdx]);
+	}
+	default: {
+		size_t teamIdx1 = random() % model.teamIds.size();
+		size_t teamIdx2 = random() % model.teamIds.size();
+		while (teamIdx2 == teamIdx1) {
+			teamIdx2 = random() % model.teamIds.size();
+		}
+		int teamId1 = model.teamIds[teamIdx1];
+		int teamId2 = model.teamIds[teamIdx2];
+		int newTeamId = model.nextTeamId++;
+		model.unitedInto[teamId1] = newTeamId;
+		model.unitedInto[teamId2] = newTeamId;
+		model.teamIds[teamIdx1] = newTeamId;
+		model.teamIds[teamIdx2] = model.teamIds.back();
+		model.teamIds.pop_back();
+		return make_command(TraceOp::UNITE_TEAMS, teamId1, teamId2, newTeamId);
+	}
+	}
+}
+
+int main(int argc, char** argv) {
+	long long numPlayers = 100000;
+	long long numTeams = -1;
+	long long numOps = -1;
+	double zipfExponent = 0.99;
+	unsigned long long seed = 1;
+	bool binary = false;
+	const char* outputPath = NULL;
+
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		bool hasValue = argIdx + 1 < argc;
+		if (strcmp(argv[argIdx], "--players") == 0 && hasValue) {
+			numPlayers = parse_number(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--teams") == 0 && hasValue) {
+			numTeams = parse_number(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--ops") == 0 && hasValue) {
+			numOps = parse_number(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--zipf") == 0 && hasValue) {
+			zipfExponent = strtod(argv[++argIdx], NULL);
+		}
+		else if (strcmp(argv[argIdx], "--seed") == 0 && hasValue) {
+			seed = static_cast<unsigned long long>(parse_number(argv[++argIdx]));
+		}
+		else if (strcmp(argv[argIdx], "--binary") == 0) {
+			binary = true;
+		}
+		else if (argv[argIdx][0] != '-' && outputPath == NULL) {
+			outputPath = argv[argIdx];
+		}
+		else {
+			outputPath = NULL;
+			break;
+		}
+	}
+	if (outputPath == NULL || numPlayers < 1 || numPlayers > 100000000 || zipfExponent <= 0) {
+		fprintf(stderr, "usage: %s [--players N] [--teams N] [--ops N] [--zipf S] [--seed N] [--binary] <output>\n", argv[0]);
+		return 1;
+	}
+	if (numTeams < 2) {
+		numTeams = std::max(2LL, numPlayers / 20);
+	}
+	if (numOps < 0) {
+		numOps = 10 * numPlayers;
+	}
+
+	FILE* out = fopen(outputPath, binary ? "wb" : "w");
+	if (out == NULL) {
+		fprintf(stderr, "%s: cannot open for writing\n", outputPath);
+		return 1;
+	}
+
+	std::mt19937_64 random(seed);
+	TournamentModel model;
+	model.nextTeamId = 1;
+	model.nextPlayerId = 1;
+	model.playerIds.reserve(numPlayers);
+	model.playerTeams.reserve(numPlayers);
+
+	unsigned long long totalCommands = numTeams + numPlayers + numOps;
+	if (binary) {
+		write_trace_binary_header(out, totalCommands);
+	}
+	else {
+		fprintf(out, "# players=%lld teams=%lld ops=%lld zipf=%g seed=%llu\n", numPlayers, numTeams, numOps, zipfExponent, seed);
+	}
+	void (*write_command)(FILE*, const TraceCommand&) = binary ? write_trace_binary_command : write_trace_text_command;
+
+	// Setup phase: teams, then players spread uniformly over the teams
+	ZipfSampler zipf(static_cast<int>(numPlayers), zipfExponent);
+	for (long long teamIdx = 0; teamIdx < numTeams; teamIdx++) {
+		write_command(out, next_command(TraceOp::ADD_TEAM, model, zipf, random));
+	}
+	for (long long playerIdx = 0; playerIdx < numPlayers; playerIdx++) {
+		write_command(out, make_add_player(model, random_team(model, random), random));
+	}
+
+	// Hot players are spread over the id space instead of being the oldest ones
+	std::vector<size_t> order(model.playerIds.size());
+	for (size_t playerIdx = 0; playerIdx < order.size(); playerIdx++) {
+		order[playerIdx] = playerIdx;
+	}
+	std::shuffle(order.begin(), order.end(), random);
+	std::vector<int> shuffledIds(order.size());
+	std::vector<int> shuffledTeams(order.size());
+	for (size_t playerIdx = 0; playerIdx < order.size(); playerIdx++) {
+		shuffledIds[playerIdx] = model.playerIds[order[playerIdx]];
+		shuffledTeams[playerIdx] = model.playerTeams[order[playerIdx]];
+	}
+	model.playerIds.swap(shuffledIds);
+	model.playerTeams.swap(shuffledTeams);
+
+	// Mixed phase
+	int totalWeight = 0;
+	for (size_t mixIdx = 0; mixIdx < WORKLOAD_MIX_SIZE; mixIdx++) {
+		totalWeight += WORKLOAD_MIX[mixIdx].weight;
+	}
+	for (long long opIdx = 0; opIdx < numOps; opIdx++) {
+		int pick = static_cast<int>(random() % totalWeight);
+		size_t mixIdx = 0;
+		while (pick >= WORKLOAD_MIX[mixIdx].weight) {
+			pick -= WORKLOAD_MIX[mixIdx].weight;
+			mixIdx++;
+		}
+		write_command(out, next_command(WORKLOAD_MIX[mixIdx].op, model, zipf, random));
+	}
+
+	fclose(out);
+	return 0;
+}
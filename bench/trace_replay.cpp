@@ -0,0 +1,352 @@
+// Replays a command trace (see Trace.h) against world_cup_t and reports the
+// throughput and p50/p99/p999 latency of every API.
+//
+// Build from the repository root (wet1util.h must be on the include path):
+//     g++ -std=c++11 -O2 -DNDEBUG -I. bench/trace_replay.cpp bench/Trace.cpp
+//         worldcup23a1.cpp WorldCupMetrics.cpp Team.cpp TeamGroup.cpp Player.cpp ThreadPool.cpp ChangeFeed.cpp
+//         -pthread -o trace_replay
+//
+// Usage: trace_replay [--echo] [--stats] [--feed] [--reserve PLAYERS TEAMS] <trace>...
+//     --echo     print the result of every command (useful to diff behavior
+//                between two builds); timing is still reported on stderr
+//     --stats    also dump the metrics world_cup_t recorded itself (build with
+//                -DWORLDCUP_METRICS and/or -DAVL_TREE_STATS) and its pool counters
+//     --feed     drain the change feed on a second thread during the replay and
+//                report the events read and lost
+//     --reserve  reserve the object pools up front
+
+#include "Trace.h"
+#include "../worldcup23a1.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define NUM_STATUS_TYPES 4
+#define NUM_CHANGE_TYPES 7
+// Events copied out of the change feed per read
+#define FEED_READ_BATCH 256
+
+struct OpLatencies {
+	std::vector<unsigned long long> samplesNs;
+	unsigned long long statusCounts[NUM_STATUS_TYPES];
+};
+
+static unsigned long long now_ns() {
+	return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static const char* status_name(StatusType status) {
+	switch (status) {
+	case StatusType::SUCCESS:
+		return "SUCCESS";
+	case StatusType::ALLOCATION_ERROR:
+		return "ALLOCATION_ERROR";
+	case StatusType::INVALID_INPUT:
+		return "INVALID_INPUT";
+	default:
+		return "FAILURE";
+	}
+}
+
+static void echo_status(const TraceCommand& command, StatusType status) {
+	printf("%s: %s\n", trace_op_name(command.op), status_name(status));
+}
+
+static void echo_output(const TraceCommand& command, output_t<int> result) {
+	if (result.status() == StatusType::SUCCESS) {
+		printf("%s: SUCCESS, %d\n", trace_op_name(command.op), result.ans());
+	}
+	else {
+		echo_status(command, result.status());
+	}
+}
+
+// Runs one of the APIs that return output_t<int>
+static output_t<int> run_query(world_cup_t& worldCup, const TraceCommand& command) {
+	const int* args = command.args;
+	switch (command.op) {
+	case TraceOp::GET_NUM_PLAYED_GAMES:
+		return worldCup.get_num_played_games(args[0]);
+	case TraceOp::GET_TEAM_POINTS:
+		return worldCup.get_team_points(args[0]);
+	case TraceOp::GET_TOP_SCORER:
+		return worldCup.get_top_scorer(args[0]);
+	case TraceOp::GET_ALL_PLAYERS_COUNT:
+		return worldCup.get_all_players_count(args[0]);
+	case TraceOp::GET_CLOSEST_PLAYER:
+		return worldCup.get_closest_player(args[0], args[1]);
+	default:
+		return worldCup.knockout_winner(args[0], args[1]);
+	}
+}
+
+// Runs a single command, returns the status and its latency through elapsedNs
+static StatusType run_command(world_cup_t& worldCup, const TraceCommand& command, std::vector<int>& allPlayersBuffer, bool echo, unsigned long long* elapsedNs) {
+	const int* args = command.args;
+	StatusType status;
+	unsigned long long start;
+	unsigned long long end;
+
+	switch (command.op) {
+	case TraceOp::ADD_TEAM:
+		start = now_ns();
+		status = worldCup.add_team(args[0], args[1]);
+		end = now_ns();
+		break;
+	case TraceOp::REMOVE_TEAM:
+		start = now_ns();
+		status = worldCup.remove_team(args[0]);
+		end = now_ns();
+		break;
+	case TraceOp::ADD_PLAYER:
+		start = now_ns();
+		status = worldCup.add_player(args[0], args[1], args[2], args[3], args[4], args[5] != 0);
+		end = now_ns();
+		break;
+	case TraceOp::REMOVE_PLAYER:
+		start = now_ns();
+		status = worldCup.remove_player(args[0]);
+		end = now_ns();
+		break;
+	case TraceOp::UPDATE_PLAYER_STATS:
+		start = now_ns();
+		status = worldCup.update_player_stats(args[0], args[1], args[2], args[3]);
+		end = now_ns();
+		break;
+	case TraceOp::PLAY_MATCH:
+		start = now_ns();
+		status = worldCup.play_match(args[0], args[1]);
+		end = now_ns();
+		break;
+	case TraceOp::UNITE_TEAMS:
+		start = now_ns();
+		status = worldCup.unite_teams(args[0], args[1], args[2]);
+		end = now_ns();
+		break;
+	case TraceOp::GET_ALL_PLAYERS: {
+		// Size the output outside of the measured region, as a caller would
+		output_t<int> count = worldCup.get_all_players_count(args[0]);
+		if (count.status() == StatusType::SUCCESS && count.ans() > 0) {
+			allPlayersBuffer.resize(count.ans());
+		}
+		int* output = allPlayersBuffer.empty() ? NULL : &allPlayersBuffer[0];
+		start = now_ns();
+		status = worldCup.get_all_players(args[0], output);
+		end = now_ns();
+		if (echo) {
+			echo_status(command, status);
+			if (status == StatusType::SUCCESS && count.status() == StatusType::SUCCESS) {
+				for (int playerIdx = 0; playerIdx < count.ans(); playerIdx++) {
+					printf("%d\n", allPlayersBuffer[playerIdx]);
+				}
+			}
+		}
+		*elapsedNs = end - start;
+		return status;
+	}
+	default: {
+		start = now_ns();
+		output_t<int> result = run_query(worldCup, command);
+		end = now_ns();
+		if (echo) {
+			echo_output(command, result);
+		}
+		*elapsedNs = end - start;
+		return result.status();
+	}
+	}
+
+	if (echo) {
+		echo_status(command, status);
+	}
+	*elapsedNs = end - start;
+	return status;
+}
+
+static unsigned long long percentile(const std::vector<unsigned long long>& sortedSamples, double fraction) {
+	size_t index = static_cast<size_t>(fraction * sortedSamples.size());
+	if (index >= sortedSamples.size()) {
+		index = sortedSamples.size() - 1;
+	}
+	return sortedSamples[index];
+}
+
+static const char* change_type_name(ChangeType type) {
+	switch (type) {
+	case ChangeType::TEAM_ADDED:
+		return "TEAM_ADDED";
+	case ChangeType::TEAM_REMOVED:
+		return "TEAM_REMOVED";
+	case ChangeType::TEAM_POINTS:
+		return "TEAM_POINTS";
+	case ChangeType::TEAMS_UNITED:
+		return "TEAMS_UNITED";
+	case ChangeType::PLAYER_ADDED:
+		return "PLAYER_ADDED";
+	case ChangeType::PLAYER_REMOVED:
+		return "PLAYER_REMOVED";
+	default:
+		return "TOP_SCORER";
+	}
+}
+
+// Reads the change feed as a dashboard would, until stopped and the feed is drained
+struct FeedReader {
+	const ChangeFeed* feed;
+	unsigned long long cursor;
+	std::atomic<bool> stopping;
+	unsigned long long typeCounts[NUM_CHANGE_TYPES];
+	unsigned long long lostEvents;
+
+	void run() {
+		ChangeEvent events[FEED_READ_BATCH];
+		while (true) {
+			// Checked before reading, so the last read sees everything published before the stop
+			bool stopped = stopping.load();
+			unsigned long long lost;
+			int numRead = feed->read(&cursor, events, FEED_READ_BATCH, &lost);
+			lostEvents += lost;
+			for (int eventIdx = 0; eventIdx < numRead; eventIdx++) {
+				typeCounts[static_cast<int>(events[eventIdx].type)]++;
+			}
+			if (numRead == 0) {
+				if (stopped) {
+					return;
+				}
+				std::this_thread::yield();
+			}
+		}
+	}
+};
+
+static void report_feed(const FeedReader& reader) {
+	fprintf(stderr, "%-22s %10s\n", "change", "events");
+	for (int typeIdx = 0; typeIdx < NUM_CHANGE_TYPES; typeIdx++) {
+		fprintf(stderr, "%-22s %10llu\n", change_type_name(static_cast<ChangeType>(typeIdx)), reader.typeCounts[typeIdx]);
+	}
+	fprintf(stderr, "%-22s %10llu\n", "lost", reader.lostEvents);
+}
+
+static void report(std::vector<OpLatencies>& latencies, unsigned long long totalNs) {
+	unsigned long long totalCommands = 0;
+	fprintf(stderr, "%-22s %10s %10s %12s %10s %10s %10s %10s\n",
+		"operation", "calls", "failed", "ops/s", "p50(ns)", "p99(ns)", "p999(ns)", "max(ns)");
+	for (int opIdx = 0; opIdx < TRACE_NUM_OPS; opIdx++) {
+		std::vector<unsigned long long>& samples = latencies[opIdx].samplesNs;
+		if (samples.empty()) {
+			continue;
+		}
+		totalCommands += samples.size();
+		unsigned long long opNs = 0;
+		for (size_t sampleIdx = 0; sampleIdx < samples.size(); sampleIdx++) {
+			opNs += samples[sampleIdx];
+		}
+		std::sort(samples.begin(), samples.end());
+		unsigned long long failed = samples.size() - latencies[opIdx].statusCounts[static_cast<int>(StatusType::SUCCESS)];
+		double opsPerSec = opNs == 0 ? 0.0 : samples.size() * 1e9 / opNs;
+		fprintf(stderr, "%-22s %10llu %10llu %12.0f %10llu %10llu %10llu %10llu\n",
+			trace_op_name(static_cast<TraceOp>(opIdx)),
+			static_cast<unsigned long long>(samples.size()), failed, opsPerSec,
+			percentile(samples, 0.50), percentile(samples, 0.99), percentile(samples, 0.999), samples.back());
+	}
+	double seconds = totalNs / 1e9;
+	fprintf(stderr, "total: %llu commands in %.3f s (%.0f commands/s)\n",
+		totalCommands, seconds, seconds == 0 ? 0.0 : totalCommands / seconds);
+}
+
+int main(int argc, char** argv) {
+	bool echo = false;
+	bool dumpStats = false;
+	bool readFeed = false;
+	int reservePlayers = 0;
+	int reserveTeams = 0;
+	std::vector<TraceCommand> commands;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		if (strcmp(argv[argIdx], "--echo") == 0) {
+			echo = true;
+		}
+		else if (strcmp(argv[argIdx], "--stats") == 0) {
+			dumpStats = true;
+		}
+		else if (strcmp(argv[argIdx], "--feed") == 0) {
+			readFeed = true;
+		}
+		else if (strcmp(argv[argIdx], "--reserve") == 0 && argIdx + 2 < argc) {
+			reservePlayers = atoi(argv[++argIdx]);
+			reserveTeams = atoi(argv[++argIdx]);
+		}
+		else if (!read_trace(argv[argIdx], commands)) {
+			return 1;
+		}
+	}
+	if (commands.empty()) {
+		fprintf(stderr, "usage: %s [--echo] [--stats] [--feed] [--reserve PLAYERS TEAMS] <trace>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<OpLatencies> latencies(TRACE_NUM_OPS);
+	std::vector<unsigned long long> opCounts(TRACE_NUM_OPS, 0);
+	for (size_t commandIdx = 0; commandIdx < commands.size(); commandIdx++) {
+		opCounts[static_cast<int>(commands[commandIdx].op)]++;
+	}
+	for (int opIdx = 0; opIdx < TRACE_NUM_OPS; opIdx++) {
+		latencies[opIdx].samplesNs.reserve(opCounts[opIdx]);
+		memset(latencies[opIdx].statusCounts, 0, sizeof(latencies[opIdx].statusCounts));
+	}
+
+	world_cup_t* worldCup = new world_cup_t();
+	if (worldCup->reserve(reservePlayers, reserveTeams) != StatusType::SUCCESS) {
+		fprintf(stderr, "cannot reserve %d players and %d teams\n", reservePlayers, reserveTeams);
+		delete worldCup;
+		return 1;
+	}
+	FeedReader feedReader;
+	feedReader.feed = &worldCup->get_change_feed();
+	feedReader.stopping.store(false);
+	memset(feedReader.typeCounts, 0, sizeof(feedReader.typeCounts));
+	feedReader.lostEvents = 0;
+	std::thread feedThread;
+	if (readFeed) {
+		if (worldCup->open_change_feed(&feedReader.cursor) != StatusType::SUCCESS) {
+			fprintf(stderr, "cannot open the change feed\n");
+			delete worldCup;
+			return 1;
+		}
+		feedThread = std::thread(&FeedReader::run, &feedReader);
+	}
+	std::vector<int> allPlayersBuffer;
+	unsigned long long totalNs = 0;
+	for (size_t commandIdx = 0; commandIdx < commands.size(); commandIdx++) {
+		const TraceCommand& command = commands[commandIdx];
+		unsigned long long elapsedNs;
+		StatusType status = run_command(*worldCup, command, allPlayersBuffer, echo, &elapsedNs);
+		OpLatencies& opLatencies = latencies[static_cast<int>(command.op)];
+		opLatencies.samplesNs.push_back(elapsedNs);
+		opLatencies.statusCounts[static_cast<int>(status)]++;
+		totalNs += elapsedNs;
+	}
+	if (readFeed) {
+		feedReader.stopping.store(true);
+		feedThread.join();
+	}
+	if (dumpStats) {
+		worldCup->dump_stats(std::cerr);
+		worldCup->dump_tree_stats(std::cerr);
+		worldCup->dump_pool_stats(std::cerr);
+	}
+	delete worldCup;
+
+	report(latencies, totalNs);
+	if (readFeed) {
+		report_feed(feedReader);
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+#include "Protocol.h"
+
+static void put_int32(std::vector<unsigned char>& buffer, int value) {
+	unsigned int bits = static_cast<unsigned int>(value);
+	buffer.push_back(static_cast<unsigned char>(bits));
+	buffer.push_back(static_cast<unsigned char>(bits >> 8));
+	buffer.push_back(static_cast<unsigned char>(bits >> 16));
+	buffer.push_back(static_cast<unsigned char>(bits >> 24));
+}
+
+static int get_int32(const unsigned char* buffer) {
+	unsigned int bits = static_cast<unsigned int>(buffer[0])
+		| (static_cast<unsigned int>(buffer[1]) << 8)
+		| (static_cast<unsigned int>(buffer[2]) << 16)
+		| (static_cast<unsigned int>(buffer[3]) << 24);
+	return static_cast<int>(bits);
+}
+
+static unsigned int get_uint32(const unsigned char* buffer) {
+	return static_cast<unsigned int>(get_int32(buffer));
+}
+
+// Appends a frame header for payloadSize bytes that follow
+static void put_frame_header(std::vector<unsigned char>& buffer, size_t payloadSize) {
+	put_int32(buffer, static_cast<int>(payloadSize));
+}
+
+void protocol_encode_request(std::vector<unsigned char>& buffer, const TraceCommand& command) {
+	int arity = trace_op_arity(command.op);
+	put_frame_header(buffer, 1 + 4 * arity);
+	buffer.push_back(static_cast<unsigned char>(command.op));
+	for (int argIdx = 0; argIdx < arity; argIdx++) {
+		put_int32(buffer, command.args[argIdx]);
+	}
+}
+
+void protocol_encode_select_tournament(std::vector<unsigned char>& buffer, int tournamentId) {
+	put_frame_header(buffer, 1 + 4);
+	buffer.push_back(static_cast<unsigned char>(PROTOCOL_OP_SELECT_TOURNAMENT));
+	put_int32(buffer, tournamentId);
+}
+
+long protocol_parse_request(const unsigned char* data, size_t length, TraceCommand* command, int* op, bool* valid) {
+	if (length < PROTOCOL_FRAME_HEADER_SIZE) {
+		return 0;
+	}
+	unsigned int payloadSize = get_uint32(data);
+	if (payloadSize == 0 || payloadSize > PROTOCOL_MAX_REQUEST_SIZE) {
+		return -1;
+	}
+	if (length < PROTOCOL_FRAME_HEADER_SIZE + payloadSize) {
+		return 0;
+	}
+	const unsigned char* payload = data + PROTOCOL_FRAME_HEADER_SIZE;
+	*op = payload[0];
+	if (*op == PROTOCOL_OP_SELECT_TOURNAMENT) {
+		*valid = payloadSize == 1 + 4 && get_int32(payload + 1) >= 0;
+		command->args[0] = *valid ? get_int32(payload + 1) : 0;
+		return static_cast<long>(PROTOCOL_FRAME_HEADER_SIZE + payloadSize);
+	}
+	*valid = *op < TRACE_NUM_OPS && payloadSize == 1 + 4 * static_cast<unsigned int>(trace_op_arity(static_cast<TraceOp>(*op)));
+	if (*valid) {
+		command->op = static_cast<TraceOp>(*op);
+		for (int argIdx = 0; argIdx < TRACE_MAX_ARGS; argIdx++) {
+			command->args[argIdx] = 1 + 4 * argIdx < static_cast<int>(payloadSize) ? get_int32(payload + 1 + 4 * argIdx) : 0;
+		}
+	}
+	return static_cast<long>(PROTOCOL_FRAME_HEADER_SIZE + payloadSize);
+}
+
+void protocol_encode_status(std::vector<unsigned char>& buffer, int op, StatusType status) {
+	put_frame_header(buffer, 2);
+	buffer.push_back(static_cast<unsigned char>(op));
+	buffer.push_back(static_cast<unsigned char>(status));
+}
+
+void protocol_encode_answer(std::vector<unsigned char>& buffer, int op, output_t<int> result) {
+	if (result.status() != StatusType::SUCCESS) {
+		protocol_encode_status(buffer, op, result.status());
+		return;
+	}
+	put_frame_header(buffer, 2 + 4);
+	buffer.push_back(static_cast<unsigned char>(op));
+	buffer.push_back(static_cast<unsigned char>(StatusType::SUCCESS));
+	put_int32(buffer, result.ans());
+}
+
+void protocol_encode_players(std::vector<unsigned char>& buffer, int op, StatusType status, const int* players, int numPlayers) {
+	if (status != StatusType::SUCCESS) {
+		protocol_encode_status(buffer, op, status);
+		return;
+	}
+	put_frame_header(buffer, 2 + 4 + 4 * static_cast<size_t>(numPlayers));
+	buffer.push_back(static_cast<unsigned char>(op));
+	buffer.push_back(static_cast<unsigned char>(StatusType::SUCCESS));
+	put_int32(buffer, numPlayers);
+	for (int playerIdx = 0; playerIdx < numPlayers; playerIdx++) {
+		put_int32(buffer, players[playerIdx]);
+	}
+}
+
+bool protocol_op_has_answer(int op) {
+	switch (static_cast<TraceOp>(op)) {
+	case TraceOp::GET_NUM_PLAYED_GAMES:
+	case TraceOp::GET_TEAM_POINTS:
+	case TraceOp::GET_TOP_SCORER:
+	case TraceOp::GET_ALL_PLAYERS_COUNT:
+	case TraceOp::GET_CLOSEST_PLAYER:
+	case TraceOp::KNOCKOUT_WINNER:
+		return true;
+	default:
+		return false;
+	}
+}
+
+long protocol_parse_response(const unsigned char* data, size_t length, ProtocolResponse* response) {
+	if (length < PROTOCOL_FRAME_HEADER_SIZE) {
+		return 0;
+	}
+	unsigned int payloadSize = get_uint32(data);
+	if (payloadSize < 2) {
+		return -1;
+	}
+	if (length < PROTOCOL_FRAME_HEADER_SIZE + static_cast<size_t>(payloadSize)) {
+		return 0;
+	}
+	const unsigned char* payload = data + PROTOCOL_FRAME_HEADER_SIZE;
+	response->op = payload[0];
+	response->status = static_cast<StatusType>(payload[1]);
+	response->answer = 0;
+	response->players.clear();
+	if (response->status == StatusType::SUCCESS && response->op == static_cast<int>(TraceOp::GET_ALL_PLAYERS)) {
+		if (payloadSize < 2 + 4) {
+			return -1;
+		}
+		int numPlayers = get_int32(payload + 2);
+		if (numPlayers < 0 || payloadSize != 2 + 4 + 4 * static_cast<unsigned long long>(numPlayers)) {
+			return -1;
+		}
+		response->players.resize(numPlayers);
+		for (int playerIdx = 0; playerIdx < numPlayers; playerIdx++) {
+			response->players[playerIdx] = get_int32(payload + 6 + 4 * playerIdx);
+		}
+	}
+	else if (response->status == StatusType::SUCCESS && protocol_op_has_answer(response->op)) {
+		if (payloadSize != 2 + 4) {
+			return -1;
+		}
+		response->answer = get_int32(payload + 2);
+	}
+	else if (payloadSize != 2) {
+		return -1;
+	}
+	return static_cast<long>(PROTOCOL_FRAME_HEADER_SIZE + payloadSize);
+}
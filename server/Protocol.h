@@ -0,0 +1,64 @@
+#ifndef WET1_SERVER_PROTOCOL_H_
+#define WET1_SERVER_PROTOCOL_H_
+
+#include "../bench/Trace.h"
+#include "wet1util.h"
+
+#include <cstddef>
+#include <vector>
+
+// Framed binary protocol of worldcup_server.
+//
+// Every frame starts with its payload length as a 32-bit little endian
+// integer. Requests and responses use the opcodes of command traces (TraceOp).
+//     request:  opcode (1 byte), trace_op_arity(opcode) int32 arguments
+//     response: opcode (1 byte), StatusType (1 byte), then on SUCCESS
+//               - nothing for the APIs returning StatusType
+//               - the answer (int32) for the APIs returning output_t<int>
+//               - the number of players (int32) and their ids for get_all_players
+// A request with an unknown opcode or a payload that does not fit its opcode
+// gets an INVALID_INPUT response. Responses come back in request order, so a
+// client may send any number of requests before reading (pipelining).
+//
+// The server hosts many tournaments. Requests of a client go to tournament 0
+// until it sends PROTOCOL_OP_SELECT_TOURNAMENT with the id of another one
+// (a non negative int32, answered with a status only response). A server
+// hosting its maximum number of tournaments answers the requests to a new
+// one with FAILURE.
+
+#define PROTOCOL_FRAME_HEADER_SIZE 4
+#define PROTOCOL_MAX_REQUEST_SIZE (1 + 4 * TRACE_MAX_ARGS)
+#define PROTOCOL_OP_SELECT_TOURNAMENT 0x80
+
+struct ProtocolResponse {
+	int op;  // Not necessarily a valid TraceOp, echoed from the request
+	StatusType status;
+	int answer;
+	std::vector<int> players;  // get_all_players only
+};
+
+// Appends the request frame of command to buffer
+void protocol_encode_request(std::vector<unsigned char>& buffer, const TraceCommand& command);
+
+// Appends a PROTOCOL_OP_SELECT_TOURNAMENT request frame to buffer
+void protocol_encode_select_tournament(std::vector<unsigned char>& buffer, int tournamentId);
+
+// Parses the request frame at the start of data. Returns the frame size, 0 if
+// the frame is not complete yet and -1 if it can never be a request (the
+// stream is out of sync). *valid is false for well framed but invalid requests.
+// A valid PROTOCOL_OP_SELECT_TOURNAMENT request leaves the tournament id in
+// command->args[0] and does not set command->op.
+long protocol_parse_request(const unsigned char* data, size_t length, TraceCommand* command, int* op, bool* valid);
+
+// Response writers, appending a complete frame to buffer
+void protocol_encode_status(std::vector<unsigned char>& buffer, int op, StatusType status);
+void protocol_encode_answer(std::vector<unsigned char>& buffer, int op, output_t<int> result);
+void protocol_encode_players(std::vector<unsigned char>& buffer, int op, StatusType status, const int* players, int numPlayers);
+
+// Parses the response frame at the start of data, same return values as protocol_parse_request
+long protocol_parse_response(const unsigned char* data, size_t length, ProtocolResponse* response);
+
+// Whether the responses of op carry an answer (the APIs returning output_t<int>)
+bool protocol_op_has_answer(int op);
+
+#endif // WET1_SERVER_PROTOCOL_H_
@@ -0,0 +1,193 @@
+#include "TournamentHost.h"
+
+#include <new>
+
+TournamentHost::TournamentHost(int numThreads, int maxTournaments, void (*jobDone)(TournamentJob* job, void* context), void* jobDoneContext)
+	: pool(new WorkStealingPool(numThreads)), worldCupPools(NULL), maxTournaments(maxTournaments < 1 ? 1 : maxTournaments),
+	jobDone(jobDone), jobDoneContext(jobDoneContext) {
+	try {
+		worldCupPools = new WorldCupPools(pool->get_num_threads());
+	}
+	catch (...) {
+		delete pool;
+		throw;
+	}
+}
+
+TournamentHost::~TournamentHost() {
+	// Workers may still be leaving run_tournament after reporting their last job
+	delete pool;
+	std::map<int, Tournament*>::iterator tournamentIt;
+	for (tournamentIt = tournaments.begin(); tournamentIt != tournaments.end(); ++tournamentIt) {
+		delete tournamentIt->second->worldCup;
+		delete tournamentIt->second;
+	}
+	// The workers are gone, the tournaments were deleted on this thread using cache 0
+	delete worldCupPools;
+}
+
+int TournamentHost::get_num_tournaments() {
+	std::lock_guard<std::mutex> lock(tournamentsMutex);
+	return static_cast<int>(tournaments.size());
+}
+
+int TournamentHost::get_num_threads() const {
+	return pool->get_num_threads();
+}
+
+TournamentHost::Tournament* TournamentHost::get_tournament(int tournamentId) {
+	std::lock_guard<std::mutex> lock(tournamentsMutex);
+	std::map<int, Tournament*>::iterator tournamentIt = tournaments.find(tournamentId);
+	if (tournamentIt != tournaments.end()) {
+		return tournamentIt->second;
+	}
+	if (static_cast<int>(tournaments.size()) >= maxTournaments) {
+		return NULL;
+	}
+	Tournament* tournament = new Tournament();
+	tournament->host = this;
+	tournament->worldCup = NULL;
+	tournament->scheduled = false;
+	try {
+		tournament->worldCup = new world_cup_t(worldCupPools);
+		tournaments[tournamentId] = tournament;
+	}
+	catch (...) {
+		delete tournament->worldCup;
+		delete tournament;
+		throw;
+	}
+	return tournament;
+}
+
+void TournamentHost::submit(TournamentJob* job) {
+	Tournament* tournament = get_tournament(job->tournamentId);
+	if (tournament == NULL) {
+		refuse_job(job);
+		jobDone(job, jobDoneContext);
+		return;
+	}
+	bool mustSchedule;
+	{
+		std::lock_guard<std::mutex> lock(tournament->mutex);
+		tournament->mailbox.push_back(job);
+		mustSchedule = !tournament->scheduled;
+		tournament->scheduled = true;
+	}
+	if (mustSchedule) {
+		pool->submit(run_tournament, tournament);
+	}
+}
+
+void TournamentHost::run_tournament(void* context) {
+	Tournament* tournament = static_cast<Tournament*>(context);
+	TournamentHost* host = tournament->host;
+	// The shared pools are used through this worker's cache
+	object_pool_cache_index() = host->pool->get_current_worker();
+	for (int jobIdx = 0; jobIdx < TOURNAMENT_JOBS_PER_TURN; jobIdx++) {
+		TournamentJob* job;
+		{
+			std::lock_guard<std::mutex> lock(tournament->mutex);
+			if (tournament->mailbox.empty()) {
+				tournament->scheduled = false;
+				return;
+			}
+			job = tournament->mailbox.front();
+			tournament->mailbox.pop_front();
+		}
+		execute_job(*tournament->worldCup, job, tournament->allPlayersBuffer);
+		host->jobDone(job, host->jobDoneContext);
+	}
+	{
+		std::lock_guard<std::mutex> lock(tournament->mutex);
+		if (tournament->mailbox.empty()) {
+			tournament->scheduled = false;
+			return;
+		}
+	}
+	// Still busy, let the other tournaments in first
+	host->pool->submit(run_tournament, tournament);
+}
+
+static void execute_request(world_cup_t& worldCup, const TraceCommand& command, std::vector<int>& allPlayersBuffer, std::vector<unsigned char>& responses) {
+	const int* args = command.args;
+	int op = static_cast<int>(command.op);
+	switch (command.op) {
+	case TraceOp::ADD_TEAM:
+		protocol_encode_status(responses, op, worldCup.add_team(args[0], args[1]));
+		break;
+	case TraceOp::REMOVE_TEAM:
+		protocol_encode_status(responses, op, worldCup.remove_team(args[0]));
+		break;
+	case TraceOp::ADD_PLAYER:
+		protocol_encode_status(responses, op, worldCup.add_player(args[0], args[1], args[2], args[3], args[4], args[5] != 0));
+		break;
+	case TraceOp::REMOVE_PLAYER:
+		protocol_encode_status(responses, op, worldCup.remove_player(args[0]));
+		break;
+	case TraceOp::UPDATE_PLAYER_STATS:
+		protocol_encode_status(responses, op, worldCup.update_player_stats(args[0], args[1], args[2], args[3]));
+		break;
+	case TraceOp::PLAY_MATCH:
+		protocol_encode_status(responses, op, worldCup.play_match(args[0], args[1]));
+		break;
+	case TraceOp::UNITE_TEAMS:
+		protocol_encode_status(responses, op, worldCup.unite_teams(args[0], args[1], args[2]));
+		break;
+	case TraceOp::GET_NUM_PLAYED_GAMES:
+		protocol_encode_answer(responses, op, worldCup.get_num_played_games(args[0]));
+		break;
+	case TraceOp::GET_TEAM_POINTS:
+		protocol_encode_answer(responses, op, worldCup.get_team_points(args[0]));
+		break;
+	case TraceOp::GET_TOP_SCORER:
+		protocol_encode_answer(responses, op, worldCup.get_top_scorer(args[0]));
+		break;
+	case TraceOp::GET_ALL_PLAYERS_COUNT:
+		protocol_encode_answer(responses, op, worldCup.get_all_players_count(args[0]));
+		break;
+	case TraceOp::GET_CLOSEST_PLAYER:
+		protocol_encode_answer(responses, op, worldCup.get_closest_player(args[0], args[1]));
+		break;
+	case TraceOp::KNOCKOUT_WINNER:
+		protocol_encode_answer(responses, op, worldCup.knockout_winner(args[0], args[1]));
+		break;
+	default: {
+		// get_all_players, sized with the players count first
+		output_t<int> count = worldCup.get_all_players_count(args[0]);
+		int numPlayers = count.status() == StatusType::SUCCESS ? count.ans() : 0;
+		if (numPlayers > 0 && static_cast<int>(allPlayersBuffer.size()) < numPlayers) {
+			allPlayersBuffer.resize(numPlayers);
+		}
+		int* output = allPlayersBuffer.empty() ? NULL : &allPlayersBuffer[0];
+		StatusType status = worldCup.get_all_players(args[0], output);
+		protocol_encode_players(responses, op, status, output, numPlayers);
+		break;
+	}
+	}
+}
+
+void TournamentHost::refuse_job(TournamentJob* job) {
+	job->responses.clear();
+	for (size_t requestIdx = 0; requestIdx < job->requests.size(); requestIdx++) {
+		const TournamentRequest& request = job->requests[requestIdx];
+		protocol_encode_status(job->responses, request.op, request.valid ? StatusType::FAILURE : StatusType::INVALID_INPUT);
+	}
+}
+
+void TournamentHost::execute_job(world_cup_t& worldCup, TournamentJob* job, std::vector<int>& allPlayersBuffer) {
+	job->responses.clear();
+	for (size_t requestIdx = 0; requestIdx < job->requests.size(); requestIdx++) {
+		const TournamentRequest& request = job->requests[requestIdx];
+		if (!request.valid) {
+			protocol_encode_status(job->responses, request.op, StatusType::INVALID_INPUT);
+			continue;
+		}
+		try {
+			execute_request(worldCup, request.command, allPlayersBuffer, job->responses);
+		}
+		catch (std::bad_alloc& ba) {
+			protocol_encode_status(job->responses, request.op, StatusType::ALLOCATION_ERROR);
+		}
+	}
+}
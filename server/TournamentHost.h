@@ -0,0 +1,93 @@
+#ifndef WET1_SERVER_TOURNAMENT_HOST_H_
+#define WET1_SERVER_TOURNAMENT_HOST_H_
+
+#include "Protocol.h"
+#include "../WorkStealingPool.h"
+#include "../worldcup23a1.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Hosts many independent world_cup_t instances (tournaments) in one process.
+//
+// Work for a tournament comes in jobs, which queue up in the tournament's
+// mailbox. A tournament with queued jobs is a task of a WorkStealingPool,
+// so busy tournaments spread over the workers, while idle ones only hold
+// their data. A tournament is never run by two workers at once, so
+// world_cup_t needs no locking, and its jobs run in the order they were
+// submitted. After TOURNAMENT_JOBS_PER_TURN jobs a tournament goes back to
+// the pool, so one busy tournament cannot hold a worker forever.
+//
+// Tournaments are created by their first job and live as long as the host.
+// Once the host holds its maximum number of tournaments, jobs for new ones
+// are refused: their requests are answered with FAILURE (INVALID_INPUT for
+// invalid ones) right away, on the submitting thread.
+// They all create their players, teams and tree nodes in one set of pools
+// owned by the host, with a cache per worker. A worker running a tournament
+// uses its own cache, so the pools need no locking either, and memory freed
+// by one tournament is reused by the next one the worker runs. The
+// tournaments start no threads of their own, the host's workers are all the
+// parallelism there is.
+
+#define TOURNAMENT_JOBS_PER_TURN 4
+
+struct TournamentRequest {
+	TraceCommand command;
+	int op;      // Opcode as received, command is only set for valid requests
+	bool valid;
+};
+
+struct TournamentJob {
+	int tournamentId;
+	std::vector<TournamentRequest> requests;
+	std::vector<unsigned char> responses;  // One response frame per request, filled by the host
+
+	// Left to the submitter
+	int clientId;
+	unsigned long long sequence;
+};
+
+class TournamentHost {
+	struct Tournament {
+		TournamentHost* host;
+		world_cup_t* worldCup;
+		std::mutex mutex;
+		std::deque<TournamentJob*> mailbox;
+		bool scheduled;  // Queued in the pool or running
+		std::vector<int> allPlayersBuffer;
+	};
+
+	WorkStealingPool* pool;  // Stopped before the tournaments are deleted
+	WorldCupPools* worldCupPools;  // Shared by all the tournaments, deleted after them
+	std::mutex tournamentsMutex;
+	std::map<int, Tournament*> tournaments;
+	int maxTournaments;
+	void (*jobDone)(TournamentJob* job, void* context);
+	void* jobDoneContext;
+
+	static void run_tournament(void* tournament);
+	// Creates the tournament if needed, NULL when it is new and the host is full
+	Tournament* get_tournament(int tournamentId);
+	// Answers the requests of a job that cannot run
+	static void refuse_job(TournamentJob* job);
+
+public:
+	// jobDone(job, context) is called on a worker thread when a job finished, or in submit when it
+	// was refused. At most maxTournaments (at least 1) tournaments are created.
+	TournamentHost(int numThreads, int maxTournaments, void (*jobDone)(TournamentJob* job, void* context), void* jobDoneContext);
+	// All submitted jobs must be done
+	~TournamentHost();
+	TournamentHost(const TournamentHost&) = delete;
+	TournamentHost& operator=(const TournamentHost&) = delete;
+
+	void submit(TournamentJob* job);
+	int get_num_tournaments();
+	int get_num_threads() const;
+
+	// Runs the requests of job against worldCup, appending their responses
+	static void execute_job(world_cup_t& worldCup, TournamentJob* job, std::vector<int>& allPlayersBuffer);
+};
+
+#endif // WET1_SERVER_TOURNAMENT_HOST_H_
@@ -0,0 +1,270 @@
+// Client of worldcup_server: sends a command trace (see bench/Trace.h) and
+// prints or times the responses.
+//
+// Build from the repository root (wet1util.h must be on the include path):
+//     g++ -std=c++11 -O2 -DNDEBUG -I. server/worldcup_client.cpp server/Protocol.cpp bench/Trace.cpp -o worldcup_client
+//
+// Usage:
+//     worldcup_client --socket <path> [--tournament ID] [--window N] [--echo] <trace>...
+//         sends the traces to tournament ID (default 0) keeping up to N
+//         requests (default 1024) in flight and reports the throughput on stderr
+//     worldcup_client [--tournament ID] --encode <trace>...
+//         writes the request frames to stdout, for worldcup_server --stdin
+//     worldcup_client --decode
+//         reads response frames from stdin and prints them
+// --echo and --decode print the results in the format of trace_replay --echo
+// (leaving out the answer to the tournament selection),
+// so that for example
+//     worldcup_client --encode t | worldcup_server --stdin | worldcup_client --decode
+// prints the same as trace_replay --echo t.
+
+#include "Protocol.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#define CLIENT_READ_CHUNK 65536
+#define CLIENT_DEFAULT_WINDOW 1024
+
+static double now_seconds() {
+	return std::chrono::duration_cast<std::chrono::duration<double> >(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* status_name(StatusType status) {
+	switch (status) {
+	case StatusType::SUCCESS:
+		return "SUCCESS";
+	case StatusType::ALLOCATION_ERROR:
+		return "ALLOCATION_ERROR";
+	case StatusType::INVALID_INPUT:
+		return "INVALID_INPUT";
+	default:
+		return "FAILURE";
+	}
+}
+
+static void echo_response(const ProtocolResponse& response) {
+	if (response.op == PROTOCOL_OP_SELECT_TOURNAMENT && response.status == StatusType::SUCCESS) {
+		return;
+	}
+	const char* name = response.op < TRACE_NUM_OPS ? trace_op_name(static_cast<TraceOp>(response.op)) : "unknown";
+	if (response.status == StatusType::SUCCESS && protocol_op_has_answer(response.op)) {
+		printf("%s: SUCCESS, %d\n", name, response.answer);
+		return;
+	}
+	printf("%s: %s\n", name, status_name(response.status));
+	for (size_t playerIdx = 0; playerIdx < response.players.size(); playerIdx++) {
+		printf("%d\n", response.players[playerIdx]);
+	}
+}
+
+// Parses the complete responses at the start of buffer, returns the bytes used or -1 on a malformed stream
+static long consume_responses(const std::vector<unsigned char>& buffer, size_t start, bool echo, unsigned long long* numResponses) {
+	ProtocolResponse response;
+	size_t offset = start;
+	while (offset < buffer.size()) {
+		long frameSize = protocol_parse_response(&buffer[offset], buffer.size() - offset, &response);
+		if (frameSize < 0) {
+			return -1;
+		}
+		if (frameSize == 0) {
+			break;
+		}
+		if (echo) {
+			echo_response(response);
+		}
+		offset += frameSize;
+		(*numResponses)++;
+	}
+	return static_cast<long>(offset - start);
+}
+
+static int encode(const std::vector<TraceCommand>& commands, int tournamentId) {
+	std::vector<unsigned char> frames;
+	if (tournamentId != 0) {
+		protocol_encode_select_tournament(frames, tournamentId);
+	}
+	for (size_t commandIdx = 0; commandIdx < commands.size(); commandIdx++) {
+		protocol_encode_request(frames, commands[commandIdx]);
+	}
+	return fwrite(&frames[0], 1, frames.size(), stdout) == frames.size() ? 0 : 1;
+}
+
+static int decode() {
+	std::vector<unsigned char> buffer;
+	size_t start = 0;
+	unsigned long long numResponses = 0;
+	while (true) {
+		size_t used = buffer.size();
+		buffer.resize(used + CLIENT_READ_CHUNK);
+		size_t numRead = fread(&buffer[used], 1, CLIENT_READ_CHUNK, stdin);
+		buffer.resize(used + numRead);
+		long consumed = consume_responses(buffer, start, true, &numResponses);
+		if (consumed < 0) {
+			fprintf(stderr, "malformed response after %llu responses\n", numResponses);
+			return 1;
+		}
+		start += consumed;
+		if (numRead == 0) {
+			break;
+		}
+		buffer.erase(buffer.begin(), buffer.begin() + start);
+		start = 0;
+	}
+	if (start != buffer.size()) {
+		fprintf(stderr, "truncated response after %llu responses\n", numResponses);
+		return 1;
+	}
+	return 0;
+}
+
+static int connect_to(const char* path) {
+	struct sockaddr_un address;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: invalid socket path\n", path);
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	int socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socketFd < 0 || connect(socketFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+		perror(path);
+		if (socketFd >= 0) {
+			close(socketFd);
+		}
+		return -1;
+	}
+	return socketFd;
+}
+
+// Sends all commands with up to window requests in flight, reading responses as they come
+static int run_pipelined(int socketFd, const std::vector<TraceCommand>& commands, int tournamentId, int window, bool echo) {
+	std::vector<unsigned char> output;
+	size_t outputStart = 0;
+	std::vector<unsigned char> input;
+	size_t inputStart = 0;
+	size_t nextCommand = 0;
+	unsigned long long numResponses = 0;
+	double start = now_seconds();
+
+	// The selection is answered like a request, count it as one
+	unsigned long long numExpected = commands.size();
+	if (tournamentId != 0) {
+		protocol_encode_select_tournament(output, tournamentId);
+		numExpected++;
+	}
+	while (numResponses < numExpected) {
+		// Encode as many requests as the window allows
+		while (nextCommand < commands.size() && nextCommand + (numExpected - commands.size()) - numResponses < static_cast<size_t>(window)) {
+			protocol_encode_request(output, commands[nextCommand++]);
+		}
+		struct pollfd socketPoll = { socketFd, POLLIN, 0 };
+		if (outputStart < output.size()) {
+			socketPoll.events |= POLLOUT;
+		}
+		if (poll(&socketPoll, 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			return 1;
+		}
+		if (socketPoll.revents & POLLOUT) {
+			ssize_t numWritten = send(socketFd, &output[outputStart], output.size() - outputStart, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (numWritten < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				perror("send");
+				return 1;
+			}
+			outputStart += numWritten > 0 ? numWritten : 0;
+			if (outputStart == output.size()) {
+				output.clear();
+				outputStart = 0;
+			}
+		}
+		if (socketPoll.revents & (POLLIN | POLLHUP | POLLERR)) {
+			size_t used = input.size();
+			input.resize(used + CLIENT_READ_CHUNK);
+			ssize_t numRead = recv(socketFd, &input[used], CLIENT_READ_CHUNK, MSG_DONTWAIT);
+			input.resize(used + (numRead > 0 ? numRead : 0));
+			if (numRead == 0 || (numRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+				fprintf(stderr, "server closed the connection after %llu of %llu responses\n", numResponses, numExpected);
+				return 1;
+			}
+			long consumed = consume_responses(input, inputStart, echo, &numResponses);
+			if (consumed < 0) {
+				fprintf(stderr, "malformed response after %llu responses\n", numResponses);
+				return 1;
+			}
+			inputStart += consumed;
+			input.erase(input.begin(), input.begin() + inputStart);
+			inputStart = 0;
+		}
+	}
+
+	double seconds = now_seconds() - start;
+	fprintf(stderr, "%llu requests in %.3f s (%.0f requests/s)\n",
+		numResponses, seconds, seconds == 0 ? 0.0 : numResponses / seconds);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	const char* socketPath = NULL;
+	int window = CLIENT_DEFAULT_WINDOW;
+	int tournamentId = 0;
+	bool echo = false;
+	bool encodeOnly = false;
+	bool decodeOnly = false;
+	std::vector<TraceCommand> commands;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		bool hasValue = argIdx + 1 < argc;
+		if (strcmp(argv[argIdx], "--socket") == 0 && hasValue) {
+			socketPath = argv[++argIdx];
+		}
+		else if (strcmp(argv[argIdx], "--tournament") == 0 && hasValue) {
+			tournamentId = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--window") == 0 && hasValue) {
+			window = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--echo") == 0) {
+			echo = true;
+		}
+		else if (strcmp(argv[argIdx], "--encode") == 0) {
+			encodeOnly = true;
+		}
+		else if (strcmp(argv[argIdx], "--decode") == 0) {
+			decodeOnly = true;
+		}
+		else if (!read_trace(argv[argIdx], commands)) {
+			return 1;
+		}
+	}
+
+	if (decodeOnly) {
+		return decode();
+	}
+	if (commands.empty() || window < 1 || tournamentId < 0 || (socketPath == NULL) == !encodeOnly) {
+		fprintf(stderr, "usage: %s [--tournament ID] --socket <path> [--window N] [--echo] <trace>... | [--tournament ID] --encode <trace>... | --decode\n", argv[0]);
+		return 1;
+	}
+	if (encodeOnly) {
+		return encode(commands, tournamentId);
+	}
+	int socketFd = connect_to(socketPath);
+	if (socketFd < 0) {
+		return 1;
+	}
+	int result = run_pipelined(socketFd, commands, tournamentId, window, echo);
+	close(socketFd);
+	return result;
+}
@@ -0,0 +1,570 @@
+// Serves world_cup_t tournaments over a Unix domain socket (or stdin/stdout)
+// using the framed binary protocol of Protocol.h.
+//
+// The main thread does all the I/O: it reads whatever the clients sent and
+// cuts it into jobs of up to SERVER_MAX_JOB consecutive requests of one
+// client to one tournament. Jobs run on a TournamentHost, which schedules the
+// tournaments on a work-stealing pool, so the tournaments of different
+// clients run in parallel while every tournament runs one job at a time.
+// A job comes back with all its responses in one buffer. Responses are put
+// back in the client's request order and sent with one write per client for
+// all the jobs that came back together. Clients may pipeline: requests are
+// read and cut into jobs without waiting for the earlier responses.
+//
+// Up to SERVER_MAX_IN_FLIGHT_JOBS jobs per worker thread are handed to the
+// host at once, after that input is left in the buffers and then in the
+// socket, which pushes back on the clients.
+//
+// Build from the repository root (wet1util.h must be on the include path):
+//     g++ -std=c++11 -O2 -DNDEBUG -I. server/worldcup_server.cpp server/TournamentHost.cpp server/Protocol.cpp
+//         bench/Trace.cpp worldcup23a1.cpp WorldCupMetrics.cpp Team.cpp TeamGroup.cpp Player.cpp ThreadPool.cpp
+//         ChangeFeed.cpp WorkStealingPool.cpp -pthread -o worldcup_server
+//
+// Usage: worldcup_server [--threads N] [--max-tournaments N] --socket <path> | --stdin
+//     --socket   listen on a Unix domain socket, until SIGINT or SIGTERM
+//     --stdin    serve a single client reading requests from stdin and writing
+//                responses to stdout, until the end of the input
+//     --threads  workers running the tournaments (default: one per hardware thread)
+//     --max-tournaments
+//                tournaments created before requests to new ones fail
+//                (default: SERVER_DEFAULT_MAX_TOURNAMENTS)
+
+#include "Protocol.h"
+#include "TournamentHost.h"
+#include "../ThreadPool.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#define SERVER_READ_CHUNK 65536
+#define SERVER_MAX_JOB 4096
+#define SERVER_MAX_IN_FLIGHT_JOBS 2
+// Tournaments live as long as the server, this bounds the memory clients can make it hold
+#define SERVER_DEFAULT_MAX_TOURNAMENTS 1024
+// A client is not read from while this much of its input waits to be parsed or of its output to be written
+#define SERVER_MAX_BUFFERED_INPUT (1 << 20)
+#define SERVER_MAX_BUFFERED_OUTPUT (4 << 20)
+
+struct Connection {
+	int id;
+	int readFd;
+	int writeFd;
+	std::vector<unsigned char> input;
+	size_t inputStart;   // Input before this offset was already parsed
+	std::vector<unsigned char> output;
+	size_t outputStart;  // Output before this offset was already written
+	int tournamentId;    // Tournament of the next requests
+	// Jobs are numbered in request order and written out in that order
+	unsigned long long nextSequence;
+	unsigned long long nextToWrite;
+	std::map<unsigned long long, TournamentJob*> finished;  // Done, waiting for earlier jobs
+	int pendingJobs;     // Cut from the input and not written out yet
+	bool readClosed;
+	bool writeBroken;
+};
+
+// Collects the jobs finished by the host's workers for the I/O thread
+class DoneQueue {
+	std::mutex mutex;
+	std::vector<TournamentJob*> jobs;
+	int wakeFd;  // Written to when the first job comes in
+
+public:
+	explicit DoneQueue(int wakeFd) : wakeFd(wakeFd) {}
+
+	// TournamentHost callback
+	static void push(TournamentJob* job, void* context) {
+		DoneQueue* queue = static_cast<DoneQueue*>(context);
+		bool wasEmpty;
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			wasEmpty = queue->jobs.empty();
+			queue->jobs.push_back(job);
+		}
+		if (wasEmpty) {
+			char wake = 0;
+			while (write(queue->wakeFd, &wake, 1) < 0 && errno == EINTR) {
+			}
+		}
+	}
+
+	// Moves the finished jobs to output (which must be empty)
+	void take_all(std::vector<TournamentJob*>& output) {
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.swap(output);
+	}
+};
+
+/****************************************************************************/
+// I/O thread
+
+static volatile sig_atomic_t stopRequested = 0;
+static int signalWakeFd = -1;
+
+static void handle_stop_signal(int signal) {
+	(void)signal;
+	stopRequested = 1;
+	char wake = 0;
+	ssize_t ignored = write(signalWakeFd, &wake, 1);
+	(void)ignored;
+}
+
+static bool set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+class Server {
+	int listenFd;
+	int wakeFds[2];
+	const char* socketPath;
+	DoneQueue* doneQueue;
+	TournamentHost* host;
+	std::map<int, Connection*> connections;
+	int nextConnectionId;
+	std::vector<TournamentJob*> freeJobs;
+	std::vector<TournamentJob*> doneJobs;
+	int inFlightJobs;
+	int maxInFlightJobs;
+
+	// Totals reported at exit
+	unsigned long long numRequests;
+	unsigned long long numJobs;
+	unsigned long long numWrites;
+
+	void add_connection(int readFd, int writeFd);
+	void close_connection(Connection* connection);
+	void accept_connections();
+	void read_input(Connection* connection);
+	void flush_output(Connection* connection);
+	TournamentJob* new_job();
+	// Cuts the next job from the connection's input, returns false if there was none
+	bool cut_job(Connection* connection);
+	void submit_jobs();
+	void collect_jobs();
+	// Moves the responses of the finished jobs that are next in order to the output
+	void queue_finished(Connection* connection);
+	void stop_listening();
+
+public:
+	Server(int numThreads, int maxTournaments);
+	~Server();
+	bool listen_on(const char* path);
+	bool serve_stdin();
+	void run();
+	void report() const;
+};
+
+Server::Server(int numThreads, int maxTournaments) : listenFd(-1), socketPath(NULL), doneQueue(NULL), host(NULL), nextConnectionId(0),
+	inFlightJobs(0), maxInFlightJobs(SERVER_MAX_IN_FLIGHT_JOBS * numThreads), numRequests(0), numJobs(0), numWrites(0) {
+	wakeFds[0] = -1;
+	wakeFds[1] = -1;
+	if (pipe(wakeFds) != 0 || !set_nonblocking(wakeFds[0]) || !set_nonblocking(wakeFds[1])) {
+		perror("pipe");
+		return;
+	}
+	doneQueue = new DoneQueue(wakeFds[1]);
+	host = new TournamentHost(numThreads, maxTournaments, DoneQueue::push, doneQueue);
+	signalWakeFd = wakeFds[1];
+}
+
+Server::~Server() {
+	std::map<int, Connection*>::iterator connectionIt;
+	for (connectionIt = connections.begin(); connectionIt != connections.end(); ++connectionIt) {
+		close_connection(connectionIt->second);
+	}
+	stop_listening();
+	// Runs whatever is still queued, the finished jobs land in doneQueue
+	delete host;
+	if (doneQueue != NULL) {
+		doneQueue->take_all(doneJobs);
+	}
+	for (size_t jobIdx = 0; jobIdx < doneJobs.size(); jobIdx++) {
+		delete doneJobs[jobIdx];
+	}
+	for (size_t jobIdx = 0; jobIdx < freeJobs.size(); jobIdx++) {
+		delete freeJobs[jobIdx];
+	}
+	delete doneQueue;
+	if (wakeFds[0] >= 0) {
+		close(wakeFds[0]);
+		close(wakeFds[1]);
+	}
+}
+
+void Server::add_connection(int readFd, int writeFd) {
+	Connection* connection = new Connection();
+	connection->id = nextConnectionId++;
+	connection->readFd = readFd;
+	connection->writeFd = writeFd;
+	connection->inputStart = 0;
+	connection->outputStart = 0;
+	connection->tournamentId = 0;
+	connection->nextSequence = 0;
+	connection->nextToWrite = 0;
+	connection->pendingJobs = 0;
+	connection->readClosed = false;
+	connection->writeBroken = false;
+	connections[connection->id] = connection;
+}
+
+void Server::close_connection(Connection* connection) {
+	// stdin / stdout are left open
+	if (connection->readFd > STDERR_FILENO) {
+		close(connection->readFd);
+	}
+	if (connection->writeFd > STDERR_FILENO && connection->writeFd != connection->readFd) {
+		close(connection->writeFd);
+	}
+	std::map<unsigned long long, TournamentJob*>::iterator jobIt;
+	for (jobIt = connection->finished.begin(); jobIt != connection->finished.end(); ++jobIt) {
+		delete jobIt->second;
+	}
+	delete connection;
+}
+
+bool Server::listen_on(const char* path) {
+	struct sockaddr_un address;
+	if (host == NULL || strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: invalid socket path\n", path);
+		return false;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0) {
+		perror("socket");
+		return false;
+	}
+	unlink(path);
+	if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(listenFd, SOMAXCONN) != 0 || !set_nonblocking(listenFd)) {
+		perror(path);
+		close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	socketPath = path;
+	return true;
+}
+
+bool Server::serve_stdin() {
+	if (host == NULL || !set_nonblocking(STDIN_FILENO) || !set_nonblocking(STDOUT_FILENO)) {
+		perror("stdin");
+		return false;
+	}
+	add_connection(STDIN_FILENO, STDOUT_FILENO);
+	return true;
+}
+
+void Server::stop_listening() {
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+		unlink(socketPath);
+	}
+}
+
+void Server::accept_connections() {
+	while (true) {
+		int clientFd = accept(listenFd, NULL, NULL);
+		if (clientFd < 0) {
+			return;
+		}
+		if (!set_nonblocking(clientFd)) {
+			close(clientFd);
+			continue;
+		}
+		add_connection(clientFd, clientFd);
+	}
+}
+
+void Server::read_input(Connection* connection) {
+	// Drop the parsed input before growing the buffer
+	if (connection->inputStart > 0) {
+		connection->input.erase(connection->input.begin(), connection->input.begin() + connection->inputStart);
+		connection->inputStart = 0;
+	}
+	size_t used = connection->input.size();
+	connection->input.resize(used + SERVER_READ_CHUNK);
+	ssize_t numRead = read(connection->readFd, &connection->input[used], SERVER_READ_CHUNK);
+	connection->input.resize(used + (numRead > 0 ? numRead : 0));
+	if (numRead == 0 || (numRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		connection->readClosed = true;
+	}
+}
+
+void Server::flush_output(Connection* connection) {
+	while (connection->outputStart < connection->output.size() && !connection->writeBroken) {
+		ssize_t numWritten = write(connection->writeFd, &connection->output[connection->outputStart],
+			connection->output.size() - connection->outputStart);
+		if (numWritten > 0) {
+			numWrites++;
+			connection->outputStart += numWritten;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
+		}
+		else if (errno != EINTR) {
+			// The client is gone, its remaining responses are dropped
+			connection->writeBroken = true;
+			connection->readClosed = true;
+		}
+	}
+	connection->output.clear();
+	connection->outputStart = 0;
+}
+
+TournamentJob* Server::new_job() {
+	if (freeJobs.empty()) {
+		return new TournamentJob();
+	}
+	TournamentJob* job = freeJobs.back();
+	freeJobs.pop_back();
+	job->requests.clear();
+	job->responses.clear();
+	return job;
+}
+
+bool Server::cut_job(Connection* connection) {
+	if (connection->writeBroken || connection->inputStart == connection->input.size()) {
+		return false;
+	}
+	TournamentJob* job = new_job();
+	job->tournamentId = connection->tournamentId;
+	job->clientId = connection->id;
+	while (job->requests.size() < SERVER_MAX_JOB && connection->inputStart < connection->input.size()) {
+		TournamentRequest request;
+		long frameSize = protocol_parse_request(&connection->input[0] + connection->inputStart,
+			connection->input.size() - connection->inputStart, &request.command, &request.op, &request.valid);
+		if (frameSize == 0) {
+			break;
+		}
+		if (frameSize < 0) {
+			// Out of sync, answer what was parsed and stop reading
+			connection->input.clear();
+			connection->inputStart = 0;
+			connection->readClosed = true;
+			break;
+		}
+		if (request.op == PROTOCOL_OP_SELECT_TOURNAMENT) {
+			if (!job->requests.empty()) {
+				break;  // Ends this job, the next one starts with it
+			}
+			// Answered right away, as a job of its own so it is written out in order
+			connection->inputStart += frameSize;
+			if (request.valid) {
+				connection->tournamentId = request.command.args[0];
+			}
+			protocol_encode_status(job->responses, request.op, request.valid ? StatusType::SUCCESS : StatusType::INVALID_INPUT);
+			job->sequence = connection->nextSequence++;
+			connection->finished[job->sequence] = job;
+			connection->pendingJobs++;
+			return true;
+		}
+		connection->inputStart += frameSize;
+		job->requests.push_back(request);
+	}
+	if (job->requests.empty()) {
+		freeJobs.push_back(job);
+		return false;
+	}
+	job->sequence = connection->nextSequence++;
+	connection->pendingJobs++;
+	numRequests += job->requests.size();
+	numJobs++;
+	inFlightJobs++;
+	host->submit(job);
+	return true;
+}
+
+void Server::submit_jobs() {
+	// One job per client per round, so a client with a long backlog does not starve the others
+	bool progress = true;
+	while (progress && inFlightJobs < maxInFlightJobs) {
+		progress = false;
+		std::map<int, Connection*>::iterator connectionIt;
+		for (connectionIt = connections.begin(); connectionIt != connections.end() && inFlightJobs < maxInFlightJobs; ++connectionIt) {
+			progress = cut_job(connectionIt->second) || progress;
+		}
+	}
+}
+
+void Server::queue_finished(Connection* connection) {
+	std::map<unsigned long long, TournamentJob*>::iterator jobIt = connection->finished.begin();
+	while (jobIt != connection->finished.end() && jobIt->first == connection->nextToWrite) {
+		TournamentJob* job = jobIt->second;
+		if (!connection->writeBroken) {
+			connection->output.insert(connection->output.end(), job->responses.begin(), job->responses.end());
+		}
+		freeJobs.push_back(job);
+		connection->finished.erase(jobIt++);
+		connection->nextToWrite++;
+		connection->pendingJobs--;
+	}
+}
+
+void Server::collect_jobs() {
+	doneJobs.clear();
+	doneQueue->take_all(doneJobs);
+	for (size_t jobIdx = 0; jobIdx < doneJobs.size(); jobIdx++) {
+		TournamentJob* job = doneJobs[jobIdx];
+		inFlightJobs--;
+		connections[job->clientId]->finished[job->sequence] = job;
+	}
+	doneJobs.clear();
+}
+
+void Server::run() {
+	std::vector<struct pollfd> pollFds;
+	std::vector<Connection*> polledConnections;
+	while (true) {
+		if (stopRequested) {
+			stop_listening();
+			std::map<int, Connection*>::iterator connectionIt;
+			for (connectionIt = connections.begin(); connectionIt != connections.end(); ++connectionIt) {
+				connectionIt->second->readClosed = true;
+			}
+		}
+
+		submit_jobs();
+		// One write per client for everything that is ready
+		for (std::map<int, Connection*>::iterator readyIt = connections.begin(); readyIt != connections.end(); ++readyIt) {
+			queue_finished(readyIt->second);
+			flush_output(readyIt->second);
+		}
+
+		// Clients that read everything they will ever send and got all their responses are done
+		std::map<int, Connection*>::iterator connectionIt = connections.begin();
+		while (connectionIt != connections.end()) {
+			Connection* connection = connectionIt->second;
+			bool unparsed = connection->inputStart < connection->input.size() && !connection->writeBroken;
+			bool unwritten = connection->outputStart < connection->output.size() && !connection->writeBroken;
+			if (connection->readClosed && !unparsed && !unwritten && connection->pendingJobs == 0) {
+				close_connection(connection);
+				connections.erase(connectionIt++);
+			}
+			else {
+				++connectionIt;
+			}
+		}
+		if (connections.empty() && listenFd < 0) {
+			break;
+		}
+
+		pollFds.clear();
+		polledConnections.clear();
+		struct pollfd wakePoll = { wakeFds[0], POLLIN, 0 };
+		pollFds.push_back(wakePoll);
+		if (listenFd >= 0) {
+			struct pollfd listenPoll = { listenFd, POLLIN, 0 };
+			pollFds.push_back(listenPoll);
+		}
+		for (connectionIt = connections.begin(); connectionIt != connections.end(); ++connectionIt) {
+			Connection* connection = connectionIt->second;
+			bool canRead = !connection->readClosed
+				&& connection->input.size() - connection->inputStart < SERVER_MAX_BUFFERED_INPUT
+				&& connection->output.size() - connection->outputStart < SERVER_MAX_BUFFERED_OUTPUT;
+			bool mustWrite = connection->outputStart < connection->output.size() && !connection->writeBroken;
+			if (canRead) {
+				struct pollfd readPoll = { connection->readFd, POLLIN, 0 };
+				pollFds.push_back(readPoll);
+				polledConnections.push_back(connection);
+			}
+			if (mustWrite) {
+				struct pollfd writePoll = { connection->writeFd, POLLOUT, 0 };
+				pollFds.push_back(writePoll);
+				polledConnections.push_back(connection);
+			}
+		}
+		if (poll(&pollFds[0], pollFds.size(), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			break;
+		}
+
+		size_t pollIdx = 0;
+		if (pollFds[pollIdx++].revents != 0) {
+			char drain[256];
+			while (read(wakeFds[0], drain, sizeof(drain)) > 0) {
+			}
+			collect_jobs();
+		}
+		if (listenFd >= 0 && pollFds[pollIdx++].revents != 0) {
+			accept_connections();
+		}
+		for (size_t connectionIdx = 0; connectionIdx < polledConnections.size(); connectionIdx++, pollIdx++) {
+			if (pollFds[pollIdx].revents == 0) {
+				continue;
+			}
+			Connection* connection = polledConnections[connectionIdx];
+			if (pollFds[pollIdx].events == POLLIN) {
+				read_input(connection);
+			}
+			else {
+				flush_output(connection);
+			}
+		}
+	}
+}
+
+void Server::report() const {
+	fprintf(stderr, "served %llu requests in %llu jobs (%.1f per job) with %llu writes, %d tournaments on %d threads\n",
+		numRequests, numJobs, numJobs == 0 ? 0.0 : static_cast<double>(numRequests) / numJobs, numWrites,
+		host->get_num_tournaments(), host->get_num_threads());
+}
+
+int main(int argc, char** argv) {
+	const char* socketPath = NULL;
+	bool useStdin = false;
+	int numThreads = ThreadPool::hardware_threads();
+	int maxTournaments = SERVER_DEFAULT_MAX_TOURNAMENTS;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		if (strcmp(argv[argIdx], "--socket") == 0 && argIdx + 1 < argc) {
+			socketPath = argv[++argIdx];
+		}
+		else if (strcmp(argv[argIdx], "--threads") == 0 && argIdx + 1 < argc) {
+			numThreads = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--max-tournaments") == 0 && argIdx + 1 < argc) {
+			maxTournaments = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--stdin") == 0) {
+			useStdin = true;
+		}
+		else {
+			socketPath = NULL;
+			useStdin = false;
+			break;
+		}
+	}
+	if ((socketPath == NULL) == !useStdin || numThreads < 1 || maxTournaments < 1) {
+		fprintf(stderr, "usage: %s [--threads N] [--max-tournaments N] --socket <path> | --stdin\n", argv[0]);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	Server server(numThreads, maxTournaments);
+	if (useStdin ? !server.serve_stdin() : !server.listen_on(socketPath)) {
+		return 1;
+	}
+	signal(SIGINT, handle_stop_signal);
+	signal(SIGTERM, handle_stop_signal);
+	server.run();
+	server.report();
+	return 0;
+}
@@ -1,48 +1,282 @@
 #include "worldcup23a1.h"
 
+#include <vector>
+
 #define POINTS_FOR_WIN 3
 #define POINTS_FOR_TIE 1
 #define POINTS_FOR_LOSS 0
 #define PLAYERS_TO_COMPARE 2
 
-world_cup_t::world_cup_t() {
+WorldCupPools::WorldCupPools(int numCaches) : groupPool(numCaches), teamPool(numCaches), playerPool(numCaches),
+	teamNodePool(numCaches), playerScoreNodePool(numCaches), playerIdNodePool(numCaches), standingNodePool(numCaches) {
+}
+
+world_cup_t::world_cup_t() : world_cup_t(NULL) {
+}
+
+world_cup_t::world_cup_t(WorldCupPools* sharedPools) : pools(sharedPools != NULL ? sharedPools : &ownPools),
+	teams(&pools->teamNodePool), playersByScore(&pools->playerScoreNodePool), playersById(&pools->playerIdNodePool),
+	validTeams(&pools->teamNodePool), teamsByPoints(&pools->standingNodePool), teamsByStrength(&pools->standingNodePool) {
 	playersCounter = 0;
 	teamCounter = 0;
 	topScorerId = 0;
-	teams = AvlTree<int, Team*>();
-	playersByScore = AvlTree<Player, Player*>();
-	playersById = AvlTree<int, Player*>();
+	knockoutTeams = NULL;
+	knockoutPrefixSums = NULL;
+	knockoutCapacity = 0;
+	workerPool = NULL;
+	// Instances sharing pools are hosted many to a process, their host provides the threads. Their
+	// workers would also use the shared pools through cache 0, which is not theirs.
+	workerPoolStarted = sharedPools != NULL;
+	lastTeamId = 0;
+	lastPlayerId = 0;
+	// Entries start at version 0 so none of them is valid before the first query
+	for (int entryIdx = 0; entryIdx < KNOCKOUT_CACHE_SIZE; entryIdx++) {
+		knockoutCache[entryIdx].version = 0;
+	}
+	knockoutVersion = 1;
 }
 
-world_cup_t::~world_cup_t() = default;
+world_cup_t::~world_cup_t() {
+	// The trees only hold pointers, players and teams are owned here
+	Player** allPlayers = new Player * [playersCounter];
+	playersById.get_tree_values_in_order(allPlayers);
+	for (int playerIdx = 0; playerIdx < playersCounter; playerIdx++) {
+		pools->playerPool.destroy(allPlayers[playerIdx]);
+	}
+	delete[] allPlayers;
+	Team** allTeams = new Team * [teamCounter];
+	teams.get_tree_values_in_order(allTeams);
+	for (int teamIdx = 0; teamIdx < teamCounter; teamIdx++) {
+		pools->teamPool.destroy(allTeams[teamIdx]);
+	}
+	delete[] allTeams;
+	delete[] knockoutTeams;
+	delete[] knockoutPrefixSums;
+	delete workerPool;
+}
 
+// Public API, every call is measured when built with WORLDCUP_METRICS
 StatusType world_cup_t::add_team(int teamId, int points) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, ADD_TEAM, add_team_aux(teamId, points));
+}
+
+StatusType world_cup_t::remove_team(int teamId) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, REMOVE_TEAM, remove_team_aux(teamId));
+}
+
+StatusType world_cup_t::add_player(int playerId, int teamId, int gamesPlayed, int goals, int cards, bool goalKeeper) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, ADD_PLAYER, add_player_aux(playerId, teamId, gamesPlayed, goals, cards, goalKeeper));
+}
+
+StatusType world_cup_t::remove_player(int playerId) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, REMOVE_PLAYER, remove_player_aux(playerId));
+}
+
+StatusType world_cup_t::update_player_stats(int playerId, int gamesPlayed, int scoredGoals, int cardsReceived) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, UPDATE_PLAYER_STATS, update_player_stats_aux(playerId, gamesPlayed, scoredGoals, cardsReceived));
+}
+
+StatusType world_cup_t::play_match(int teamId1, int teamId2) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, PLAY_MATCH, play_match_aux(teamId1, teamId2));
+}
+
+output_t<int> world_cup_t::get_num_played_games(int playerId) {
+	WORLDCUP_MEASURED(stats, GET_NUM_PLAYED_GAMES, get_num_played_games_aux(playerId));
+}
+
+output_t<int> world_cup_t::get_team_points(int teamId) {
+	WORLDCUP_MEASURED(stats, GET_TEAM_POINTS, get_team_points_aux(teamId));
+}
+
+StatusType world_cup_t::unite_teams(int teamId1, int teamId2, int newTeamId) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, UNITE_TEAMS, unite_teams_aux(teamId1, teamId2, newTeamId));
+}
+
+output_t<int> world_cup_t::get_top_scorer(int teamId) {
+	WORLDCUP_MEASURED(stats, GET_TOP_SCORER, get_top_scorer_aux(teamId));
+}
+
+output_t<int> world_cup_t::get_all_players_count(int teamId) {
+	WORLDCUP_MEASURED(stats, GET_ALL_PLAYERS_COUNT, get_all_players_count_aux(teamId));
+}
+
+StatusType world_cup_t::get_all_players(int teamId, int* const output) {
+	WORLDCUP_MEASURED(stats, GET_ALL_PLAYERS, get_all_players_aux(teamId, output));
+}
+
+output_t<int> world_cup_t::get_closest_player(int playerId, int teamId) {
+	WORLDCUP_MEASURED(stats, GET_CLOSEST_PLAYER, get_closest_player_aux(playerId, teamId));
+}
+
+output_t<int> world_cup_t::knockout_winner(int minTeamId, int maxTeamId) {
+	WORLDCUP_MEASURED(stats, KNOCKOUT_WINNER, knockout_winner_aux(minTeamId, maxTeamId));
+}
+
+output_t<int> world_cup_t::get_scorers_page(int teamId, int firstRank, int count, int* const output) {
+	WORLDCUP_MEASURED(stats, GET_SCORERS_PAGE, get_scorers_page_aux(teamId, firstRank, count, output));
+}
+
+output_t<int> world_cup_t::get_top_scorers(int teamId, int count, int* const output) {
+	WORLDCUP_MEASURED(stats, GET_TOP_SCORERS, get_scorers_page_aux(teamId, 1, count, output));
+}
+
+StatusType world_cup_t::play_matches(const int* teamIds1, const int* teamIds2, int numMatches, StatusType* const statuses) {
+	ChangeFeed::Batch feedBatch(changeFeed);
+	WORLDCUP_MEASURED(stats, PLAY_MATCHES, play_matches_aux(teamIds1, teamIds2, numMatches, statuses));
+}
+
+StatusType world_cup_t::get_num_played_games_batch(const int* playerIds, int numIds, int* const answers, StatusType* const statuses) {
+	WORLDCUP_MEASURED(stats, GET_NUM_PLAYED_GAMES_BATCH, get_num_played_games_batch_aux(playerIds, numIds, answers, statuses));
+}
+
+StatusType world_cup_t::get_team_points_batch(const int* teamIds, int numIds, int* const answers, StatusType* const statuses) {
+	WORLDCUP_MEASURED(stats, GET_TEAM_POINTS_BATCH, get_team_points_batch_aux(teamIds, numIds, answers, statuses));
+}
+
+output_t<int> world_cup_t::get_teams_by_points(int firstRank, int count, int* const output) {
+	WORLDCUP_MEASURED(stats, GET_TEAMS_BY_POINTS, get_team_standings_aux(teamsByPoints, firstRank, count, output));
+}
+
+output_t<int> world_cup_t::get_teams_by_strength(int firstRank, int count, int* const output) {
+	WORLDCUP_MEASURED(stats, GET_TEAMS_BY_STRENGTH, get_team_standings_aux(teamsByStrength, firstRank, count, output));
+}
+
+output_t<int> world_cup_t::get_team_points_rank(int teamId) {
+	WORLDCUP_MEASURED(stats, GET_TEAM_POINTS_RANK, get_team_rank_aux(teamsByPoints, teamId, false));
+}
+
+output_t<int> world_cup_t::get_team_strength_rank(int teamId) {
+	WORLDCUP_MEASURED(stats, GET_TEAM_STRENGTH_RANK, get_team_rank_aux(teamsByStrength, teamId, true));
+}
+
+const WorldCupStats& world_cup_t::get_stats() const {
+#ifdef WORLDCUP_METRICS
+	return stats;
+#else
+	// Shared by all the instances, it stays empty
+	static const WorldCupStats noStats;
+	return noStats;
+#endif
+}
+
+StatusType world_cup_t::open_change_feed(unsigned long long* cursor) {
+	if (cursor == NULL) {
+		return StatusType::INVALID_INPUT;
+	}
+	if (!changeFeed.enable()) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	*cursor = changeFeed.end();
+	return StatusType::SUCCESS;
+}
+
+const ChangeFeed& world_cup_t::get_change_feed() const {
+	return changeFeed;
+}
+
+void world_cup_t::reset_stats() {
+#ifdef WORLDCUP_METRICS
+	stats.reset();
+#endif
+}
+
+void world_cup_t::dump_stats(std::ostream& out) const {
+	get_stats().dump(out);
+}
+
+StatusType world_cup_t::reserve(int players, int teams) {
+	if (players < 0 || teams < 0) {
+		return StatusType::INVALID_INPUT;
+	}
+	// Every team starts a group, which can outlive the team after unite_teams
+	if (!pools->playerPool.reserve(players) || !pools->teamPool.reserve(teams) || !pools->groupPool.reserve(teams)) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	// Players are in the global trees and their team's, teams in teams and validTeams, and in both standings
+	if (!pools->playerScoreNodePool.reserve(2LL * players) || !pools->playerIdNodePool.reserve(2LL * players) ||
+		!pools->teamNodePool.reserve(2LL * teams) || !pools->standingNodePool.reserve(2LL * teams)) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	return StatusType::SUCCESS;
+}
+
+void world_cup_t::dump_pool_stats(std::ostream& out) const {
+	::dump_pool_stats(out, "players", pools->playerPool.get_stats());
+	::dump_pool_stats(out, "teams", pools->teamPool.get_stats());
+	::dump_pool_stats(out, "team groups", pools->groupPool.get_stats());
+	::dump_pool_stats(out, "team nodes", pools->teamNodePool.get_stats());
+	::dump_pool_stats(out, "player score nodes", pools->playerScoreNodePool.get_stats());
+	::dump_pool_stats(out, "player id nodes", pools->playerIdNodePool.get_stats());
+	::dump_pool_stats(out, "standing nodes", pools->standingNodePool.get_stats());
+}
+
+void world_cup_t::dump_tree_stats(std::ostream& out) const {
+	::dump_tree_stats(out, "teams", 1, teams.get_stats());
+	::dump_tree_stats(out, "playersById", 1, playersById.get_stats());
+	::dump_tree_stats(out, "validTeams", 1, validTeams.get_stats());
+	::dump_tree_stats(out, "teamsByPoints", 1, teamsByPoints.get_stats());
+	::dump_tree_stats(out, "teamsByStrength", 1, teamsByStrength.get_stats());
+	::dump_tree_stats(out, "playersByScore", 1, playersByScore.get_stats());
+
+	// Team trees are summed over all the teams
+	TreeStats teamsById = TreeStats();
+	TreeStats teamsByScore = TreeStats();
+	Team** allTeams = new Team * [teamCounter];
+	teams.get_tree_values_in_order(allTeams);
+	for (int teamIdx = 0; teamIdx < teamCounter; teamIdx++) {
+		add_tree_stats(teamsById, allTeams[teamIdx]->get_players_by_id_stats());
+		add_tree_stats(teamsByScore, allTeams[teamIdx]->get_players_by_score_stats());
+	}
+	delete[] allTeams;
+	::dump_tree_stats(out, "team playersById", teamCounter, teamsById);
+	::dump_tree_stats(out, "team playersByScore", teamCounter, teamsByScore);
+}
+
+// API implementations
+
+// Top scorer of a team as get_top_scorer reports it, 0 for none
+static int team_top_scorer_id(const Team* team) {
+	output_t<int> topScorer = team->get_top_scorer_id();
+	return topScorer.status() == StatusType::SUCCESS ? topScorer.ans() : 0;
+}
+
+StatusType world_cup_t::add_team_aux(int teamId, int points) {
 	if (teamId <= 0 || points < 0) {
 		return StatusType::INVALID_INPUT;
 	}
-	// Check there is no team with given id
+	// Check there is no team with given id. Teams usually come with increasing ids, then the
+	// insert starts at the last added team and finds a duplicate itself.
+	bool increasingId = teamId > lastTeamId;
 	Team* team;
-	TreeStatusType teamsFindResult = teams.find(teamId, &team);
-	if (teamsFindResult == TreeStatusType::TREE_SUCCESS) {
+	if (!increasingId && teams.find(teamId, &team) == TreeStatusType::TREE_SUCCESS) {
 		return StatusType::FAILURE;
 	}
 
 	// Create new team and add to teams tree
-	Team* newTeam = new Team(teamId, points);
-	TreeStatusType teamsAddResult = teams.insert(teamId, newTeam);
+	Team* newTeam = pools->teamPool.create(teamId, points, &pools->groupPool, &pools->playerScoreNodePool, &pools->playerIdNodePool);
+	TreeStatusType teamsAddResult = increasingId ? teams.insert_near_last(teamId, newTeam) : teams.insert(teamId, newTeam);
 	if (teamsAddResult == TreeStatusType::TREE_FAILURE) {
-		delete newTeam;
+		pools->teamPool.destroy(newTeam);
 		return StatusType::FAILURE;
 	}
 	else if (teamsAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
-		delete newTeam;
+		pools->teamPool.destroy(newTeam);
 		return StatusType::ALLOCATION_ERROR;
 	}
+	lastTeamId = teamId;
 	teamCounter++;
-	return StatusType::SUCCESS;
+	changeFeed.push(ChangeType::TEAM_ADDED, teamId, points);
+	return add_team_standings(newTeam);
 }
 
-StatusType world_cup_t::remove_team(int teamId) {
+StatusType world_cup_t::remove_team_aux(int teamId) {
 	if (teamId <= 0) {
 		return StatusType::INVALID_INPUT;
 	}
@@ -57,21 +291,28 @@ StatusType world_cup_t::remove_team(int teamId) {
 	if (teamsRemoveResult == TreeStatusType::TREE_FAILURE) {
 		return StatusType::FAILURE;
 	}
-	delete teamToRemove;
-	teamCounter--;
+	discard_team(teamToRemove);
 	return StatusType::SUCCESS;
 }
 
-StatusType world_cup_t::add_player(int playerId, int teamId, int gamesPlayed, int goals, int cards, bool goalKeeper) {
+void world_cup_t::discard_team(Team* team) {
+	int teamId = team->get_team_id();
+	remove_team_standings(team);
+	pools->teamPool.destroy(team);
+	teamCounter--;
+	changeFeed.push(ChangeType::TEAM_REMOVED, teamId, 0);
+}
+
+StatusType world_cup_t::add_player_aux(int playerId, int teamId, int gamesPlayed, int goals, int cards, bool goalKeeper) {
 	// Check input is valid
 	if (playerId <= 0 || teamId <= 0 || gamesPlayed < 0 || goals < 0 || cards < 0 || (gamesPlayed == 0 and (goals > 0 || cards > 0))) {
 		return StatusType::INVALID_INPUT;
 	}
 
-	// Check there is no player with given id
+	// Check there is no player with given id, left to the insert for increasing ids (see add_team_aux)
+	bool increasingId = playerId > lastPlayerId;
 	Player* playerPtr;
-	TreeStatusType playersByIdSearchResult = playersById.find(playerId, &playerPtr);
-	if (playersByIdSearchResult == TreeStatusType::TREE_SUCCESS) {
+	if (!increasingId && playersById.find(playerId, &playerPtr) == TreeStatusType::TREE_SUCCESS) {
 		return StatusType::FAILURE;
 	}
 
@@ -84,19 +325,19 @@ StatusType world_cup_t::add_player(int playerId, int teamId, int gamesPlayed, in
 	
 
 	// Add player to global data structure
-	Player* newPlayer = new Player(playerId, gamesPlayed, goals, cards, goalKeeper, teamFound);
-	TreeStatusType playersByIdAddResult = playersById.insert(playerId, newPlayer);
+	Player* newPlayer = pools->playerPool.create(playerId, gamesPlayed, goals, cards, goalKeeper, teamFound);
+	TreeStatusType playersByIdAddResult = increasingId ? playersById.insert_near_last(playerId, newPlayer) : playersById.insert(playerId, newPlayer);
 	if (playersByIdAddResult == TreeStatusType::TREE_FAILURE) {
-		delete newPlayer;
+		pools->playerPool.destroy(newPlayer);
 		return StatusType::FAILURE;
 	}
 	else if (playersByIdAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
-		delete newPlayer;
+		pools->playerPool.destroy(newPlayer);
 		return StatusType::ALLOCATION_ERROR;
 	}
 	TreeStatusType playersByScoreAddResult = playersByScore.insert(*newPlayer, newPlayer);
 	if (playersByScoreAddResult == TreeStatusType::TREE_FAILURE) {
-		delete newPlayer;
+		pools->playerPool.destroy(newPlayer);
 		TreeStatusType playersByIdRemoveResult = playersById.remove(playerId);
 		if (playersByIdRemoveResult == TreeStatusType::TREE_FAILURE) {
 			// throw exception
@@ -104,27 +345,36 @@ StatusType world_cup_t::add_player(int playerId, int teamId, int gamesPlayed, in
 		return StatusType::FAILURE;
 	}
 	else if (playersByScoreAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
-		delete newPlayer;
+		pools->playerPool.destroy(newPlayer);
 		TreeStatusType playersByIdRemoveResult = playersById.remove(playerId);
 		if (playersByIdRemoveResult == TreeStatusType::TREE_FAILURE) {
 			// throw exception
 		}
 		return StatusType::ALLOCATION_ERROR;
 	}
+	invalidate_knockout_cache();
+	bool wasTeamValid = teamFound->is_team_valid();
+	int previousTeamTopScorerId = team_top_scorer_id(teamFound);
 	StatusType teamAddPlayerStatus = teamFound->add_player(newPlayer);
 	if (teamAddPlayerStatus != StatusType::SUCCESS) {  // check player addition to team
+		playersByScore.remove(*newPlayer);
+		playersById.remove(playerId);
+		pools->playerPool.destroy(newPlayer);
 		return teamAddPlayerStatus;
 	}
-	// Update top scorer
-	Player* topScorer = playersByScore.find_max();
-	if (topScorer != NULL) {
-		topScorerId = topScorer->get_player_id();
+	changeFeed.push(ChangeType::PLAYER_ADDED, teamId, playerId);
+	feed_team_top_scorer(teamFound, previousTeamTopScorerId);
+	StatusType validTeamsUpdateStatus = update_valid_team(teamFound, wasTeamValid);
+	if (validTeamsUpdateStatus != StatusType::SUCCESS) {
+		return validTeamsUpdateStatus;
 	}
+	update_top_scorer();
+	lastPlayerId = playerId;
 	playersCounter++;  // Update global player counter
-	return StatusType::SUCCESS;
+	return update_team_standings(teamFound);
 }
 
-StatusType world_cup_t::remove_player(int playerId) {
+StatusType world_cup_t::remove_player_aux(int playerId) {
 	// Check input is valid
 	if (playerId <= 0) {
 		return StatusType::INVALID_INPUT;
@@ -139,27 +389,29 @@ StatusType world_cup_t::remove_player(int playerId) {
 
 	// Remove player from team
 	Team* teamFound = playerPtr->get_team();
+	invalidate_knockout_cache();
+	bool wasTeamValid = teamFound->is_team_valid();
+	int previousTeamTopScorerId = team_top_scorer_id(teamFound);
 	StatusType teamRemovePlayerStatus = teamFound->remove_player(playerId);
 	if (teamRemovePlayerStatus != StatusType::SUCCESS) {  // check player removal to team
 		return teamRemovePlayerStatus;
 	}
+	changeFeed.push(ChangeType::PLAYER_REMOVED, teamFound->get_team_id(), playerId);
+	feed_team_top_scorer(teamFound, previousTeamTopScorerId);
+	update_valid_team(teamFound, wasTeamValid);  // Removal from the index cannot fail
 	// Remove player from global data structure
 	TreeStatusType playersByScoreRemoveResult = playersByScore.remove(*playerPtr);
 	TreeStatusType playersByIdRemoveResult = playersById.remove(playerId);
 	if (playersByIdRemoveResult != TreeStatusType::TREE_SUCCESS || playersByScoreRemoveResult != TreeStatusType::TREE_SUCCESS) {
 		return StatusType::FAILURE;
 	}
-	// Update top scorer
-	Player* topScorer = playersByScore.find_max();
-	if (topScorer != NULL) {
-		topScorerId = topScorer->get_player_id();
-	}
-	delete playerPtr;
+	update_top_scorer();
+	pools->playerPool.destroy(playerPtr);
 	playersCounter--;
-	return StatusType::SUCCESS;
+	return update_team_standings(teamFound);
 }
 
-StatusType world_cup_t::update_player_stats(int playerId, int gamesPlayed, int scoredGoals, int cardsReceived) {
+StatusType world_cup_t::update_player_stats_aux(int playerId, int gamesPlayed, int scoredGoals, int cardsReceived) {
 	if (playerId <= 0 || gamesPlayed < 0 || scoredGoals < 0 || cardsReceived < 0) {
 		return StatusType::INVALID_INPUT;
 	}
@@ -175,11 +427,16 @@ StatusType world_cup_t::update_player_stats(int playerId, int gamesPlayed, int s
 	if (playersByScoreRemoveResult == TreeStatusType::TREE_FAILURE) {
 		return StatusType::FAILURE;
 	}
+	int previousTeamTopScorerId = team_top_scorer_id(playerPtr->get_team());
 	playerPtr->get_team()->remove_player(playerId);
+	// Games played do not take part in knockout scores
+	if (scoredGoals != 0 || cardsReceived != 0) {
+		invalidate_knockout_cache();
+	}
 	// Update stats
 	playerPtr->set_goals(playerPtr->get_goals() + scoredGoals);
 	playerPtr->set_cards(playerPtr->get_cards() + cardsReceived);
-	playerPtr->set_games_played(playerPtr->get_games_played() + gamesPlayed - playerPtr->get_team()->get_games_played());
+	playerPtr->set_games_played(playerPtr->get_games_played() + gamesPlayed);
 
 	// Re-insert player to score ordered tree after stats update
 	TreeStatusType playersByScoreAddResult = playersByScore.insert(*playerPtr, playerPtr);
@@ -190,39 +447,35 @@ StatusType world_cup_t::update_player_stats(int playerId, int gamesPlayed, int s
 	if (reAddPlayerToTeamResult != StatusType::SUCCESS) {
 		return StatusType::FAILURE;
 	}
-
-	// Update top scorer
-	Player* topScorer = playersByScore.find_max();
-	if (topScorer != NULL) {
-		topScorerId = topScorer->get_player_id();
-	}
-
-	// Update player in team
-	return StatusType::SUCCESS;
+	feed_team_top_scorer(playerPtr->get_team(), previousTeamTopScorerId);
+	update_top_scorer();
+	return update_team_standings(playerPtr->get_team());
 }
 
-StatusType world_cup_t::play_match(int teamId1, int teamId2) {
+StatusType world_cup_t::find_match_teams(int teamId1, int teamId2, Team** team1, Team** team2) {
 	// Check input is valid
 	if (teamId1 <= 0 || teamId2 <= 0 || teamId1 == teamId2) {
 		return StatusType::INVALID_INPUT;
 	}
 
 	// Find teams
-	Team* team1;
-	Team* team2;
-	TreeStatusType team1FindResult = teams.find(teamId1, &team1);
-	TreeStatusType team2FindResult = teams.find(teamId2, &team2);
+	TreeStatusType team1FindResult = teams.find(teamId1, team1);
+	TreeStatusType team2FindResult = teams.find(teamId2, team2);
 	if (team1FindResult == TreeStatusType::TREE_FAILURE || team2FindResult == TreeStatusType::TREE_FAILURE) {
 		return StatusType::FAILURE;
 	}
 
 	// Check teams are valid for match
-	if (!team1->is_team_valid() || !team2->is_team_valid()) {
+	if (!(*team1)->is_team_valid() || !(*team2)->is_team_valid()) {
 		return StatusType::FAILURE;
 	}
+	return StatusType::SUCCESS;
+}
 
-	int team1Score = team1->get_points() + team1->get_team_goals() - team1->get_team_cards();
-	int team2Score = team2->get_points() + team2->get_team_goals() - team2->get_team_cards();
+// Updates the points and games of two teams after a match, touching nothing else
+static void play_match_teams(Team* team1, Team* team2) {
+	int team1Score = team1->sum_for_match();
+	int team2Score = team2->sum_for_match();
 	if (team1Score > team2Score) {  // Team1 wins
 		team1->set_points(team1->get_points() + POINTS_FOR_WIN);
 		team2->set_points(team2->get_points() + POINTS_FOR_LOSS);
@@ -237,10 +490,182 @@ StatusType world_cup_t::play_match(int teamId1, int teamId2) {
 	}
 	team1->set_games_played_after_update(team1->get_games_played() + 1);
 	team2->set_games_played_after_update(team2->get_games_played() + 1);
+}
+
+StatusType world_cup_t::play_match_aux(int teamId1, int teamId2) {
+	Team* team1;
+	Team* team2;
+	StatusType findResult = find_match_teams(teamId1, teamId2, &team1, &team2);
+	if (findResult != StatusType::SUCCESS) {
+		return findResult;
+	}
+	invalidate_knockout_cache();
+	int previousPoints1 = team1->get_points();
+	int previousPoints2 = team2->get_points();
+	play_match_teams(team1, team2);
+	// A loss adds no points
+	if (team1->get_points() != previousPoints1) {
+		changeFeed.push(ChangeType::TEAM_POINTS, teamId1, team1->get_points());
+	}
+	if (team2->get_points() != previousPoints2) {
+		changeFeed.push(ChangeType::TEAM_POINTS, teamId2, team2->get_points());
+	}
+	StatusType standingsStatus1 = update_team_standings(team1);
+	StatusType standingsStatus2 = update_team_standings(team2);
+	return standingsStatus1 != StatusType::SUCCESS ? standingsStatus1 : standingsStatus2;
+}
+
+// Playable matches of a play_matches batch, grouped into components that share no team
+struct MatchBatch {
+	std::vector<Team*> teams1;         // Teams of every playable match, in input order
+	std::vector<Team*> teams2;
+	std::vector<int> order;            // Playable matches by component, in input order within one
+	std::vector<int> componentStarts;  // Component c is order[componentStarts[c]] to order[componentStarts[c + 1] - 1]
+	int numTasks;
+	std::vector<Team*> slotTeams;      // Team of every union find slot, with its points before the batch
+	std::vector<int> slotPoints;
+};
+
+// ThreadPool task playing a contiguous range of components, the context is a MatchBatch
+static void play_components_task(int taskIdx, void* context) {
+	MatchBatch* batch = static_cast<MatchBatch*>(context);
+	long long numComponents = static_cast<long long>(batch->componentStarts.size()) - 1;
+	int firstComponent = static_cast<int>(numComponents * taskIdx / batch->numTasks);
+	int endComponent = static_cast<int>(numComponents * (taskIdx + 1) / batch->numTasks);
+	for (int orderIdx = batch->componentStarts[firstComponent]; orderIdx < batch->componentStarts[endComponent]; orderIdx++) {
+		int matchIdx = batch->order[orderIdx];
+		play_match_teams(batch->teams1[matchIdx], batch->teams2[matchIdx]);
+	}
+}
+
+// Union find root of a team slot, halving the path on the way
+static int find_component(std::vector<int>& parents, int slot) {
+	while (parents[slot] != slot) {
+		parents[slot] = parents[parents[slot]];
+		slot = parents[slot];
+	}
+	return slot;
+}
+
+// Finds the union find slot of a team, adding a slot of its own the first time
+static bool get_team_slot(AvlTree<int, int>& teamSlots, std::vector<int>& parents, int teamId, int* slot) {
+	if (teamSlots.find(teamId, slot) == TreeStatusType::TREE_SUCCESS) {
+		return true;
+	}
+	*slot = static_cast<int>(parents.size());
+	if (teamSlots.insert(teamId, *slot) != TreeStatusType::TREE_SUCCESS) {
+		return false;
+	}
+	parents.push_back(*slot);
+	return true;
+}
+
+// Marks a whole batch of matches as not played when it fails before playing any
+static StatusType fail_matches(int numMatches, StatusType* const statuses) {
+	for (int matchIdx = 0; matchIdx < numMatches; matchIdx++) {
+		statuses[matchIdx] = StatusType::ALLOCATION_ERROR;
+	}
+	return StatusType::ALLOCATION_ERROR;
+}
+
+StatusType world_cup_t::play_matches_aux(const int* teamIds1, const int* teamIds2, int numMatches, StatusType* const statuses) {
+	// Check input is valid
+	if (teamIds1 == NULL || teamIds2 == NULL || statuses == NULL || numMatches < 0) {
+		return StatusType::INVALID_INPUT;
+	}
+	ThreadPool* pool = numMatches >= PARALLEL_MATCHES_MIN ? get_worker_pool() : NULL;
+	if (pool == NULL) {
+		// Small batches are not worth the pool
+		for (int matchIdx = 0; matchIdx < numMatches; matchIdx++) {
+			statuses[matchIdx] = play_match_aux(teamIds1[matchIdx], teamIds2[matchIdx]);
+		}
+		return StatusType::SUCCESS;
+	}
+
+	// Matches only change points and games, so which matches are playable is known up front
+	MatchBatch batch;
+	try {
+		AvlTree<int, int> teamSlots;
+		std::vector<int> parents;
+		std::vector<int> matchSlots;  // Slot of the first team of every playable match
+		for (int matchIdx = 0; matchIdx < numMatches; matchIdx++) {
+			Team* team1;
+			Team* team2;
+			statuses[matchIdx] = find_match_teams(teamIds1[matchIdx], teamIds2[matchIdx], &team1, &team2);
+			if (statuses[matchIdx] != StatusType::SUCCESS) {
+				continue;
+			}
+			int slot1;
+			int slot2;
+			if (!get_team_slot(teamSlots, parents, teamIds1[matchIdx], &slot1) || !get_team_slot(teamSlots, parents, teamIds2[matchIdx], &slot2)) {
+				return fail_matches(numMatches, statuses);
+			}
+			// New slots are numbered in order, remember their teams for the change feed
+			if (slot1 == static_cast<int>(batch.slotTeams.size())) {
+				batch.slotTeams.push_back(team1);
+				batch.slotPoints.push_back(team1->get_points());
+			}
+			if (slot2 == static_cast<int>(batch.slotTeams.size())) {
+				batch.slotTeams.push_back(team2);
+				batch.slotPoints.push_back(team2->get_points());
+			}
+			// Both teams now belong to one component
+			parents[find_component(parents, slot1)] = find_component(parents, slot2);
+			batch.teams1.push_back(team1);
+			batch.teams2.push_back(team2);
+			matchSlots.push_back(slot1);
+		}
+
+		// Number the components by their first match and group the matches by component, keeping their order
+		int numPlayable = static_cast<int>(matchSlots.size());
+		std::vector<int> rootComponents(parents.size(), -1);
+		std::vector<int> matchComponents(numPlayable);
+		int numComponents = 0;
+		for (int matchIdx = 0; matchIdx < numPlayable; matchIdx++) {
+			int root = find_component(parents, matchSlots[matchIdx]);
+			if (rootComponents[root] < 0) {
+				rootComponents[root] = numComponents++;
+			}
+			matchComponents[matchIdx] = rootComponents[root];
+		}
+		batch.componentStarts.assign(numComponents + 1, 0);
+		for (int matchIdx = 0; matchIdx < numPlayable; matchIdx++) {
+			batch.componentStarts[matchComponents[matchIdx] + 1]++;
+		}
+		for (int component = 0; component < numComponents; component++) {
+			batch.componentStarts[component + 1] += batch.componentStarts[component];
+		}
+		std::vector<int> nextPositions(batch.componentStarts.begin(), batch.componentStarts.end() - 1);
+		batch.order.resize(numPlayable);
+		for (int matchIdx = 0; matchIdx < numPlayable; matchIdx++) {
+			batch.order[nextPositions[matchComponents[matchIdx]]++] = matchIdx;
+		}
+		batch.numTasks = pool->get_num_threads() * MATCH_TASKS_PER_THREAD;
+		if (batch.numTasks > numComponents) {
+			batch.numTasks = numComponents;
+		}
+	}
+	catch (std::bad_alloc& ba) {
+		return fail_matches(numMatches, statuses);
+	}
+
+	if (batch.numTasks > 0) {
+		invalidate_knockout_cache();
+		pool->run(batch.numTasks, play_components_task, &batch);
+		// The feed has one writer, so the teams' points are fed here once for the whole batch
+		for (size_t slotIdx = 0; slotIdx < batch.slotTeams.size(); slotIdx++) {
+			Team* team = batch.slotTeams[slotIdx];
+			if (team->get_points() != batch.slotPoints[slotIdx]) {
+				changeFeed.push(ChangeType::TEAM_POINTS, team->get_team_id(), team->get_points());
+			}
+			// The matches were played, a team that cannot be moved now is moved on its next change
+			update_team_standings(team);
+		}
+	}
 	return StatusType::SUCCESS;
 }
 
-output_t<int> world_cup_t::get_num_played_games(int playerId) {
+output_t<int> world_cup_t::get_num_played_games_aux(int playerId) {
 	// Check input is valid
 	if (playerId <= 0) {
 		return output_t<int>(StatusType::INVALID_INPUT);
@@ -254,7 +679,7 @@ output_t<int> world_cup_t::get_num_played_games(int playerId) {
 	return output_t<int>(playerPtr->get_games_played());
 }
 
-output_t<int> world_cup_t::get_team_points(int teamId) {
+output_t<int> world_cup_t::get_team_points_aux(int teamId) {
 	// Check input is valid
 	if (teamId <= 0) {
 		return output_t<int>(StatusType::INVALID_INPUT);
@@ -267,7 +692,52 @@ output_t<int> world_cup_t::get_team_points(int teamId) {
 	return output_t<int>(teamFound->get_points());
 }
 
-StatusType world_cup_t::unite_teams(int teamId1, int teamId2, int newTeamId) {
+// Turns the tree results of a batch lookup into API statuses, ids that cannot exist are invalid input
+static void batch_statuses(const int* ids, int numIds, const std::vector<TreeStatusType>& treeResults, StatusType* const statuses) {
+	for (int idIdx = 0; idIdx < numIds; idIdx++) {
+		if (ids[idIdx] <= 0) {
+			statuses[idIdx] = StatusType::INVALID_INPUT;
+		}
+		else {
+			statuses[idIdx] = treeResults[idIdx] == TreeStatusType::TREE_SUCCESS ? StatusType::SUCCESS : StatusType::FAILURE;
+		}
+	}
+}
+
+StatusType world_cup_t::get_num_played_games_batch_aux(const int* playerIds, int numIds, int* const answers, StatusType* const statuses) {
+	// Check input is valid
+	if (playerIds == NULL || answers == NULL || statuses == NULL || numIds < 0) {
+		return StatusType::INVALID_INPUT;
+	}
+	try {
+		batchResults.resize(numIds);
+	}
+	catch (std::bad_alloc& ba) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	// Ids that cannot exist are not found either
+	playersById.map_find_many(playerIds, numIds, answers, batchResults.data(), Player::games_played_of);
+	batch_statuses(playerIds, numIds, batchResults, statuses);
+	return StatusType::SUCCESS;
+}
+
+StatusType world_cup_t::get_team_points_batch_aux(const int* teamIds, int numIds, int* const answers, StatusType* const statuses) {
+	// Check input is valid
+	if (teamIds == NULL || answers == NULL || statuses == NULL || numIds < 0) {
+		return StatusType::INVALID_INPUT;
+	}
+	try {
+		batchResults.resize(numIds);
+	}
+	catch (std::bad_alloc& ba) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	teams.map_find_many(teamIds, numIds, answers, batchResults.data(), Team::points_of);
+	batch_statuses(teamIds, numIds, batchResults, statuses);
+	return StatusType::SUCCESS;
+}
+
+StatusType world_cup_t::unite_teams_aux(int teamId1, int teamId2, int newTeamId) {
 	// Check input is valid
 	if (teamId1 <= 0 || teamId2 <= 0 || newTeamId <= 0 || teamId1 == teamId2) {
 		return StatusType::INVALID_INPUT;
@@ -291,39 +761,53 @@ StatusType world_cup_t::unite_teams(int teamId1, int teamId2, int newTeamId) {
 	}
 
 	// Create new team
-	Team* newTeam = new Team(newTeamId, team1->get_points() + team2->get_points());
+	invalidate_knockout_cache();
+	Team* newTeam = pools->teamPool.create(newTeamId, team1->get_points() + team2->get_points(), &pools->groupPool, &pools->playerScoreNodePool, &pools->playerIdNodePool);
+
+	// Add new team before anything else changes, so a failure leaves both teams as they were.
+	// An id of one of the 2 teams is already in teams and only needs its value replaced.
+	if (newTeamId != teamId1 && newTeamId != teamId2) {
+		TreeStatusType teamsAddResult = teams.insert(newTeamId, newTeam);
+		if (teamsAddResult == TreeStatusType::TREE_FAILURE) {
+			pools->teamPool.destroy(newTeam);
+			return StatusType::FAILURE;
+		}
+		else if (teamsAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
+			pools->teamPool.destroy(newTeam);
+			return StatusType::ALLOCATION_ERROR;
+		}
+	}
+	else {
+		teams.replace(newTeamId, newTeam);
+	}
+
 	// Merge 2 teams into new team
 	newTeam->merge_teams(team1, team2);
 
 	// Remove 2 previous teams
-	team1->clear_players();
-	team2->clear_players();
-	this->remove_team(teamId1);
-	this->remove_team(teamId2);
-	
-
-	// Add new team
-	TreeStatusType teamsAddResult = teams.insert(newTeamId, newTeam);
-	if (teamsAddResult == TreeStatusType::TREE_FAILURE) {
-		teams.insert(teamId1, team1);
-		teams.insert(teamId2, team2);
-		delete newTeam;
-		return StatusType::FAILURE;
+	validTeams.remove(teamId1);
+	validTeams.remove(teamId2);
+	if (newTeamId != teamId1) {
+		teams.remove(teamId1);
 	}
-	else if (teamsAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
-		teams.insert(teamId1, team1);
-		teams.insert(teamId2, team2);
-		delete newTeam;
-		return StatusType::ALLOCATION_ERROR;
+	if (newTeamId != teamId2) {
+		teams.remove(teamId2);
 	}
+	discard_team(team1);
+	discard_team(team2);
 
 	teamCounter++;
+	changeFeed.push(ChangeType::TEAMS_UNITED, newTeamId, teamId1, teamId2);
+	changeFeed.push(ChangeType::TEAM_POINTS, newTeamId, newTeam->get_points());
+	feed_team_top_scorer(newTeam, 0);
 	
-	return StatusType::SUCCESS;
+	StatusType standingsStatus = add_team_standings(newTeam);
+	StatusType validTeamsStatus = update_valid_team(newTeam, false);
+	return validTeamsStatus != StatusType::SUCCESS ? validTeamsStatus : standingsStatus;
 }
 
 
-output_t<int> world_cup_t::get_top_scorer(int teamId) {
+output_t<int> world_cup_t::get_top_scorer_aux(int teamId) {
 	// Check intput is valid
 	if (teamId == 0) {
 		return output_t<int>(StatusType::INVALID_INPUT);
@@ -346,7 +830,7 @@ output_t<int> world_cup_t::get_top_scorer(int teamId) {
 	}
 }
 
-output_t<int> world_cup_t::get_all_players_count(int teamId) {
+output_t<int> world_cup_t::get_all_players_count_aux(int teamId) {
 	// Check intput is valid
 	if (teamId == 0) {
 		return output_t<int>(StatusType::INVALID_INPUT);
@@ -366,19 +850,15 @@ output_t<int> world_cup_t::get_all_players_count(int teamId) {
 	}
 }
 
-StatusType world_cup_t::get_all_players(int teamId, int* const output) {
+StatusType world_cup_t::get_all_players_aux(int teamId, int* const output) {
 	// Check intput is valid
 	if (teamId == 0) {
 		return StatusType::INVALID_INPUT;
 	}
 	// Get all global players
 	if (teamId < 0) {
-		Player* allPlayers = new Player [playersCounter];
-		playersByScore.get_tree_keys_in_order(allPlayers);
-		for (int playerIdx = 0; playerIdx < playersCounter; playerIdx++) {
-			output[playerIdx] = allPlayers[playerIdx].get_player_id();
-		}
-		delete[] allPlayers;
+		// Large exports are split into subtrees written straight to output in parallel
+		playersByScore.map_values_in_order(output, Player::id_of, playersCounter >= PARALLEL_EXPORT_MIN_PLAYERS ? get_worker_pool() : NULL);
 	}
 	// Get all team players
 	else {
@@ -392,6 +872,48 @@ StatusType world_cup_t::get_all_players(int teamId, int* const output) {
 	return StatusType::SUCCESS;
 }
 
+output_t<int> world_cup_t::get_scorers_page_aux(int teamId, int firstRank, int count, int* const output) {
+	// Check intput is valid
+	if (teamId == 0 || firstRank < 1 || count < 1 || output == NULL) {
+		return output_t<int>(StatusType::INVALID_INPUT);
+	}
+	// Walk the global score tree down from the max end
+	if (teamId < 0) {
+		return output_t<int>(playersByScore.map_values_by_rank_desc(output, firstRank - 1, count, Player::id_of));
+	}
+	// Walk the team score tree
+	else {
+		Team* teamFound;
+		TreeStatusType teamFindResult = teams.find(teamId, &teamFound);
+		if (teamFindResult == TreeStatusType::TREE_FAILURE) {
+			return output_t<int>(StatusType::FAILURE);
+		}
+		return output_t<int>(teamFound->get_players_id_by_rank(output, firstRank - 1, count));
+	}
+}
+
+output_t<int> world_cup_t::get_team_standings_aux(const AvlTree<TeamStanding, Team*>& standings, int firstRank, int count, int* const output) {
+	// Check intput is valid
+	if (firstRank < 1 || count < 1 || output == NULL) {
+		return output_t<int>(StatusType::INVALID_INPUT);
+	}
+	return output_t<int>(standings.map_values_by_rank_desc(output, firstRank - 1, count, Team::id_of));
+}
+
+output_t<int> world_cup_t::get_team_rank_aux(const AvlTree<TeamStanding, Team*>& standings, int teamId, bool byStrength) {
+	// Check intput is valid
+	if (teamId <= 0) {
+		return output_t<int>(StatusType::INVALID_INPUT);
+	}
+	Team* teamFound;
+	TreeStatusType teamFindResult = teams.find(teamId, &teamFound);
+	if (teamFindResult == TreeStatusType::TREE_FAILURE) {
+		return output_t<int>(StatusType::FAILURE);
+	}
+	TeamStanding standing = byStrength ? teamFound->get_strength_standing() : teamFound->get_points_standing();
+	return output_t<int>(standings.count_keys_above(standing) + 1);
+}
+
 int compare_players(Player* player1, Player* player2, Player* refrencePlayer) {
 	// Function that finds closest (score-wise) out of 2 players to given refrence player
 	// returns positive number if player1 is closest to refrencePlayer, negative number if player2 is closest to refrencePlayer
@@ -399,7 +921,7 @@ int compare_players(Player* player1, Player* player2, Player* refrencePlayer) {
 		return 0;
 	}
 	// Create candidate for closest player array
-	Player** candidatePlayers = new Player * [PLAYERS_TO_COMPARE];
+	Player* candidatePlayers[PLAYERS_TO_COMPARE];
 	candidatePlayers[0] = player1;
 	candidatePlayers[1] = player2;
 	// Arrays containing absalut difference between given player and candidates (per stat)
@@ -439,7 +961,7 @@ int compare_players(Player* player1, Player* player2, Player* refrencePlayer) {
 }
 
 
-output_t<int> world_cup_t::get_closest_player(int playerId, int teamId) {
+output_t<int> world_cup_t::get_closest_player_aux(int playerId, int teamId) {
 	// Check input is valid
 	if (playerId <= 0 || teamId <= 0) {
 		return output_t<int>(StatusType::INVALID_INPUT);
@@ -472,128 +994,207 @@ output_t<int> world_cup_t::get_closest_player(int playerId, int teamId) {
 }
 
 
-bool is_team_valid(Team * team) {
-	if (team == NULL) {
+StatusType world_cup_t::add_team_standings(Team* team) {
+	team->set_points_standing(team->current_points_standing());
+	team->set_strength_standing(team->current_strength_standing());
+	TreeStatusType byPointsAddResult = teamsByPoints.insert(team->get_points_standing(), team);
+	TreeStatusType byStrengthAddResult = teamsByStrength.insert(team->get_strength_standing(), team);
+	if (byPointsAddResult == TreeStatusType::TREE_ALLOCATION_ERROR || byStrengthAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	return StatusType::SUCCESS;
+}
+
+StatusType world_cup_t::update_team_standings(Team* team) {
+	// A team missing after a failed insert is not found by the remove and put back by the insert
+	StatusType status = StatusType::SUCCESS;
+	TeamStanding pointsStanding = team->current_points_standing();
+	if (pointsStanding != team->get_points_standing()) {
+		teamsByPoints.remove(team->get_points_standing());
+		if (teamsByPoints.insert(pointsStanding, team) == TreeStatusType::TREE_ALLOCATION_ERROR) {
+			status = StatusType::ALLOCATION_ERROR;
+		}
+		team->set_points_standing(pointsStanding);
+	}
+	TeamStanding strengthStanding = team->current_strength_standing();
+	if (strengthStanding != team->get_strength_standing()) {
+		teamsByStrength.remove(team->get_strength_standing());
+		if (teamsByStrength.insert(strengthStanding, team) == TreeStatusType::TREE_ALLOCATION_ERROR) {
+			status = StatusType::ALLOCATION_ERROR;
+		}
+		team->set_strength_standing(strengthStanding);
+	}
+	return status;
+}
+
+void world_cup_t::remove_team_standings(Team* team) {
+	teamsByPoints.remove(team->get_points_standing());
+	teamsByStrength.remove(team->get_strength_standing());
+}
+
+void world_cup_t::update_top_scorer() {
+	Player* topScorer = playersByScore.find_max();
+	// 0 once the last player is removed, like team_top_scorer_id
+	int newTopScorerId = topScorer != NULL ? topScorer->get_player_id() : 0;
+	if (newTopScorerId != topScorerId) {
+		topScorerId = newTopScorerId;
+		changeFeed.push(ChangeType::TOP_SCORER, -1, topScorerId);
+	}
+}
+
+void world_cup_t::feed_team_top_scorer(Team* team, int previousTopScorerId) {
+	int teamTopScorerId = team_top_scorer_id(team);
+	if (teamTopScorerId != previousTopScorerId) {
+		changeFeed.push(ChangeType::TOP_SCORER, team->get_team_id(), teamTopScorerId);
+	}
+}
+
+StatusType world_cup_t::update_valid_team(Team* team, bool wasValid) {
+	bool isValid = team->is_team_valid();
+	if (isValid == wasValid) {
+		return StatusType::SUCCESS;
+	}
+	if (!isValid) {
+		validTeams.remove(team->get_team_id());
+		return StatusType::SUCCESS;
+	}
+	TreeStatusType validTeamsAddResult = validTeams.insert(team->get_team_id(), team);
+	if (validTeamsAddResult == TreeStatusType::TREE_ALLOCATION_ERROR) {
+		return StatusType::ALLOCATION_ERROR;
+	}
+	return StatusType::SUCCESS;
+}
+
+bool world_cup_t::reserve_knockout_buffers(int numTeams) {
+	if (numTeams <= knockoutCapacity) {
+		return true;
+	}
+	// Grow geometrically so a run of growing ranges reallocates O(log k) times
+	int newCapacity = numTeams > 2 * knockoutCapacity ? numTeams : 2 * knockoutCapacity;
+	Team** newTeams;
+	long long* newPrefixSums;
+	try {
+		newTeams = new Team * [newCapacity];
+	}
+	catch (std::bad_alloc& ba) {
 		return false;
 	}
-	return team->is_team_valid();
+	try {
+		newPrefixSums = new long long[newCapacity + 1];
+	}
+	catch (std::bad_alloc& ba) {
+		delete[] newTeams;
+		return false;
+	}
+	delete[] knockoutTeams;
+	delete[] knockoutPrefixSums;
+	knockoutTeams = newTeams;
+	knockoutPrefixSums = newPrefixSums;
+	knockoutCapacity = newCapacity;
+	return true;
 }
 
-output_t<int> world_cup_t::knockout_winner(int minTeamId, int maxTeamId) {
+output_t<int> world_cup_t::knockout_winner_aux(int minTeamId, int maxTeamId) {
 	// Check input is valid
 	if (minTeamId < 0 || maxTeamId<0 || minTeamId>maxTeamId) {
 		return output_t<int>(StatusType::INVALID_INPUT);
 	}
-	// Get valid competing teams (between given IDs)
-	int numCompetingTeams = 0;
-	Team** competingTeams = teams.get_tree_values_ranged_in_order(&numCompetingTeams, minTeamId, maxTeamId, is_team_valid);
-	if (numCompetingTeams == 0) {  // If now teams competing, return failure
-		return output_t<int>(StatusType::FAILURE);
-	}
-	TeamScore** competitionArray = new TeamScore * [numCompetingTeams];
-	for (int i = 0; i < numCompetingTeams; i++) {
-		TeamScore* newTeamScore = new TeamScore;
-		newTeamScore->teamId = competingTeams[i]->get_team_id();
-		newTeamScore->teamScore = competingTeams[i]->sum_for_match();
-		competitionArray[i] = newTeamScore;
-	}
-
-	// TODO: check all mathimatical operations and int<->double castings
-	int numSubArrays = int(log2((double)numCompetingTeams));
-	bool* needSubArrayOfSize = new bool[numSubArrays + 1];
-	int tempNumCompetingTeams = numCompetingTeams;
-	for (int size = numSubArrays; size >= 0; size--) { // TODO: check lower bound is correct
-		if (tempNumCompetingTeams >= pow(2.0, double(size))) {
-			needSubArrayOfSize[size] = true;
-			tempNumCompetingTeams = tempNumCompetingTeams % int(pow(2.0, double(size)));
-		}
-		else {
-			needSubArrayOfSize[size] = false;
+	KnockoutCacheEntry& cacheEntry = knockout_cache_entry(minTeamId, maxTeamId);
+	if (cacheEntry.version == knockoutVersion && cacheEntry.minTeamId == minTeamId && cacheEntry.maxTeamId == maxTeamId) {
+		if (cacheEntry.status != StatusType::SUCCESS) {
+			return output_t<int>(cacheEntry.status);
 		}
+		return output_t<int>(cacheEntry.winnerId);
 	}
+	cacheEntry.minTeamId = minTeamId;
+	cacheEntry.maxTeamId = maxTeamId;
 
-	int* startIndices = new int[numSubArrays+1];
-	int* endIndices = new int[numSubArrays+1];
-
-	// Initialize start/end indices
-	int currIndex = 0;
-	for (int size = numSubArrays; size >= 0; size--) {
-		if (needSubArrayOfSize[size]) {
-			startIndices[size] = currIndex;
-			endIndices[size] = currIndex + int(pow(2.0, double(size))) - 1;
-			currIndex += int(pow(2.0, double(size)));
-		}
-		else {
-			startIndices[size] = -1;
-			endIndices[size] = -1;
-		}
+	// Get valid competing teams (between given IDs), ordered by id
+	int numCompetingTeams = validTeams.get_num_of_values_ranged(minTeamId, maxTeamId, NULL);
+	if (numCompetingTeams == 0) {  // If no teams competing, return failure
+		cacheEntry.version = knockoutVersion;
+		cacheEntry.status = StatusType::FAILURE;
+		return output_t<int>(StatusType::FAILURE);
 	}
-	if (currIndex != numCompetingTeams) {
-		// exception
+	if (!reserve_knockout_buffers(numCompetingTeams)) {
+		return output_t<int>(StatusType::ALLOCATION_ERROR);
 	}
+	validTeams.fill_tree_values_ranged_in_order(knockoutTeams, minTeamId, maxTeamId, NULL);
 
-	TeamScore* winner = new TeamScore;
-	bool winnerValid = false;
-	winner->teamId = 0;
-	winner->teamScore = 0;
-	winner->subArrayScore = 0;
-	if (needSubArrayOfSize[0]) {
-		competitionArray[startIndices[0]]->subArrayScore = competitionArray[startIndices[0]]->teamScore;
+	// Prefix sums of the teams' match scores, the score of any sub-bracket is then O(1)
+	long long* prefixSums = knockoutPrefixSums;
+	prefixSums[0] = 0;
+	for (int teamIdx = 0; teamIdx < numCompetingTeams; teamIdx++) {
+		prefixSums[teamIdx + 1] = prefixSums[teamIdx] + knockoutTeams[teamIdx]->sum_for_match();
 	}
-	for (int round = 0; round < numSubArrays+1; round++) {
-		if (needSubArrayOfSize[round]) {
-			if (!winnerValid) {
-				winner->teamId = competitionArray[startIndices[round]]->teamId;
-				winnerValid = true;
-				winner->teamScore = competitionArray[startIndices[round]]->subArrayScore + winner->teamScore;
-			}
-			else{
-				if (winner->teamScore < competitionArray[startIndices[round]]->subArrayScore) {
-					winner->teamId = competitionArray[startIndices[round]]->teamId;
-				}
-				winner->teamScore = competitionArray[startIndices[round]]->subArrayScore + winner->teamScore + POINTS_FOR_WIN;
-			}
+
+	// Pairing neighbours each round (the last team advancing when the count is odd) splits the
+	// teams into full brackets by the binary representation of their count: the largest bracket
+	// first and the smallest one last. Inside a bracket both halves play the same number of
+	// matches, so the half with the larger score sum wins (the right half, with larger ids, on a
+	// tie) and the bracket winner ends with the bracket's sum plus POINTS_FOR_WIN per match.
+	// The brackets then meet from the last one backwards, ties going to the later teams.
+	int winnerIdx = -1;
+	long long winnerScore = 0;
+	int bracketEnd = numCompetingTeams;
+	for (int bracketSize = 1; bracketSize <= numCompetingTeams; bracketSize <<= 1) {
+		if ((numCompetingTeams & bracketSize) == 0) {
+			continue;
 		}
-		for (int size = numSubArrays ; size > round; size--) {
-			if (!needSubArrayOfSize[size]) {
-				continue;
-			}
-			int middleIndex = startIndices[size] + ((endIndices[size] - startIndices[size]) / 2);
-			int leftSum = 0;
-			int rightSum = 0;
-			for (int i = startIndices[size]; i <= middleIndex; i++) {
-				leftSum += competitionArray[i]->teamScore;
-			}
-			for (int i = middleIndex + 1; i <= endIndices[size]; i++) {
-				rightSum += competitionArray[i]->teamScore;
-			}
-			if (round == 0) {
-				for (int i = startIndices[size]; i <= endIndices[size]; i++) {
-					competitionArray[i]->subArrayScore = leftSum + rightSum + POINTS_FOR_WIN*size;
-				}
-			}
+		int bracketStart = bracketEnd - bracketSize;
+		long long bracketScore = prefixSums[bracketEnd] - prefixSums[bracketStart] + (long long)POINTS_FOR_WIN * (bracketSize - 1);
+
+		// Descend to the bracket winner, halving the candidates every round
+		int low = bracketStart;
+		for (int half = bracketSize >> 1; half > 0; half >>= 1) {
+			long long leftSum = prefixSums[low + half] - prefixSums[low];
+			long long rightSum = prefixSums[low + 2 * half] - prefixSums[low + half];
 			if (leftSum <= rightSum) {
-				startIndices[size] = middleIndex + 1;
+				low += half;
 			}
-			else {
-				endIndices[size] = middleIndex;
+		}
+
+		if (winnerIdx == -1) {
+			winnerIdx = low;
+			winnerScore = bracketScore;
+		}
+		else {
+			if (bracketScore > winnerScore) {
+				winnerIdx = low;
 			}
+			winnerScore += bracketScore + POINTS_FOR_WIN;
 		}
+		bracketEnd = bracketStart;
 	}
 
-	int winnerId = winner->teamId;
+	cacheEntry.version = knockoutVersion;
+	cacheEntry.status = StatusType::SUCCESS;
+	cacheEntry.winnerId = knockoutTeams[winnerIdx]->get_team_id();
+	return output_t<int>(cacheEntry.winnerId);
+}
 
-	// Release all helper arrays/variables
-	delete winner;
-	delete[] startIndices;
-	delete[] endIndices;
-	delete[] needSubArrayOfSize;
-	for (int i = 0; i < numCompetingTeams; i++) {
-		delete competitionArray[i];
+ThreadPool* world_cup_t::get_worker_pool() {
+	if (!workerPoolStarted) {
+		workerPoolStarted = true;
+		int numThreads = ThreadPool::hardware_threads();
+		if (numThreads > 1) {
+			try {
+				workerPool = new ThreadPool(numThreads);
+			}
+			catch (std::exception& e) {
+				workerPool = NULL;  // Not enough resources for threads, stay serial
+			}
+		}
 	}
-	delete[] competitionArray;
-	delete[] competingTeams;
+	return workerPool;
+}
 
+void world_cup_t::invalidate_knockout_cache() {
+	// Empty teams never compete, so adding and removing them keeps the cache valid
+	knockoutVersion++;
+}
 
-	return output_t<int>(winnerId);
-}
\ No newline at end of file
+world_cup_t::KnockoutCacheEntry& world_cup_t::knockout_cache_entry(int minTeamId, int maxTeamId) {
+	unsigned int hash = static_cast<unsigned int>(minTeamId) * 2654435761u ^ static_cast<unsigned int>(maxTeamId) * 40503u;
+	return knockoutCache[(hash >> 16) % KNOCKOUT_CACHE_SIZE];
+}
@@ -18,25 +18,151 @@
 #include "wet1util.h"
 #include "AVLTree.h"
 #include "Team.h"
+#include "WorldCupMetrics.h"
+#include "ThreadPool.h"
+#include "ObjectPool.h"
+#include "ChangeFeed.h"
 #include "math.h"
 
+#include <vector>
+
+// Number of knockout_winner ranges remembered between changes to the teams
+#define KNOCKOUT_CACHE_SIZE 64
+// get_all_players of all the players runs on a thread pool from this many players
+#define PARALLEL_EXPORT_MIN_PLAYERS 65536
+// play_matches runs on the thread pool from this many matches
+#define PARALLEL_MATCHES_MIN 256
+// Tasks per thread of a parallel play_matches, so uneven groups of matches even out
+#define MATCH_TASKS_PER_THREAD 4
+
 class Team;
 
+// Pools world_cup_t creates its players, teams and team groups in, and takes the nodes of its
+// trees from. Instances own theirs unless they are given pools to share, which then need a
+// cache per thread using them (see ObjectPool). The group pool comes first so that it is
+// destroyed last, players and teams release their groups.
+struct WorldCupPools {
+	ObjectPool<TeamGroup> groupPool;
+	ObjectPool<Team> teamPool;
+	ObjectPool<Player> playerPool;
+	// Nodes of world_cup_t's trees and of the teams' trees, which unite_teams moves between trees
+	AvlNodePool<int, Team*> teamNodePool;
+	AvlNodePool<Player, Player*> playerScoreNodePool;
+	AvlNodePool<int, Player*> playerIdNodePool;
+	AvlNodePool<TeamStanding, Team*> standingNodePool;
+
+	explicit WorldCupPools(int numCaches = 1);
+};
+
 class world_cup_t {
 private:
+	// ownPools unless the instance shares pools with others. Declared before the trees, which
+	// give their nodes back when destroyed.
+	WorldCupPools ownPools;
+	WorldCupPools* pools;
+
 	int playersCounter;
 	int teamCounter;
 	int topScorerId;
+	// Ids of the last added team and player, larger ids are inserted starting from them
+	int lastTeamId;
+	int lastPlayerId;
 	AvlTree<int, Team*> teams;
 	AvlTree<Player, Player*> playersByScore;
 	AvlTree<int, Player*> playersById;
+	// Teams that can play a match (see Team::is_team_valid), so knockouts skip the rest
+	AvlTree<int, Team*> validTeams;
+
+	// Adds or removes a team from validTeams after its roster changed
+	StatusType update_valid_team(Team* team, bool wasValid);
+
+	// Standings of the teams by (points, id) and by (sum_for_match, id). Teams are indexed under
+	// the keys they keep (see Team::get_points_standing), which are moved after every change to
+	// the points, goals, cards or roster of a team.
+	AvlTree<TeamStanding, Team*> teamsByPoints;
+	AvlTree<TeamStanding, Team*> teamsByStrength;
 
-	struct TeamScore {
-		int teamId;
-		int teamScore;
-		int subArrayScore;
+	// Puts a new team into the standings, moves a team after a change, or takes it out
+	StatusType add_team_standings(Team* team);
+	StatusType update_team_standings(Team* team);
+	void remove_team_standings(Team* team);
+
+	// Scratch buffers of knockout_winner, reused between calls
+	Team** knockoutTeams;
+	long long* knockoutPrefixSums;
+	int knockoutCapacity;
+
+	// Makes sure the knockout scratch buffers fit numTeams teams
+	bool reserve_knockout_buffers(int numTeams);
+
+	// Direct mapped cache of knockout_winner results. An entry is valid only while its
+	// version equals knockoutVersion, which is bumped by every change to the points,
+	// goals, cards or roster of a team (the inputs of sum_for_match and is_team_valid).
+	struct KnockoutCacheEntry {
+		int minTeamId;
+		int maxTeamId;
+		unsigned long long version;
+		StatusType status;
+		int winnerId;
 	};
+	KnockoutCacheEntry knockoutCache[KNOCKOUT_CACHE_SIZE];
+	unsigned long long knockoutVersion;
+
+	void invalidate_knockout_cache();
+	KnockoutCacheEntry& knockout_cache_entry(int minTeamId, int maxTeamId);
+
+	// Workers of large get_all_players exports and play_matches batches, started on first use.
+	// Never started by instances sharing pools.
+	ThreadPool* workerPool;
+	bool workerPoolStarted;
+
+	// Starts the worker pool if needed, NULL when single threaded
+	ThreadPool* get_worker_pool();
+
+	// Finds the teams of a match and checks that both can play it
+	StatusType find_match_teams(int teamId1, int teamId2, Team** team1, Team** team2);
+
+	// Tree results of the batch lookups, reused between calls
+	std::vector<TreeStatusType> batchResults;
 
+	// Changes for readers on other threads, every public call publishes its events on return
+	ChangeFeed changeFeed;
+
+	// Updates topScorerId from playersByScore, feeding a change
+	void update_top_scorer();
+	// Feeds a change of the top scorer of team, which was previousTopScorerId before
+	void feed_team_top_scorer(Team* team, int previousTopScorerId);
+
+	// Destroys a team already taken out of teams, with its standings, feeding its removal
+	void discard_team(Team* team);
+
+#ifdef WORLDCUP_METRICS
+	// Call counters and latency histograms of the public APIs. Without metrics the instances
+	// do not carry them, so WORLDCUP_METRICS must be the same in every file including this one.
+	WorldCupStats stats;
+#endif
+
+	// Implementations of the public APIs, the public wrappers only add measurements
+	StatusType add_team_aux(int teamId, int points);
+	StatusType remove_team_aux(int teamId);
+	StatusType add_player_aux(int playerId, int teamId, int gamesPlayed, int goals, int cards, bool goalKeeper);
+	StatusType remove_player_aux(int playerId);
+	StatusType update_player_stats_aux(int playerId, int gamesPlayed, int scoredGoals, int cardsReceived);
+	StatusType play_match_aux(int teamId1, int teamId2);
+	output_t<int> get_num_played_games_aux(int playerId);
+	output_t<int> get_team_points_aux(int teamId);
+	StatusType unite_teams_aux(int teamId1, int teamId2, int newTeamId);
+	output_t<int> get_top_scorer_aux(int teamId);
+	output_t<int> get_all_players_count_aux(int teamId);
+	StatusType get_all_players_aux(int teamId, int* const output);
+	output_t<int> get_closest_player_aux(int playerId, int teamId);
+	output_t<int> knockout_winner_aux(int minTeamId, int maxTeamId);
+	output_t<int> get_scorers_page_aux(int teamId, int firstRank, int count, int* const output);
+	StatusType play_matches_aux(const int* teamIds1, const int* teamIds2, int numMatches, StatusType* const statuses);
+	StatusType get_num_played_games_batch_aux(const int* playerIds, int numIds, int* const answers, StatusType* const statuses);
+	StatusType get_team_points_batch_aux(const int* teamIds, int numIds, int* const answers, StatusType* const statuses);
+	output_t<int> get_team_standings_aux(const AvlTree<TeamStanding, Team*>& standings, int firstRank, int count, int* const output);
+	output_t<int> get_team_rank_aux(const AvlTree<TeamStanding, Team*>& standings, int teamId, bool byStrength);
 
 public:
 	// <DO-NOT-MODIFY> {
@@ -75,6 +201,70 @@ public:
 	output_t<int> knockout_winner(int minTeamId, int maxTeamId);
 
 	// } </DO-NOT-MODIFY>
+
+	// An instance creating its objects in pools shared with other instances, which must outlive it.
+	// It runs single threaded, its calls may be made from any thread (one at a time) that set
+	// object_pool_cache_index() to a cache of its own.
+	explicit world_cup_t(WorldCupPools* sharedPools);
+
+	// Leaderboard pages in the reverse order of get_all_players: writes the ids of
+	// the players ranked firstRank to firstRank + count - 1 (rank 1 is the top scorer) of team
+	// teamId, or of all the players for a negative teamId, into output. Returns the number of
+	// ids written, which is less than count near the end. O(log n + count).
+	output_t<int> get_scorers_page(int teamId, int firstRank, int count, int* const output);
+
+	// Same as get_scorers_page(teamId, 1, count, output)
+	output_t<int> get_top_scorers(int teamId, int count, int* const output);
+
+	// Standings of the teams by points and by match strength (sum_for_match), ties going to the
+	// larger id: writes the ids of the teams ranked firstRank to firstRank + count - 1 (rank 1 is
+	// the top) into output. Returns the number of ids written, which is less than count near the
+	// end. O(log n + count).
+	output_t<int> get_teams_by_points(int firstRank, int count, int* const output);
+	output_t<int> get_teams_by_strength(int firstRank, int count, int* const output);
+
+	// Rank of a team in the standings above, 1 for the top. O(log n).
+	output_t<int> get_team_points_rank(int teamId);
+	output_t<int> get_team_strength_rank(int teamId);
+
+	// Plays match i between teamIds1[i] and teamIds2[i] for every i below numMatches, with the
+	// results of calling play_match on them in order, and writes the status of every match into
+	// statuses. Matches that share no team (directly or through other matches) are independent,
+	// so large batches play those groups in parallel, each group in input order.
+	// Returns ALLOCATION_ERROR when no match was played, with every status set to ALLOCATION_ERROR,
+	// SUCCESS otherwise.
+	StatusType play_matches(const int* teamIds1, const int* teamIds2, int numMatches, StatusType* const statuses);
+
+	// Batch versions of get_num_played_games and get_team_points: the status of ids[i] goes into
+	// statuses[i] and its answer, when found, into answers[i]. The tree lookups run interleaved
+	// (see AvlTree::find_many). Returns INVALID_INPUT for missing arrays or a negative numIds,
+	// ALLOCATION_ERROR when nothing was looked up, SUCCESS otherwise.
+	StatusType get_num_played_games_batch(const int* playerIds, int numIds, int* const answers, StatusType* const statuses);
+	StatusType get_team_points_batch(const int* teamIds, int numIds, int* const answers, StatusType* const statuses);
+
+	// Starts recording changes on the first call and sets cursor to the end of the change feed.
+	// Read the events with get_change_feed().read(), from any thread and at any pace; the events
+	// of one call become visible together when it returns. Returns ALLOCATION_ERROR when the
+	// feed could not be started.
+	StatusType open_change_feed(unsigned long long* cursor);
+	const ChangeFeed& get_change_feed() const;
+
+	// Per API metrics, only recorded when built with WORLDCUP_METRICS, otherwise always empty
+	const WorldCupStats& get_stats() const;
+	void reset_stats();
+	void dump_stats(std::ostream& out) const;
+
+	// Internal counters of the AvlTrees, only recorded when built with AVL_TREE_STATS
+	void dump_tree_stats(std::ostream& out) const;
+
+	// Grows the object and tree node pools to hold this many players and teams, so that adding
+	// and removing them up to those numbers takes no memory from the heap (shared pools grow
+	// the calling thread's cache)
+	StatusType reserve(int players, int teams);
+
+	// Live objects, capacity and heap allocations of the object and tree node pools, summed
+	// over all the instances sharing them
+	void dump_pool_stats(std::ostream& out) const;
 };
 
 #endif // WORLDCUP23A1_H_